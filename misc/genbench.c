@@ -0,0 +1,199 @@
+/* Headless benchmark for the map generators, which also checks that generated worlds are unchanged.
+   Runs the generators over a set of sizes and seeds, times each stage (i.e. each change of Gen_CurrentState),
+   then compares a hash of the generated blocks against the expected hash for that size and seed.
+   Compile with 'make genbench' in the src folder.
+   Copyright 2014-2021 ClassiCube | Licensed under BSD-3
+*/
+#include "Generator.h"
+#include "World.h"
+#include "Platform.h"
+#include "Utils.h"
+#include "Funcs.h"
+#include "Drawer2D.h"
+#include "Window.h"
+#include <stdio.h>
+#include <string.h>
+
+/* The platform and logging code call into some parts of the game, which are provided here instead */
+struct _WorldData World;
+void SysFonts_Register(const cc_string* path) { }
+
+void Window_ShowDialog(const char* title, const char* msg) {
+	printf("%s: %s\n", title, msg);
+}
+
+/*########################################################################################################################*
+*-------------------------------------------------------Test cases--------------------------------------------------------*
+*#########################################################################################################################*/
+static const struct GenCase {
+	cc_bool vanilla;
+	int width, height, length, seed;
+	cc_uint32 hash; /* CRC32 of the generated blocks */
+} cases[] = {
+	{ true,    16,  16,   16,          0, 0xAD12830E }, { true,    16,  16,   16,          1, 0xE00A5262 },
+	{ true,    16,  16,   16,      12345, 0x3B9553D1 }, { true,    16,  16,   16,    -987654, 0x92B5BE73 },
+	{ true,    16,  16,   16, 2147483647, 0xFC859DCF },
+	{ true,   128,  64,  128,          0, 0x572ED8B0 }, { true,   128,  64,  128,          1, 0x90403D50 },
+	{ true,   128,  64,  128,      12345, 0xE68B4073 }, { true,   128,  64,  128,    -987654, 0x7946ECEB },
+	{ true,   128,  64,  128, 2147483647, 0x76932DCD },
+	{ true,   200,  96,  144,          0, 0x4F293054 }, { true,   200,  96,  144,          1, 0xCF4F692A },
+	{ true,   200,  96,  144,      12345, 0xD856F164 }, { true,   200,  96,  144,    -987654, 0xDBFE2667 },
+	{ true,   200,  96,  144, 2147483647, 0x44E7EF90 },
+	{ true,   256,  64,  256,          0, 0x10DDCA9F }, { true,   256,  64,  256,          1, 0x2F0669AA },
+	{ true,   256,  64,  256,      12345, 0x25D16B22 }, { true,   256,  64,  256,    -987654, 0xBC49D687 },
+	{ true,   256,  64,  256, 2147483647, 0xD70371E3 },
+	{ true,   512, 128,  512,          0, 0xB8D876D1 }, { true,   512, 128,  512,          1, 0x06D1F035 },
+	{ true,   512, 128,  512,      12345, 0x31346CCE }, { true,   512, 128,  512,    -987654, 0x5A200A1D },
+	{ true,   512, 128,  512, 2147483647, 0x9B2BC850 },
+	{ true,  1024, 128, 1024,          0, 0xA27EF4A4 },
+	/* Flatgrass ignores the seed, so only one seed per size is needed */
+	{ false,   16,  16,   16,          0, 0xEE9363C3 },
+	{ false,  128,  64,  128,          0, 0x1622F464 },
+	{ false,  200,  96,  144,          0, 0x5DBD3130 },
+	{ false,  256,  64,  256,          0, 0x0025F1D0 },
+	{ false,  512, 128,  512,          0, 0x893B18E1 },
+	{ false, 1024, 128, 1024,          0, 0x752ADC79 }
+};
+
+
+/*########################################################################################################################*
+*---------------------------------------------------------Stages----------------------------------------------------------*
+*#########################################################################################################################*/
+#define GEN_MAX_STAGES 32
+/* Total time spent in a stage, across every test case */
+static struct GenStage {
+	const char* name;
+	cc_uint64 elapsed; /* Time spent in this stage in microseconds */
+	double blocks;     /* Number of blocks generated while in this stage */
+} stages[GEN_MAX_STAGES];
+static int stagesCount;
+
+static struct GenStage* GenBench_GetStage(const char* name) {
+	int i;
+	for (i = 0; i < stagesCount; i++) {
+		if (!strcmp(stages[i].name, name)) return &stages[i];
+	}
+
+	if (stagesCount == GEN_MAX_STAGES) return NULL;
+	stages[stagesCount].name = name;
+	return &stages[stagesCount++];
+}
+
+static double GenBench_Throughput(double blocks, cc_uint64 elapsed) {
+	return elapsed ? (blocks / (1000.0 * 1000.0)) / (elapsed / (1000.0 * 1000.0)) : 0.0;
+}
+
+static void GenBench_AddStage(const char* name, cc_uint64 beg, cc_uint64 end) {
+	struct GenStage* stage;
+	cc_uint64 elapsed = Stopwatch_ElapsedMicroseconds(beg, end);
+
+	printf("  %-24s %9.2f ms (%8.2f M blocks/s)\n", name, elapsed / 1000.0,
+		GenBench_Throughput(World.Volume, elapsed));
+	if (!(stage = GenBench_GetStage(name))) return;
+
+	stage->elapsed += elapsed;
+	stage->blocks  += World.Volume;
+}
+
+
+/*########################################################################################################################*
+*-------------------------------------------------------Benchmark---------------------------------------------------------*
+*#########################################################################################################################*/
+static cc_uint64 totalElapsed[2];
+static double totalBlocks[2];
+
+static void GenBench_SetDimensions(int width, int height, int length) {
+	World.Width  = width; World.Height = height; World.Length = length;
+	World.Volume = width * height * length;
+
+	World.OneY = width * length;
+	World.MaxX = width  - 1;
+	World.MaxY = height - 1;
+	World.MaxZ = length - 1;
+}
+
+static const char* curState;
+static cc_uint64 stateBeg;
+
+static void GenBench_BeginState(const char* state) {
+	cc_uint64 now = Stopwatch_Measure();
+	if (curState) GenBench_AddStage(curState, stateBeg, now);
+
+	curState = state;
+	stateBeg = now;
+}
+
+/* Generates the map on this thread, while timing how long the generator spends in each stage */
+static cc_uint64 GenBench_Generate(cc_bool vanilla) {
+	cc_uint64 beg = Stopwatch_Measure(), end;
+	curState = NULL;
+
+	if (vanilla) {
+		NotchyGen_Generate();
+	} else {
+		FlatgrassGen_Generate();
+	}
+
+	end = Stopwatch_Measure();
+	if (curState) GenBench_AddStage(curState, stateBeg, end);
+	return Stopwatch_ElapsedMicroseconds(beg, end);
+}
+
+/* Generates the map for the given test case, and checks the generated blocks are as expected */
+static cc_bool GenBench_Run(const struct GenCase* c) {
+	cc_uint64 elapsed;
+	cc_uint32 hash;
+
+	GenBench_SetDimensions(c->width, c->height, c->length);
+	Gen_Seed    = c->seed;
+	Gen_Vanilla = c->vanilla;
+	Gen_Blocks  = (BlockRaw*)Mem_TryAlloc(World.Volume, 1);
+
+	printf("%s %dx%dx%d seed %d\n", c->vanilla ? "NotchyGen" : "FlatgrassGen",
+		c->width, c->height, c->length, c->seed);
+	if (!Gen_Blocks) { printf("  Not enough memory to generate map\n"); return false; }
+
+	elapsed = GenBench_Generate(c->vanilla);
+	hash    = Utils_CRC32(Gen_Blocks, World.Volume);
+	Mem_Free(Gen_Blocks);
+
+	printf("  %-24s %9.2f ms (%8.2f M blocks/s)\n", "Total", elapsed / 1000.0,
+		GenBench_Throughput(World.Volume, elapsed));
+	totalElapsed[c->vanilla] += elapsed;
+	totalBlocks[c->vanilla]  += World.Volume;
+
+	if (hash == c->hash) return true;
+	printf("  MISMATCH: expected hash %08X, got %08X\n", c->hash, hash);
+	return false;
+}
+
+static void GenBench_PrintTotals(void) {
+	int i;
+	printf("\nTotal time per stage:\n");
+
+	for (i = 0; i < stagesCount; i++) {
+		printf("  %-24s %9.2f ms (%8.2f M blocks/s)\n", stages[i].name, stages[i].elapsed / 1000.0,
+			GenBench_Throughput(stages[i].blocks, stages[i].elapsed));
+	}
+	printf("  %-24s %9.2f ms (%8.2f M blocks/s)\n", "FlatgrassGen", totalElapsed[false] / 1000.0,
+		GenBench_Throughput(totalBlocks[false], totalElapsed[false]));
+	printf("  %-24s %9.2f ms (%8.2f M blocks/s)\n", "NotchyGen", totalElapsed[true] / 1000.0,
+		GenBench_Throughput(totalBlocks[true], totalElapsed[true]));
+}
+
+int main(void) {
+	int i, failed = 0;
+	Platform_Init();
+	Gen_StateFunc = GenBench_BeginState;
+	/* Show results as each case finishes, even when output is redirected */
+	setvbuf(stdout, NULL, _IONBF, 0);
+
+	for (i = 0; i < Array_Elems(cases); i++) {
+		if (!GenBench_Run(&cases[i])) failed++;
+	}
+	GenBench_PrintTotals();
+
+	if (failed) printf("\n%d of %d maps did not match the expected output\n", failed, (int)Array_Elems(cases));
+	else        printf("\nAll %d maps matched the expected output\n", (int)Array_Elems(cases));
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,239 @@
+/* Headless tool for converting maps between formats, and for verifying/benchmarking the map importers and exporters.
+   Links only the map format, world, compression and platform code, so needs no window or graphics context.
+   Compile with 'make maptool' in the src folder.
+   Copyright 2014-2021 ClassiCube | Licensed under BSD-3
+*/
+#include "Formats.h"
+#include "World.h"
+#include "Block.h"
+#include "Entity.h"
+#include "Server.h"
+#include "Deflate.h"
+#include "Stream.h"
+#include "String.h"
+#include "Platform.h"
+#include "Logger.h"
+#include "Utils.h"
+#include "Funcs.h"
+#include "Game.h"
+#include "Chat.h"
+#include "Screens.h"
+#include "Drawer2D.h"
+#include "TexturePack.h"
+#include "Window.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*########################################################################################################################*
+*---------------------------------------------------Headless game state---------------------------------------------------*
+*#########################################################################################################################*/
+/* Map importers/exporters read and write some game state, which is provided here instead of by the game */
+struct _BlockLists Blocks;
+struct _ServerConnectionData Server;
+struct LocalPlayer LocalPlayer_Instance;
+cc_bool Game_AllowCustomBlocks = true;
+cc_string Game_Username = String_FromConst("maptool");
+cc_string TexturePack_Url;
+
+static cc_uint8 defined[BLOCK_COUNT];
+static char nameBuffers[BLOCK_COUNT][STRING_SIZE];
+static cc_string names[BLOCK_COUNT];
+
+cc_bool Block_IsCustomDefined(BlockID block) { return defined[block]; }
+void Block_DefineCustom(BlockID block)       { defined[block] = true; }
+void Block_SetCollide(BlockID block, cc_uint8 collide) { Blocks.Collide[block] = collide; }
+
+cc_string Block_UNSAFE_GetName(BlockID block) { return names[block]; }
+void Block_SetName(BlockID block, const cc_string* name) {
+	String_InitArray(names[block], nameBuffers[block]);
+	String_AppendString(&names[block], name);
+}
+
+void Game_Reset(void) { World_NewMap(); }
+int ScheduledTask_Add(double interval, ScheduledTaskCallback callback) { return 0; }
+int Options_GetInt(const char* key, int min, int max, int defValue) { return defValue; }
+
+void Chat_AddRaw(const char* raw) { }
+void Chat_Add1(const char* format, const void* a1) { }
+void LocalPlayer_MoveToSpawn(void) { }
+void Entity_GetBounds(struct Entity* e, struct AABB* bb) { }
+void Entity_GetPickingBounds(struct Entity* e, struct AABB* bb) { }
+void MapImportingScreen_Show(const cc_string* path) { }
+void Server_RetrieveTexturePack(const cc_string* url) { }
+void SysFonts_Register(const cc_string* path) { }
+
+static void MapTool_Print(const cc_string* msg) {
+	printf("%.*s\n", msg->length, msg->buffer);
+}
+void Window_ShowDialog(const char* title, const char* msg) {
+	printf("%s: %s\n", title, msg);
+}
+
+
+/*########################################################################################################################*
+*------------------------------------------------------Map tool-----------------------------------------------------------*
+*#########################################################################################################################*/
+static const struct MapFormat {
+	const char* ext;
+	IMapExporter exporter;
+	cc_bool gzip; /* Whether output of exporter should be GZIP compressed */
+} formats[3] = {
+	{ ".cw",        Cw_Save,        true  },
+	{ ".schematic", Schematic_Save, true  },
+	{ ".ccr",       Ccr_Save,       false }
+};
+
+struct MapHash { int width, height, length; cc_uint32 lower, upper; };
+
+static const struct MapFormat* MapTool_FindFormat(const cc_string* path) {
+	cc_string ext;
+	int i;
+
+	for (i = 0; i < Array_Elems(formats); i++) {
+		ext = String_FromReadonly(formats[i].ext);
+		if (String_CaselessEnds(path, &ext)) return &formats[i];
+	}
+	return NULL;
+}
+
+static void MapTool_PrintTime(const char* action, const cc_string* path, cc_uint64 elapsed) {
+	double mb = World.Volume / (1024.0 * 1024.0);
+	double ms = elapsed / 1000.0;
+
+	printf("%s %.*s: %dx%dx%d in %.2f ms (%.2f MB/s)\n", action, path->length, path->buffer,
+		World.Width, World.Height, World.Length, ms, ms ? mb / (ms / 1000.0) : 0.0);
+}
+
+static void MapTool_Hash(struct MapHash* hash) {
+	hash->width  = World.Width;
+	hash->height = World.Height;
+	hash->length = World.Length;
+	hash->lower  = Utils_CRC32(World.Blocks, World.Volume);
+	hash->upper  = 0;
+#ifdef EXTENDED_BLOCKS
+	if (World.Blocks2 != World.Blocks) hash->upper = Utils_CRC32(World.Blocks2, World.Volume);
+#endif
+}
+
+/* Loads the given map, the same way the game does */
+static cc_bool MapTool_Load(const cc_string* path) {
+	cc_uint64 beg = Stopwatch_Measure();
+	if (Map_LoadFrom(path)) return false;
+
+	while (!Map_ImportDone) { Thread_Sleep(1); }
+	Map_EndImport();
+	if (!World.Blocks) return false;
+
+	MapTool_PrintTime("Loaded", path, Stopwatch_ElapsedMicroseconds(beg, Stopwatch_Measure()));
+	return true;
+}
+
+/* Saves the current map to the given file, the same way the game does */
+static cc_result MapTool_Save(const cc_string* path, const struct MapFormat* format) {
+	struct Stream stream, compStream, *output;
+	struct GZipState state;
+	cc_uint64 beg = Stopwatch_Measure();
+	cc_result res, closeRes;
+
+	if ((res = Stream_CreateFile(&stream, path))) { Logger_SysWarn2(res, "creating", path); return res; }
+	output = &stream;
+
+	if (format->gzip) {
+		GZip_MakeParallelStream(&compStream, &state, &stream);
+		output = &compStream;
+	}
+
+	res = format->exporter(output);
+	/* Still need to close to free the compressor threads */
+	if (format->gzip) {
+		closeRes = compStream.Close(&compStream);
+		if (!res) res = closeRes;
+	}
+
+	closeRes = stream.Close(&stream);
+	if (!res) res = closeRes;
+	if (res) { Logger_SysWarn2(res, "encoding", path); return res; }
+
+	MapTool_PrintTime("Saved", path, Stopwatch_ElapsedMicroseconds(beg, Stopwatch_Measure()));
+	return 0;
+}
+
+static int MapTool_Convert(const cc_string* src, const cc_string* dst) {
+	const struct MapFormat* format = MapTool_FindFormat(dst);
+	if (!format) { printf("Cannot save maps to %.*s\n", dst->length, dst->buffer); return 1; }
+
+	if (!MapTool_Load(src)) return 1;
+	return MapTool_Save(dst, format) ? 1 : 0;
+}
+
+/* Saves the map to every exportable format, then checks the blocks are the same after loading it back */
+static int MapTool_Verify(const cc_string* src) {
+	char name[32];
+	cc_string path;
+	struct MapHash expected, actual;
+	int i, failed = 0;
+	if (!MapTool_Load(src)) return 1;
+
+	MapTool_Hash(&expected);
+	printf("Hash: %08X %08X\n", expected.lower, expected.upper);
+
+	for (i = 0; i < Array_Elems(formats); i++) {
+		sprintf(name, "maptool-verify%s", formats[i].ext);
+		path = String_FromReadonly(name);
+
+		if (MapTool_Save(&path, &formats[i])) {
+			failed++;
+		} else if (!Map_FindImporter(&path)) {
+			printf("Skipped verifying %s: format can only be exported\n", formats[i].ext);
+		} else if (!MapTool_Load(&path)) {
+			failed++;
+		} else {
+			MapTool_Hash(&actual);
+			if (Mem_Equal(&expected, &actual, sizeof(expected))) {
+				printf("Verified %s\n", formats[i].ext);
+			} else {
+				printf("MISMATCH %s: %dx%dx%d %08X %08X\n", formats[i].ext, actual.width,
+					actual.height, actual.length, actual.lower, actual.upper);
+				failed++;
+			}
+		}
+
+		remove(name);
+		/* Loading the saved map replaced the world, so load the original map again for the next format */
+		if (i < Array_Elems(formats) - 1 && !MapTool_Load(src)) return 1;
+	}
+	return failed ? 1 : 0;
+}
+
+static int MapTool_Usage(void) {
+	printf("Usage: maptool convert [input map] [output map]\n");
+	printf("       maptool verify  [input map]\n");
+	printf("Supported output formats: .cw, .schematic, .ccr\n");
+	return 1;
+}
+
+int main(int argc, char** argv) {
+	cc_string cmd, src, dst;
+	int res;
+	if (argc < 3) return MapTool_Usage();
+
+	cmd = String_FromReadonly(argv[1]);
+	src = String_FromReadonly(argv[2]);
+	if (String_CaselessEqualsConst(&cmd, "convert") && argc < 4) return MapTool_Usage();
+
+	Platform_Init();
+	Logger_WarnFunc = MapTool_Print;
+	Formats_Component.Init();
+
+	if (String_CaselessEqualsConst(&cmd, "convert")) {
+		dst = String_FromReadonly(argv[3]);
+		res = MapTool_Convert(&src, &dst);
+	} else if (String_CaselessEqualsConst(&cmd, "verify")) {
+		res = MapTool_Verify(&src);
+	} else {
+		res = MapTool_Usage();
+	}
+
+	Formats_Component.Free();
+	return res;
+}
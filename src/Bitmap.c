@@ -6,6 +6,7 @@
 #include "Stream.h"
 #include "Errors.h"
 #include "Utils.h"
+#include "Funcs.h"
 
 BitmapCol BitmapColor_Offset(BitmapCol color, int rBy, int gBy, int bBy) {
 	int r, g, b;
@@ -324,7 +325,7 @@ static void ComputeTransparency(struct Bitmap* bmp, BitmapCol col) {
 #define PNG_BUFFER_SIZE ((PNG_MAX_DIMS * 2 * 4 + 1) * 2)
 
 /* TODO: Test a lot of .png files and ensure output is right */
-cc_result Png_Decode(struct Bitmap* bmp, struct Stream* stream) {
+static cc_result Png_DecodeImage(struct Bitmap* bmp, struct Stream* stream, cc_uint8* buffer) {
 	cc_uint8 tmp[PNG_PALETTE * 3];
 	cc_uint32 dataSize, fourCC;
 	cc_result res;
@@ -342,7 +343,6 @@ cc_result Png_Decode(struct Bitmap* bmp, struct Stream* stream) {
 
 	/* idat state */
 	cc_uint32 curY = 0, begY, rowY, endY;
-	cc_uint8 buffer[PNG_BUFFER_SIZE];
 	cc_uint32 bufferRows, bufferLen;
 	cc_uint32 bufferIdx, read, left;
 
@@ -351,9 +351,6 @@ cc_result Png_Decode(struct Bitmap* bmp, struct Stream* stream) {
 	struct Stream compStream, datStream;
 	struct ZLibHeader zlibHeader;
 
-	bmp->width = 0; bmp->height = 0;
-	bmp->scan0 = NULL;
-
 	res = Stream_Read(stream, tmp, PNG_SIG_SIZE);
 	if (res) return res;
 	if (!Png_Detect(tmp, PNG_SIG_SIZE)) return PNG_ERR_INVALID_SIG;
@@ -514,6 +511,60 @@ cc_result Png_Decode(struct Bitmap* bmp, struct Stream* stream) {
 	}
 }
 
+static cc_result DecodedPng_Read(struct Stream* s, cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	struct DecodedPng* png = (struct DecodedPng*)s->Meta.Inflate;
+	count = min(count, png->size - png->read);
+	Mem_Copy(data, png->data + png->read, count);
+
+	png->read += count;
+	*modified  = count;
+	return 0;
+}
+
+static cc_result DecodedPng_Close(struct Stream* s) {
+	struct DecodedPng* png = (struct DecodedPng*)s->Meta.Inflate;
+	Mem_Free(png->bmp.scan0);
+	png->bmp.scan0 = NULL;
+	return 0;
+}
+
+void Png_MakeDecodedStream(struct Stream* stream, struct DecodedPng* png) {
+	Stream_Init(stream);
+	stream->Meta.Inflate = png;
+	stream->Read  = DecodedPng_Read;
+	stream->Close = DecodedPng_Close;
+	png->read     = 0;
+}
+
+cc_result Png_Decode(struct Bitmap* bmp, struct Stream* stream) {
+	struct DecodedPng* png;
+	cc_uint8* buffer;
+	cc_result res;
+
+	bmp->width = 0; bmp->height = 0;
+	bmp->scan0 = NULL;
+
+	/* Image was already decoded (e.g. on a background thread), so just take the result */
+	if (stream->Read == DecodedPng_Read) {
+		png  = (struct DecodedPng*)stream->Meta.Inflate;
+		*bmp = png->bmp;
+		res  = png->res;
+
+		png->bmp.width = 0; png->bmp.height = 0;
+		png->bmp.scan0 = NULL;
+		png->res       = ERR_END_OF_STREAM;
+		return res;
+	}
+
+	/* Row buffer is too large to safely put on the stack of background threads */
+	buffer = (cc_uint8*)Mem_TryAlloc(PNG_BUFFER_SIZE, 1);
+	if (!buffer) return ERR_OUT_OF_MEMORY;
+
+	res = Png_DecodeImage(bmp, stream, buffer);
+	Mem_Free(buffer);
+	return res;
+}
+
 
 /*########################################################################################################################*
 *------------------------------------------------------PNG encoder--------------------------------------------------------*
@@ -84,6 +84,13 @@ typedef BitmapCol* (*Png_RowGetter)(struct Bitmap* bmp, int row);
      https://github.com/nothings/stb/blob/master/stb_image.h
 */
 CC_API cc_result Png_Decode(struct Bitmap* bmp, struct Stream* stream);
+
+/* Raw file data, along with the result of having already decoded it as a PNG. */
+struct DecodedPng { cc_uint8* data; cc_uint32 size, read; struct Bitmap bmp; cc_result res; };
+/* Wraps an already decoded PNG in a stream that reads its raw file data. */
+/* NOTE: Png_Decode on this stream takes ownership of the decoded bitmap instead of decoding again. */
+/* NOTE: Closing the stream frees the decoded bitmap if it was not taken by Png_Decode. */
+CC_API void Png_MakeDecodedStream(struct Stream* stream, struct DecodedPng* png);
 /* Encodes a bitmap in PNG format. */
 /* getRow is optional. Can be used to modify how rows are encoded. (e.g. flip image) */
 /* if alpha is non-zero, RGBA channels are saved, otherwise only RGB channels are. */
@@ -486,6 +486,30 @@ static struct ChatCommand ModelCommand = {
 	}
 };
 
+static void NetStatsCommand_Execute(const cc_string* args, int argsCount) {
+	static const cc_string path = String_FromConst("netstats.csv");
+	cc_result res;
+
+	if (argsCount && String_CaselessEqualsConst(&args[0], "dump")) {
+		res = Net_DumpStats(&path);
+		if (res) { Logger_SysWarn2(res, "writing", &path); return; }
+		Chat_Add1("&e/client: &fNetwork statistics written to &e%s", &path);
+	} else {
+		Net_ShowStats = !Net_ShowStats;
+		Chat_Add1("&e/client: &fNetwork statistics overlay is now &e%c", Net_ShowStats ? "on" : "off");
+	}
+}
+
+static struct ChatCommand NetStatsCommand = {
+	"NetStats", NetStatsCommand_Execute,
+	0,
+	{
+		"&a/client netstats [dump]",
+		"&eToggles an overlay showing which packet types take the most time to handle.",
+		"&bdump: &eWrites statistics for every packet type to netstats.csv",
+	}
+};
+
 static void ClearDeniedCommand_Execute(const cc_string* args, int argsCount) {
 	int count = TextureCache_ClearDenied();
 	Chat_Add1("Removed &e%i &fdenied texture pack URLs.", &count);
@@ -669,6 +693,7 @@ static void OnInit(void) {
 	Commands_Register(&CuboidCommand);
 	Commands_Register(&TeleportCommand);
 	Commands_Register(&ClearDeniedCommand);
+	Commands_Register(&NetStatsCommand);
 
 #if defined CC_BUILD_MOBILE || defined CC_BUILD_WEB
 	/* Better to not log chat by default on mobile/web, */
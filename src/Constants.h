@@ -5,7 +5,7 @@ Defines useful constants
 Copyright 2014-2022 ClassiCube | Licensed under BSD-3
 */
 
-#define GAME_MAX_CMDARGS 5
+#define GAME_MAX_CMDARGS 6
 #define GAME_APP_VER "1.3.2"
 #define GAME_API_VER 1
 
@@ -142,7 +142,7 @@ enum INFLATE_STATE_ {
 };
 
 /* Insert next byte into the bit buffer */
-#define Inflate_GetByte(state) state->AvailIn--; state->Bits |= (cc_uint32)(*state->NextIn++) << state->NumBits; state->NumBits += 8;
+#define Inflate_GetByte(state) state->AvailIn--; state->Bits |= (cc_uint64)(*state->NextIn++) << state->NumBits; state->NumBits += 8;
 /* Retrieves bits from the bit buffer */
 #define Inflate_PeekBits(state, bits) (state->Bits & ((1UL << (bits)) - 1UL))
 /* Consumes/eats up bits from the bit buffer */
@@ -151,8 +151,6 @@ enum INFLATE_STATE_ {
 #define Inflate_AlignBits(state) cc_uint32 alignSkip = state->NumBits & 7; Inflate_ConsumeBits(state, alignSkip);
 /* Ensures there are 'bitsCount' bits, or returns if not */
 #define Inflate_EnsureBits(state, bitsCount) while (state->NumBits < bitsCount) { if (!state->AvailIn) return; Inflate_GetByte(state); }
-/* Ensures there are 'bitsCount' bits */
-#define Inflate_UNSAFE_EnsureBits(state, bitsCount) while (state->NumBits < bitsCount) { Inflate_GetByte(state); }
 /* Peeks then consumes given bits */
 #define Inflate_ReadBits(state, bitsCount) Inflate_PeekBits(state, bitsCount); Inflate_ConsumeBits(state, bitsCount);
 /* Sets to given result and sets state to DONE */
@@ -164,8 +162,8 @@ enum INFLATE_STATE_ {
 #define Inflate_NextCompressState(state) ((state->AvailIn >= INFLATE_FASTINF_IN && state->AvailOut >= INFLATE_FASTINF_OUT) ? INFLATE_STATE_FASTCOMPRESSED : INFLATE_STATE_COMPRESSED_LIT)
 /* The maximum amount of bytes that can be output is 258 */
 #define INFLATE_FASTINF_OUT 258
-/* The most input bytes required for huffman codes and extra data is 16 + 5 + 16 + 13 bits. Add 3 extra bytes to account for putting data into the bit buffer. */
-#define INFLATE_FASTINF_IN 10
+/* The bit buffer is refilled by reading 8 bytes at once, which can consume up to 7 bytes */
+#define INFLATE_FASTINF_IN 16
 
 static cc_uint32 Huffman_ReverseBits(cc_uint32 n, cc_uint8 bits) {
 	n = ((n & 0xAAAA) >> 1) | ((n & 0x5555) << 1);
@@ -175,8 +173,27 @@ static cc_uint32 Huffman_ReverseBits(cc_uint32 n, cc_uint8 bits) {
 	return n >> (16 - bits);
 }
 
+/* Entries in the fast lookup table are packed as follows: */
+/*  bits 0-3 codeword length (0 if codeword is longer than INFLATE_FAST_BITS), bits 4-12 value, */
+/*  bits 13-16 number of extra bits and bits 17-31 base length/distance (only for lengths/distances) */
+#define Huffman_EntryBits(entry)  ((entry) & 0x0F)
+#define Huffman_EntryValue(entry) (((entry) >> 4) & 0x1FF)
+#define Huffman_EntryExtra(entry) (((entry) >> 13) & 0x0F)
+#define Huffman_EntryBase(entry)  ((entry) >> 17)
+
+/* Packs the given value and codeword length, and base/extra bits if the value represents a length/distance */
+static cc_uint32 Huffman_MakeEntry(int value, int len, const cc_uint16* bases, const cc_uint8* extras, int first) {
+	cc_uint32 entry = (cc_uint32)(value << 4) | len;
+	if (!bases || value < first) return entry;
+
+	return entry | ((cc_uint32)extras[value - first] << 13) | ((cc_uint32)bases[value - first] << 17);
+}
+
 /* Builds a huffman tree, based on input lengths of each codeword */
-static cc_result Huffman_Build(struct HuffmanTable* table, const cc_uint8* bitLens, int count) {
+/* If bases is non NULL, values from first onwards also have their base and extra bits put in fast lookup table */
+/*  (so that lengths and distances can be decoded without another table lookup) */
+static cc_result Huffman_Build(struct HuffmanTable* table, const cc_uint8* bitLens, int count,
+								const cc_uint16* bases, const cc_uint8* extras, int first) {
 	int bl_count[INFLATE_MAX_BITS], bl_offsets[INFLATE_MAX_BITS];
 	int code, offset, value;
 	int i, j;
@@ -229,7 +246,7 @@ static cc_result Huffman_Build(struct HuffmanTable* table, const cc_uint8* bitLe
 	*  Some values may also not be assigned to any codeword.
 	*/
 	value = 0;
-	Mem_Set(table->Fast, UInt8_MaxValue, sizeof(table->Fast));
+	Mem_Set(table->Fast, 0, sizeof(table->Fast));
 	for (i = 0; i < count; i++, value++) {
 		int len = bitLens[i];
 		if (!len) continue;
@@ -243,7 +260,7 @@ static cc_result Huffman_Build(struct HuffmanTable* table, const cc_uint8* bitLe
 		*   - set fast value to specify a 'value' value, and to skip 'len' bits
 		*/
 		if (len <= INFLATE_FAST_BITS) {
-			cc_int16 packed = (cc_int16)((len << INFLATE_FAST_BITS) | value);
+			cc_uint32 packed = Huffman_MakeEntry(value, len, bases, extras, first);
 			int codeword = table->FirstCodewords[len] + (bl_offsets[len] - table->FirstOffsets[len]);
 			codeword <<= (INFLATE_FAST_BITS - len);
 
@@ -260,8 +277,8 @@ static cc_result Huffman_Build(struct HuffmanTable* table, const cc_uint8* bitLe
 /* Attempts to read the next huffman encoded value from the bitstream, using given table */
 /* Returns -1 if there are insufficient bits to read the value */
 static int Huffman_Decode(struct InflateState* state, struct HuffmanTable* table) {
-	cc_uint32 i, j, codeword;
-	int packed, bits, offset;
+	cc_uint32 i, j, codeword, packed;
+	int bits, offset;
 
 	/* Buffer as many bits as possible */
 	while (state->NumBits <= INFLATE_MAX_BITS) {
@@ -272,10 +289,10 @@ static int Huffman_Decode(struct InflateState* state, struct HuffmanTable* table
 	/* Try fast accelerated table lookup */
 	if (state->NumBits >= INFLATE_FAST_BITS) {
 		packed = table->Fast[Inflate_PeekBits(state, INFLATE_FAST_BITS)];
-		if (packed >= 0) {
-			bits = packed >> INFLATE_FAST_BITS;
+		if (packed) {
+			bits = Huffman_EntryBits(packed);
 			Inflate_ConsumeBits(state, bits);
-			return packed & 0x1FF;
+			return Huffman_EntryValue(packed);
 		}
 	}
 
@@ -296,43 +313,25 @@ static int Huffman_Decode(struct InflateState* state, struct HuffmanTable* table
 	return -1;
 }
 
-/* Inline the common <= 9 bits case */
-#define Huffman_UNSAFE_Decode(state, table, result) \
-{\
-	Inflate_UNSAFE_EnsureBits(state, INFLATE_MAX_BITS);\
-	packed = table.Fast[Inflate_PeekBits(state, INFLATE_FAST_BITS)];\
-	if (packed >= 0) {\
-		consumedBits = packed >> INFLATE_FAST_BITS;\
-		Inflate_ConsumeBits(state, consumedBits);\
-		result = packed & 0x1FF;\
-	} else {\
-		result = Huffman_UNSAFE_Decode_Slow(state, &table);\
-	}\
-}
-
-static int Huffman_UNSAFE_Decode_Slow(struct InflateState* state, struct HuffmanTable* table) {
+/* Returns the fast lookup table style entry for a codeword longer than INFLATE_FAST_BITS, */
+/*  or 0 if the codeword is invalid. (bits must have at least INFLATE_MAX_BITS bits) */
+static cc_uint32 Huffman_SlowEntry(const struct HuffmanTable* table, cc_uint32 bits,
+									const cc_uint16* bases, const cc_uint8* extras, int first) {
 	cc_uint32 i, j, codeword;
 	int offset;
 
 	/* Slow, bit by bit lookup. Need to reverse order for huffman. */
-	codeword = Inflate_PeekBits(state,       INFLATE_FAST_BITS);
+	codeword = bits & ((1UL << INFLATE_FAST_BITS) - 1);
 	codeword = Huffman_ReverseBits(codeword, INFLATE_FAST_BITS);
 
 	for (i = INFLATE_FAST_BITS + 1, j = INFLATE_FAST_BITS; i < INFLATE_MAX_BITS; i++, j++) {
-		codeword = (codeword << 1) | ((state->Bits >> j) & 1);
+		codeword = (codeword << 1) | ((bits >> j) & 1);
 
 		if (codeword < table->EndCodewords[i]) {
 			offset = table->FirstOffsets[i] + (codeword - table->FirstCodewords[i]);
-			Inflate_ConsumeBits(state, i);
-			return table->Values[offset];
+			return Huffman_MakeEntry(table->Values[offset], i, bases, extras, first);
 		}
 	}
-
-	Inflate_Fail(state, INF_ERR_INVALID_CODE);
-	/* Need to exit the fast decode loop */
-	/* TODO: This means a few garbage bytes can get written */
-	/* to the output, but it probably doesn't matter */
-	state->AvailIn = 0;
 	return 0;
 }
 
@@ -344,6 +343,7 @@ void Inflate_Init2(struct InflateState* state, struct Stream* source) {
 	state->NextIn  = state->Input;
 	state->AvailIn = 0;
 	state->Output = NULL;
+	state->OutputBeg = NULL;
 	state->AvailOut = 0;
 	state->Source = source;
 	state->WindowIndex = 0;
@@ -389,80 +389,189 @@ static const cc_uint8 codelens_order[INFLATE_MAX_CODELENS] = {
 	16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 
 };
 
-static void Inflate_InflateFast(struct InflateState* s) {
-	/* huffman variables */
-	cc_uint32 lit, len, dist;
-	cc_uint32 bits, lenIdx, distIdx;
-	int packed, consumedBits;
+#if defined __GNUC__ && !defined CC_BIG_ENDIAN
+/* Reads 8 bytes as a little endian 64 bit integer */
+static CC_INLINE cc_uint64 Inflate_GetU64(const cc_uint8* src) {
+	cc_uint64 value; __builtin_memcpy(&value, src, 8); return value;
+}
+#define Inflate_Copy8(dst, src) __builtin_memcpy(dst, src, 8)
+#else
+static CC_INLINE cc_uint64 Inflate_GetU64(const cc_uint8* src) {
+	return (cc_uint64)src[0]       | ((cc_uint64)src[1] << 8)  | ((cc_uint64)src[2] << 16) | ((cc_uint64)src[3] << 24) |
+		  ((cc_uint64)src[4] << 32) | ((cc_uint64)src[5] << 40) | ((cc_uint64)src[6] << 48) | ((cc_uint64)src[7] << 56);
+}
+#define Inflate_Copy8(dst, src) (dst)[0] = (src)[0]; (dst)[1] = (src)[1]; (dst)[2] = (src)[2]; (dst)[3] = (src)[3];\
+								(dst)[4] = (src)[4]; (dst)[5] = (src)[5]; (dst)[6] = (src)[6]; (dst)[7] = (src)[7];
+#endif
+
+/* Copies a back-reference of at least 8 bytes, where distance is also at least 8 bytes */
+/* NOTE: Never writes past dst + len, as that would overwrite the oldest data in the window */
+static CC_INLINE void Inflate_CopyChunks(cc_uint8* dst, cc_uint8* src, cc_uint32 len, cc_uint32 dist) {
+	cc_uint32 i = 0;
+	/* Chunks can't read bytes they write themselves, as distance is at least chunk size */
+	if (dist >= 16) {
+		for (; i + 16 <= len; i += 16) {
+			Inflate_Copy8(dst + i, src + i); Inflate_Copy8(dst + i + 8, src + i + 8);
+		}
+	}
+	for (; i + 8 <= len; i += 8) { Inflate_Copy8(dst + i, src + i); }
 
-	/* window variables */
-	cc_uint8* window;
-	cc_uint32 i, curIdx, startIdx;
-	cc_uint32 copyStart, copyLen, partLen;
+	/* Overlap last chunk with already copied bytes (which just rewrites them with same values) */
+	if (i < len) { i = len - 8; Inflate_Copy8(dst + i, src + i); }
+}
 
-	window = s->Window;
-	curIdx = s->WindowIndex;
-	copyStart = s->WindowIndex;
-	copyLen   = 0;
+/* Copies a back-reference, where source is either before or overlaps with destination */
+static CC_INLINE void Inflate_CopyMatch(cc_uint8* dst, cc_uint8* src, cc_uint32 len, cc_uint32 dist) {
+	cc_uint32 i;
+	if (dist >= 8 && len >= 8) { Inflate_CopyChunks(dst, src, len, dist); return; }
 
-#define INFLATE_FAST_COPY_MAX (INFLATE_WINDOW_SIZE - INFLATE_FASTINF_OUT)
-	while (s->AvailOut >= INFLATE_FASTINF_OUT && s->AvailIn >= INFLATE_FASTINF_IN && copyLen < INFLATE_FAST_COPY_MAX) {
-		Huffman_UNSAFE_Decode(s, s->Table.Lits, lit);
+	for (i = 0; i < (len & ~0x3); i += 4) {
+		*dst++ = *src++; *dst++ = *src++; *dst++ = *src++; *dst++ = *src++;
+	}
+	for (; i < len; i++) { *dst++ = *src++; }
+}
 
-		if (lit <= 256) {
-			if (lit < 256) {
-				window[curIdx] = (cc_uint8)lit;
-				s->AvailOut--; copyLen++;
-				curIdx = (curIdx + 1) & INFLATE_WINDOW_MASK;
-			} else {
-				s->State = Inflate_NextBlockState(s);
-				break;
+/* Copies a back-reference which starts 'back' bytes before OutputBeg (i.e. in the window) */
+static void Inflate_CopyFromWindow(struct InflateState* s, cc_uint8* dst, cc_uint32 len, cc_uint32 back) {
+	cc_uint32 i, startIdx, windowLen;
+	startIdx  = (s->WindowIndex - back) & INFLATE_WINDOW_MASK;
+	windowLen = min(len, back);
+
+	for (i = 0; i < windowLen; i++) {
+		dst[i] = s->Window[(startIdx + i) & INFLATE_WINDOW_MASK];
+	}
+	/* Rest of the back-reference is from the start of output */
+	for (; i < len; i++) { dst[i] = s->OutputBeg[i - windowLen]; }
+}
+
+/* Copies the most recent output data that hasn't been copied into the window yet */
+/* NOTE: Only the last 32 KB of output needs to be copied, as back-references can't go back any further */
+static void Inflate_SyncWindow(struct InflateState* s) {
+	cc_uint32 len, partLen;
+	cc_uint8* src;
+
+	len = (cc_uint32)(s->Output - s->OutputBeg);
+	if (!len) return;
+	src = s->OutputBeg;
+
+	if (len > INFLATE_WINDOW_SIZE) {
+		src = s->Output - INFLATE_WINDOW_SIZE;
+		len = INFLATE_WINDOW_SIZE;
+	}
+	partLen = INFLATE_WINDOW_SIZE - s->WindowIndex;
+	partLen = min(partLen, len);
+
+	Mem_Copy(&s->Window[s->WindowIndex], src, partLen);
+	/* Wrap around remainder of copy to start from beginning of window */
+	if (partLen < len) Mem_Copy(s->Window, src + partLen, len - partLen);
+
+	s->WindowIndex = (s->WindowIndex + len) & INFLATE_WINDOW_MASK;
+	s->OutputBeg   = s->Output;
+}
+
+/* Decodes as many compressed values as possible, without checking for end of input or output per value */
+/* Bit buffer is refilled with 8 bytes at once every iteration, which always results in at least 56 bits */
+/*  (which is more than the longest literal/length + extra bits + distance + extra bits of 48 bits) */
+/* Data is decoded directly into output (and only copied into the window later by Inflate_SyncWindow) */
+static void Inflate_InflateFast(struct InflateState* s) {
+	/* bit buffer variables */
+	cc_uint64 bitbuf;
+	cc_uint32 numBits, keepBytes;
+	cc_uint8* in;
+	cc_uint8* inBeg;
+	cc_uint8* inEnd;
+	/* huffman variables */
+	struct HuffmanTable* lits;
+	struct HuffmanTable* dists;
+	cc_uint32 entry, lit, len, dist, extra;
+	/* output variables */
+	cc_uint8* out;
+	cc_uint32 outLen;
+
+	bitbuf  = s->Bits;
+	numBits = s->NumBits;
+	in      = s->NextIn;
+	inBeg   = s->NextIn;
+	inEnd   = s->NextIn + s->AvailIn;
+	lits    = &s->Table.Lits;
+	dists   = &s->TableDists;
+	out     = s->Output;
+
+#define INFLATE_FAST_MASK ((1UL << INFLATE_FAST_BITS) - 1)
+	while (s->AvailOut >= INFLATE_FASTINF_OUT && (inEnd - in) >= INFLATE_FASTINF_IN) {
+		/* Branchless refill: reads 8 bytes, but only advances by the number of whole bytes that fit */
+		bitbuf  |= Inflate_GetU64(in) << numBits;
+		in      += (63 - numBits) >> 3;
+		numBits |= 56;
+
+		entry = lits->Fast[bitbuf & INFLATE_FAST_MASK];
+		if (!entry) entry = Huffman_SlowEntry(lits, (cc_uint32)bitbuf, len_base, len_bits, 257);
+		if (!entry) { Inflate_Fail(s, INF_ERR_INVALID_CODE); break; }
+
+		bitbuf  >>= Huffman_EntryBits(entry);
+		numBits  -= Huffman_EntryBits(entry);
+		lit       = Huffman_EntryValue(entry);
+
+		if (lit < 256) {
+			*out++ = (cc_uint8)lit;
+			s->AvailOut--;
+
+			/* Refill usually leaves enough bits for several more literals */
+			/* (at most 56 more literals, so can't exceed INFLATE_FASTINF_OUT) */
+			for (;;) {
+				entry = lits->Fast[bitbuf & INFLATE_FAST_MASK];
+				if (numBits < INFLATE_FAST_BITS || !entry || Huffman_EntryValue(entry) >= 256) break;
+
+				bitbuf  >>= Huffman_EntryBits(entry);
+				numBits  -= Huffman_EntryBits(entry);
+				*out++    = (cc_uint8)Huffman_EntryValue(entry);
+				s->AvailOut--;
 			}
+			continue;
+		} else if (lit == 256) {
+			s->State = Inflate_NextBlockState(s);
+			break;
+		} else if (lit > 285) {
+			Inflate_Fail(s, INF_ERR_INVALID_CODE); break;
+		}
+
+		extra   = Huffman_EntryExtra(entry);
+		len     = Huffman_EntryBase(entry) + (cc_uint32)(bitbuf & ((1UL << extra) - 1));
+		bitbuf >>= extra; numBits -= extra;
+
+		entry = dists->Fast[bitbuf & INFLATE_FAST_MASK];
+		if (!entry) entry = Huffman_SlowEntry(dists, (cc_uint32)bitbuf, dist_base, dist_bits, 0);
+		if (!entry) { Inflate_Fail(s, INF_ERR_INVALID_CODE); break; }
+
+		bitbuf  >>= Huffman_EntryBits(entry);
+		numBits  -= Huffman_EntryBits(entry);
+		extra     = Huffman_EntryExtra(entry);
+		dist      = Huffman_EntryBase(entry) + (cc_uint32)(bitbuf & ((1UL << extra) - 1));
+		bitbuf  >>= extra; numBits -= extra;
+		if (!dist) { Inflate_Fail(s, INF_ERR_INVALID_CODE); break; }
+
+		/* Back-references are resolved against earlier output when possible, instead of the window */
+		outLen = (cc_uint32)(out - s->OutputBeg);
+		if (dist <= outLen) {
+			Inflate_CopyMatch(out, out - dist, len, dist);
 		} else {
-			lenIdx = lit - 257;
-			bits = len_bits[lenIdx];
-			Inflate_UNSAFE_EnsureBits(s, bits);
-			len  = len_base[lenIdx] + Inflate_ReadBits(s, bits);
-
-			Huffman_UNSAFE_Decode(s, s->TableDists, distIdx);
-			bits = dist_bits[distIdx];
-			Inflate_UNSAFE_EnsureBits(s, bits);
-			dist = dist_base[distIdx] + Inflate_ReadBits(s, bits);
-	
-			/* Window infinitely repeats like ...xyz|uvwxyz|uvwxyz|uvw... */
-			/* If start and end don't cross a boundary, can avoid masking index */
-			startIdx = (curIdx - dist) & INFLATE_WINDOW_MASK;
-			if (curIdx >= startIdx && (curIdx + len) < INFLATE_WINDOW_SIZE) {
-				cc_uint8* src = &window[startIdx]; 
-				cc_uint8* dst = &window[curIdx];
-
-				for (i = 0; i < (len & ~0x3); i += 4) {
-					*dst++ = *src++; *dst++ = *src++; *dst++ = *src++; *dst++ = *src++;
-				}
-				for (; i < len; i++) { *dst++ = *src++; }
-			} else {
-				for (i = 0; i < len; i++) {
-					window[(curIdx + i) & INFLATE_WINDOW_MASK] = window[(startIdx + i) & INFLATE_WINDOW_MASK];
-				}
-			}
-			curIdx = (curIdx + len) & INFLATE_WINDOW_MASK;
-			s->AvailOut -= len; copyLen += len;
+			Inflate_CopyFromWindow(s, out, len, dist - outLen);
 		}
+		out += len; s->AvailOut -= len;
 	}
 
-	s->WindowIndex = curIdx;
-	if (!copyLen) return;
-
-	if (copyStart + copyLen < INFLATE_WINDOW_SIZE) {
-		Mem_Copy(s->Output, &s->Window[copyStart], copyLen);
-		s->Output += copyLen;
-	} else {
-		partLen = INFLATE_WINDOW_SIZE - copyStart;
-		Mem_Copy(s->Output, &s->Window[copyStart], partLen);
-		s->Output += partLen;
-		Mem_Copy(s->Output, s->Window, copyLen - partLen);
-		s->Output += (copyLen - partLen);
-	}
+	/* Return any whole bytes which were read ahead, but not consumed */
+	keepBytes = numBits >> 3;
+	keepBytes = min(keepBytes, (cc_uint32)(in - inBeg));
+	in      -= keepBytes;
+	numBits -= keepBytes << 3;
+	bitbuf  &= ((cc_uint64)1 << numBits) - 1;
+
+	s->Bits    = bitbuf;
+	s->NumBits = numBits;
+	s->AvailIn = (cc_uint32)(inEnd - in);
+	s->NextIn  = in;
+	s->Output  = out;
 }
 
 void Inflate_Process(struct InflateState* s) {
@@ -495,8 +604,8 @@ void Inflate_Process(struct InflateState* s) {
 			} break;
 
 			case 1: { /* Fixed/static huffman compressed */
-				(void)Huffman_Build(&s->Table.Lits, fixed_lits,  INFLATE_MAX_LITS);
-				(void)Huffman_Build(&s->TableDists, fixed_dists, INFLATE_MAX_DISTS);
+				(void)Huffman_Build(&s->Table.Lits, fixed_lits,  INFLATE_MAX_LITS,  len_base,  len_bits,  257);
+				(void)Huffman_Build(&s->TableDists, fixed_dists, INFLATE_MAX_DISTS, dist_base, dist_bits, 0);
 				s->State = Inflate_NextCompressState(s);
 			} break;
 
@@ -525,6 +634,7 @@ void Inflate_Process(struct InflateState* s) {
 		}
 
 		case INFLATE_STATE_UNCOMPRESSED_DATA: {
+			Inflate_SyncWindow(s);
 			/* read bits left in bit buffer (slow way) */
 			while (s->NumBits && s->AvailOut && s->Index) {
 				*s->Output = Inflate_ReadBits(s, 8);
@@ -532,6 +642,7 @@ void Inflate_Process(struct InflateState* s) {
 
 				s->WindowIndex = (s->WindowIndex + 1) & INFLATE_WINDOW_MASK;
 				s->Output++; s->AvailOut--;	s->Index--;
+				s->OutputBeg = s->Output;
 			}
 			if (!s->AvailIn || !s->AvailOut) return;
 
@@ -550,7 +661,8 @@ void Inflate_Process(struct InflateState* s) {
 
 				s->WindowIndex = (s->WindowIndex + copyLen) & INFLATE_WINDOW_MASK;
 				s->Output += copyLen; s->AvailOut -= copyLen; s->Index -= copyLen;
-				s->NextIn += copyLen; s->AvailIn  -= copyLen;		
+				s->NextIn += copyLen; s->AvailIn  -= copyLen;
+				s->OutputBeg = s->Output;
 			}
 
 			if (!s->Index) { s->State = Inflate_NextBlockState(s); }
@@ -579,7 +691,7 @@ void Inflate_Process(struct InflateState* s) {
 
 			s->Index = 0;
 			s->State = INFLATE_STATE_DYNAMIC_LITSDISTS;
-			res = Huffman_Build(&s->Table.CodeLens, s->Buffer, INFLATE_MAX_CODELENS);
+			res = Huffman_Build(&s->Table.CodeLens, s->Buffer, INFLATE_MAX_CODELENS, NULL, NULL, 0);
 			if (res) { Inflate_Fail(s, res); return; }
 		}
 
@@ -602,9 +714,9 @@ void Inflate_Process(struct InflateState* s) {
 				s->Index = 0;
 				s->State = Inflate_NextCompressState(s);
 
-				res = Huffman_Build(&s->Table.Lits, s->Buffer, s->NumLits);
+				res = Huffman_Build(&s->Table.Lits, s->Buffer, s->NumLits, len_base, len_bits, 257);
 				if (res) { Inflate_Fail(s, res); return; }
-				res = Huffman_Build(&s->TableDists, s->Buffer + s->NumLits, s->NumDists);
+				res = Huffman_Build(&s->TableDists, s->Buffer + s->NumLits, s->NumDists, dist_base, dist_bits, 0);
 				if (res) { Inflate_Fail(s, res); return; }
 			}
 			break;
@@ -645,6 +757,7 @@ void Inflate_Process(struct InflateState* s) {
 
 		case INFLATE_STATE_COMPRESSED_LIT: {
 			if (!s->AvailOut) return;
+			Inflate_SyncWindow(s);
 			lit = Huffman_Decode(s, &s->Table.Lits);
 
 			if (lit < 256) {
@@ -652,6 +765,7 @@ void Inflate_Process(struct InflateState* s) {
 				*s->Output = (cc_uint8)lit;
 				s->Window[s->WindowIndex] = (cc_uint8)lit;
 				s->Output++; s->AvailOut--;
+				s->OutputBeg   = s->Output;
 				s->WindowIndex = (s->WindowIndex + 1) & INFLATE_WINDOW_MASK;
 				break;
 			} else if (lit == 256) {
@@ -687,6 +801,7 @@ void Inflate_Process(struct InflateState* s) {
 
 		case INFLATE_STATE_COMPRESSED_DATA: {
 			if (!s->AvailOut) return;
+			Inflate_SyncWindow(s);
 			len = s->TmpLit; dist = s->TmpDist;
 			len = min(len, s->AvailOut);
 
@@ -701,6 +816,7 @@ void Inflate_Process(struct InflateState* s) {
 			}
 
 			s->WindowIndex = (curIdx + len) & INFLATE_WINDOW_MASK;
+			s->OutputBeg   = s->Output;
 			s->TmpLit   -= len;
 			s->AvailOut -= len;
 			if (!s->TmpLit) { s->State = Inflate_NextCompressState(s); }
@@ -727,25 +843,29 @@ static cc_result Inflate_StreamRead(struct Stream* stream, cc_uint8* data, cc_ui
 	cc_uint32 read, left;
 	cc_uint32 startAvailOut;
 	cc_bool hasInput;
-	cc_result res;
+	cc_result res = 0;
 
 	*modified = 0;
 	state = (struct InflateState*)stream->Meta.Inflate;
-	state->Output   = data;
-	state->AvailOut = count;
+	state->Output    = data;
+	state->OutputBeg = data;
+	state->AvailOut  = count;
 
 	hasInput = true;
 	while (state->AvailOut > 0 && hasInput) {
-		if (state->State == INFLATE_STATE_DONE) return state->result;
+		if (state->State == INFLATE_STATE_DONE) { res = state->result; break; }
 
-		if (!state->AvailIn) {
-			/* Fully used up input buffer. Cycle back to start. */
-			inputEnd = state->Input + INFLATE_MAX_INPUT;
-			if (state->NextIn == inputEnd) state->NextIn = state->Input;
+		if (state->AvailIn < INFLATE_FASTINF_IN) {
+			/* Move leftover input to start of buffer, so that fast decoding can continue after reading more */
+			if (state->AvailIn <= (cc_uint32)(state->NextIn - state->Input)) {
+				Mem_Copy(state->Input, state->NextIn, state->AvailIn);
+				state->NextIn = state->Input;
+			}
+			inputEnd = state->NextIn + state->AvailIn;
 
-			left = (cc_uint32)(inputEnd - state->NextIn);
-			res  = state->Source->Read(state->Source, state->NextIn, left, &read);
-			if (res) return res;
+			left = (cc_uint32)(state->Input + INFLATE_MAX_INPUT - inputEnd);
+			res  = state->Source->Read(state->Source, inputEnd, left, &read);
+			if (res) break;
 
 			/* Did we fail to read in more input data? Can't immediately return here, */
 			/* because there might be a few bits of data left in the bit buffer */
@@ -758,7 +878,10 @@ static cc_result Inflate_StreamRead(struct Stream* stream, cc_uint8* data, cc_ui
 		Inflate_Process(state);
 		*modified += (startAvailOut - state->AvailOut);
 	}
-	return 0;
+
+	/* Caller's buffer might not be valid after this call, so copy recent output into window */
+	Inflate_SyncWindow(state);
+	return res;
 }
 
 void Inflate_MakeStream2(struct Stream* stream, struct InflateState* state, struct Stream* underlying) {
@@ -788,8 +911,8 @@ static const cc_uint16 deflate_dist[31] = {
 #define Deflate_PushBits(state, value, bits) state->Bits |= (value) << state->NumBits; state->NumBits += (bits);
 /* Pushes bits of the huffman codeword bits for the given literal, but does not write them */
 #define Deflate_PushLit(state, value) Deflate_PushBits(state, state->LitsCodewords[value], state->LitsLens[value])
-/* Pushes given bits (reversing for huffman code), but does not write them */
-#define Deflate_PushHuff(state, value, bits) Deflate_PushBits(state, Huffman_ReverseBits(value, bits), bits)
+/* Pushes bits of the huffman codeword bits for the given distance, but does not write them */
+#define Deflate_PushDist(state, value) Deflate_PushBits(state, state->DistsCodewords[value], state->DistsLens[value])
 /* Writes given byte to output */
 #define Deflate_WriteByte(state) *state->NextOut++ = state->Bits; state->AvailOut--; state->Bits >>= 8; state->NumBits -= 8;
 /* Flushes bits in buffer to output buffer */
@@ -797,140 +920,580 @@ static const cc_uint16 deflate_dist[31] = {
 
 #define MIN_MATCH_LEN 3
 #define MAX_MATCH_LEN 258
+/* Max bit length of a codeword in the literal/length and distance huffman trees */
+#define DEFLATE_MAX_CODE_BITS 15
+/* Max bit length of a codeword in the huffman tree used to encode the other trees */
+#define DEFLATE_MAX_CODELEN_BITS 7
+/* Number of literal/length and distance codes that can actually be used in compressed data */
+#define DEFLATE_NUM_LITS  286
+#define DEFLATE_NUM_DISTS 30
 
 /* Number of bytes that match (are the same) from a and b */
+#if defined __GNUC__ && !defined CC_BIG_ENDIAN
+/* Compares 8 bytes at a time, then uses the number of trailing zero bits */
+/*  in the XOR of those bytes to work out the first byte that differs */
+static int Deflate_MatchLen(cc_uint8* a, cc_uint8* b, int maxLen) {
+	cc_uint64 x, y;
+	int i = 0;
+
+	for (; i + 8 <= maxLen; i += 8) {
+		__builtin_memcpy(&x, a + i, 8);
+		__builtin_memcpy(&y, b + i, 8);
+		if (x != y) return i + (__builtin_ctzll(x ^ y) >> 3);
+	}
+	while (i < maxLen && a[i] == b[i]) i++;
+	return i;
+}
+#else
 static int Deflate_MatchLen(cc_uint8* a, cc_uint8* b, int maxLen) {
 	int i = 0;
 	while (i < maxLen && *a == *b) { i++; a++; b++; }
 	return i;
 }
+#endif
 
-/* Hashes 3 bytes of data */
+/* Hashes 4 bytes of data (multiplicative hashing, using top bits of the product) */
 static cc_uint32 Deflate_Hash(cc_uint8* src) {
-	return (cc_uint32)((src[0] << 8) ^ (src[1] << 4) ^ (src[2])) & DEFLATE_HASH_MASK;
+	cc_uint32 value = src[0] | (src[1] << 8) | (src[2] << 16) | ((cc_uint32)src[3] << 24);
+	return (cc_uint32)(value * 2654435761UL) >> (32 - DEFLATE_HASH_BITS);
+}
+
+/* Returns the length code (relative to 257) for the given match length */
+#define Deflate_LenCode(state, len) (state)->LenCodes[len]
+/* Returns the distance code for the given match distance */
+/* Distances above 256 always use codes with at least 7 extra bits, so can be looked up by 128 */
+#define Deflate_DistCode(state, dist) ((dist) <= 256 ? (state)->DistCodes[(dist) - 1] : (state)->DistCodes[256 + (((dist) - 1) >> 7)])
+
+static void Deflate_InitCodes(struct DeflateState* state) {
+	int i, j, dist;
+
+	for (i = 0; i < 29; i++) {
+		for (j = deflate_len[i]; j < deflate_len[i + 1] && j <= MAX_MATCH_LEN; j++) {
+			state->LenCodes[j] = i;
+		}
+	}
+	for (i = 0; i < 30; i++) {
+		for (j = 0; j < (1 << dist_bits[i]); j++) {
+			dist = deflate_dist[i] + j;
+			if (dist <= 256) { state->DistCodes[dist - 1] = i; }
+			else { state->DistCodes[256 + ((dist - 1) >> 7)] = i; }
+		}
+	}
 }
 
-/* Writes a literal to state->Output */
+/* Adds a literal to the symbols of the current block */
 static void Deflate_Lit(struct DeflateState* state, int lit) {
-	Deflate_PushLit(state, lit);
-	Deflate_FlushBits(state);
+	int i = state->NumSyms++;
+	state->SymLits[i]  = lit;
+	state->SymDists[i] = 0;
+	state->LitsFreqs[lit]++;
 }
 
-/* Writes a length-distance pair to state->Output */
+/* Adds a length-distance pair to the symbols of the current block */
 static void Deflate_LenDist(struct DeflateState* state, int len, int dist) {
-	int j;
-	/* TODO: Do we actually need the if (len_bits[j]) ????????? does writing 0 bits matter??? */
-
-	for (j = 0; len >= deflate_len[j + 1]; j++);
-	Deflate_PushLit(state, j + 257);
-	if (len_bits[j]) { Deflate_PushBits(state, len - deflate_len[j], len_bits[j]); }
-	Deflate_FlushBits(state);
-
-	for (j = 0; dist >= deflate_dist[j + 1]; j++);
-	Deflate_PushHuff(state, j, 5);
-	if (dist_bits[j]) { Deflate_PushBits(state, dist - deflate_dist[j], dist_bits[j]); }
-	Deflate_FlushBits(state);
+	int i = state->NumSyms++;
+	state->SymLits[i]  = len;
+	state->SymDists[i] = dist;
+	state->LitsFreqs[Deflate_LenCode(state, len) + 257]++;
+	state->DistsFreqs[Deflate_DistCode(state, dist)]++;
 }
 
 /* Moves "current block" to "previous block", adjusting state if needed. */
 static void Deflate_MoveBlock(struct DeflateState* state) {
-	int i;
+	cc_uint16* head = state->Head;
+	cc_uint16* prev = state->Prev;
+	int i, pos;
 	Mem_Copy(state->Input, state->Input + DEFLATE_BLOCK_SIZE, DEFLATE_BLOCK_SIZE);
 	state->InputPosition = DEFLATE_BLOCK_SIZE;
 
 	/* adjust hash table offsets, removing offsets that are no longer in data at all */
-	for (i = 0; i < Array_Elems(state->Head); i++) {
-		state->Head[i] = state->Head[i] < DEFLATE_BLOCK_SIZE ? 0 : (state->Head[i] - DEFLATE_BLOCK_SIZE);
+	for (i = 0; i < DEFLATE_HASH_SIZE; i++) {
+		pos = head[i]; head[i] = pos < DEFLATE_BLOCK_SIZE ? 0 : pos - DEFLATE_BLOCK_SIZE;
 	}
-	for (i = 0; i < Array_Elems(state->Prev); i++) {
-		state->Prev[i] = state->Prev[i] < DEFLATE_BLOCK_SIZE ? 0 : (state->Prev[i] - DEFLATE_BLOCK_SIZE);
+
+	/* Hash chains are only ever followed from positions in the current block, so the */
+	/*  previous block's chains can simply be replaced by the current block's chains */
+	/* (entries for positions not yet inserted are never read, so don't need clearing) */
+	for (i = 0; i < DEFLATE_BLOCK_SIZE; i++) {
+		pos = prev[i + DEFLATE_BLOCK_SIZE]; prev[i] = pos < DEFLATE_BLOCK_SIZE ? 0 : pos - DEFLATE_BLOCK_SIZE;
 	}
 }
 
-/* Compresses current block of data */
-static cc_result Deflate_FlushBlock(struct DeflateState* state, int len) {
-	cc_uint32 hash, nextHash;
-	int bestLen, maxLen, matchLen, depth;
-	int bestPos, pos, nextPos;
-	cc_uint16 oldHead;
-	cc_uint8* input;
-	cc_uint8* cur;
-	cc_result res;
+struct DeflateLevel {
+	cc_uint16 maxChain; /* Max number of previous positions in a hash chain to check */
+	cc_uint16 niceLen;  /* Stop checking hash chain once a match at least this long is found */
+	cc_uint16 lazyLen;  /* Don't check for a longer match at next byte when match is at least this long */
+	cc_uint16 maxInsert;/* Only insert every byte of a match into hash chains when match is at most this long */
+};
+static const struct DeflateLevel deflate_levels[] = {
+	{    0,   0,   0,   0 }, /* DEFLATE_LEVEL_STORE */
+	{    0,   0,   0,   0 }, /* DEFLATE_LEVEL_RLE */
+	{    4,  32,   0,   8 }, /* DEFLATE_LEVEL_FAST */
+	{    8,  64,  16, 258 }, /* DEFLATE_LEVEL_DEFAULT */
+	{ 4096, 258, 258, 258 }, /* DEFLATE_LEVEL_MAX */
+};
+
+/* Inserts the given position into its hash chain */
+static CC_INLINE int Deflate_Insert(struct DeflateState* state, cc_uint8* cur) {
+	cc_uint32 hash = Deflate_Hash(cur);
+	int pos   = (int)(cur - state->Input);
+	int chain = state->Head[hash];
 
-	if (!state->WroteHeader) {
-		state->WroteHeader = true;
-		Deflate_PushBits(state, 3, 3); /* final block TRUE, block type FIXED */
+	state->Head[hash] = pos;
+	state->Prev[pos]  = chain;
+	return chain;
+}
+
+/* Searches the given hash chain for a match longer than bestLen, returning 0 if none is found */
+static int Deflate_FindMatch(struct DeflateState* state, const struct DeflateLevel* level, 
+							int chain, cc_uint8* cur, int maxLen, int bestLen, int* bestPos) {
+	cc_uint8* input = state->Input;
+	int niceLen  = min(level->niceLen, maxLen);
+	int depth    = level->maxChain;
+	int matchLen, found = 0;
+	cc_uint8* match;
+
+	if (bestLen >= maxLen) return 0;
+	for (; chain != 0 && depth > 0; chain = state->Prev[chain], depth--) {
+		match = input + chain;
+		/* Quickly skip matches that can't be longer than the best match */
+		if (match[bestLen] != cur[bestLen] || match[0] != cur[0]) continue;
+
+		matchLen = Deflate_MatchLen(match, cur, maxLen);
+		if (matchLen <= bestLen) continue;
+
+		bestLen  = matchLen; found = bestLen;
+		*bestPos = chain;
+		if (matchLen >= niceLen) break;
+	}
+	return found;
+}
+
+/* Finds runs of the same byte in the current block of data */
+static void Deflate_CompressRuns(struct DeflateState* state, cc_uint8* cur, int len) {
+	cc_uint8* start = cur;
+	int runLen;
+
+	while (len > 0) {
+		/* Only look within current block, since previous block is uninitialised at start */
+		runLen = 0;
+		if (cur > start) runLen = Deflate_MatchLen(cur - 1, cur, min(len, MAX_MATCH_LEN));
+
+		if (runLen >= MIN_MATCH_LEN) {
+			Deflate_LenDist(state, runLen, 1);
+			len -= runLen; cur += runLen;
+		} else {
+			Deflate_Lit(state, *cur);
+			len--; cur++;
+		}
 	}
+}
+
+/* Finds matches in the current block of data, converting it into literals and length-distance pairs */
+static void Deflate_CompressBlock(struct DeflateState* state, int len) {
+	const struct DeflateLevel* level = &deflate_levels[state->Level];
+	int chain, matchLen, matchPos, maxLen, pos;
+	int prevLen = 0, prevDist = 0;
+	cc_bool hasPrev = false;
+	cc_uint8* cur;
+	cc_uint8* end;
 
 	/* Based off descriptions from http://www.gzip.org/algorithm.txt and
 	https://github.com/nothings/stb/blob/master/stb_image_write.h */
-	input = state->Input;
-	cur   = input + DEFLATE_BLOCK_SIZE;
+	cur = state->Input + DEFLATE_BLOCK_SIZE;
+	end = cur + len;
 
-	/* Compress current block of data */
-	/* Use > instead of >=, because also try match at one byte after current */
-	while (len > MIN_MATCH_LEN) {
-		hash   = Deflate_Hash(cur);
-		maxLen = min(len, MAX_MATCH_LEN);
+	state->NumSyms = 0;
+	Mem_Set(state->LitsFreqs,  0, sizeof(state->LitsFreqs));
+	Mem_Set(state->DistsFreqs, 0, sizeof(state->DistsFreqs));
+	/* End of block symbol */
+	state->LitsFreqs[256]++;
 
-		bestLen = MIN_MATCH_LEN - 1; /* Match must be at least 3 bytes */
-		bestPos = 0;
+	if (state->Level == DEFLATE_LEVEL_STORE) return;
+	if (state->Level == DEFLATE_LEVEL_RLE) { Deflate_CompressRuns(state, cur, len); return; }
+
+	/* Hashing reads 4 bytes, so last few bytes are always literals */
+	while (end - cur > 4) {
+		maxLen = min((int)(end - cur), MAX_MATCH_LEN);
+		pos    = (int)(cur - state->Input);
+		chain  = Deflate_Insert(state, cur);
 
 		/* Find longest match starting at this byte */
-		/* Only explore up to 5 previous matches, to avoid slow performance */
-		/* (i.e prefer quickly saving maps/screenshots to completely optimal filesize) */
-		pos = state->Head[hash];
-		for (depth = 0; pos != 0 && depth < 5; depth++) {
-			matchLen = Deflate_MatchLen(&input[pos], cur, maxLen);
-			if (matchLen > bestLen) { bestLen = matchLen; bestPos = pos; }
-			pos = state->Prev[pos];
+		matchLen = 0;
+		if (chain && (!level->lazyLen || prevLen < level->lazyLen)) {
+			matchLen = Deflate_FindMatch(state, level, chain, cur, maxLen, 
+							max(prevLen, MIN_MATCH_LEN - 1), &matchPos);
 		}
 
-		/* Insert this entry into the hash chain */
-		pos = (int)(cur - input);
-		oldHead = state->Head[hash];
-		state->Head[hash] = pos;
-		state->Prev[pos]  = oldHead;
-
-		/* Lazy evaluation: Find longest match starting at next byte */
-		/* If that's longer than the longest match at current byte, throwaway this match */
-		if (bestPos) {
-			nextHash = Deflate_Hash(cur + 1);
-			nextPos  = state->Head[nextHash];
-			maxLen   = min(len - 1, MAX_MATCH_LEN);
-
-			for (depth = 0; nextPos != 0 && depth < 5; depth++) {
-				matchLen = Deflate_MatchLen(&input[nextPos], cur + 1, maxLen);
-				if (matchLen > bestLen) { bestPos = 0; break; }
-				nextPos = state->Prev[nextPos];
+		if (!level->lazyLen) {
+			if (matchLen) {
+				Deflate_LenDist(state, matchLen, pos - matchPos);
+				/* Skip inserting rest of a long match, to avoid slow performance */
+				if (matchLen <= level->maxInsert) {
+					for (pos = 1; pos < matchLen && end - (cur + pos) > 4; pos++) Deflate_Insert(state, cur + pos);
+				}
+				cur += matchLen;
+			} else {
+				Deflate_Lit(state, *cur);
+				cur++;
 			}
+			continue;
 		}
 
-		if (bestPos) {
-			Deflate_LenDist(state, bestLen, pos - bestPos);
-			len -= bestLen; cur += bestLen;
+		/* Lazy evaluation: Only use the match starting at previous byte */
+		/*  if this byte doesn't start a longer match */
+		if (prevLen && !matchLen) {
+			Deflate_LenDist(state, prevLen, prevDist);
+			/* Previous byte and this byte are already inserted */
+			for (pos = 1; pos < prevLen - 1 && end - (cur + pos) > 4; pos++) Deflate_Insert(state, cur + pos);
+
+			cur += prevLen - 1;
+			prevLen = 0; hasPrev = false;
 		} else {
-			Deflate_Lit(state, *cur);
-			len--; cur++;
+			if (hasPrev) Deflate_Lit(state, cur[-1]);
+			if (matchLen) { prevLen = matchLen; prevDist = pos - matchPos; }
+
+			hasPrev = true;
+			cur++;
 		}
+	}
 
-		/* leave room for a few bytes and literals at end */
-		if (state->AvailOut >= 20) continue;
-		res = Stream_Write(state->Dest, state->Output, DEFLATE_OUT_SIZE - state->AvailOut);
-		state->NextOut  = state->Output;
-		state->AvailOut = DEFLATE_OUT_SIZE;
-		if (res) return res;
+	if (hasPrev && prevLen) {
+		Deflate_LenDist(state, prevLen, prevDist);
+		cur += prevLen - 1;
+	} else if (hasPrev) {
+		Deflate_Lit(state, cur[-1]);
 	}
 
 	/* literals for last few bytes */
-	while (len > 0) {
-		Deflate_Lit(state, *cur);
-		len--; cur++;
+	while (cur < end) { Deflate_Lit(state, *cur); cur++; }
+}
+
+
+/* Calculates the bit lengths of the codewords of a length limited huffman tree, */
+/*  based on how often each symbol is used. (uses in-place Moffat-Katajainen algorithm) */
+static void Deflate_CalcCodeLens(const cc_uint16* freqs, int count, int maxBits, cc_uint8* lens) {
+	int syms[INFLATE_MAX_LITS], A[INFLATE_MAX_LITS];
+	int numCodes[32];
+	int root, leaf, next, avbl, used, depth;
+	int i, j, sym, n = 0;
+	cc_uint32 total;
+
+	for (i = 0; i < count; i++) {
+		lens[i] = 0;
+		if (freqs[i]) syms[n++] = i;
+	}
+
+	/* A huffman tree must have at least two codewords, so add an unused codeword if necessary */
+	if (n < 2) {
+		sym = n ? syms[0] : 0;
+		lens[sym] = 1;
+		lens[sym ? 0 : 1] = 1;
+		return;
+	}
+
+	/* Sort used symbols from least to most frequently used */
+	for (i = 1; i < n; i++) {
+		sym = syms[i];
+		for (j = i; j > 0 && freqs[syms[j - 1]] > freqs[sym]; j--) { syms[j] = syms[j - 1]; }
+		syms[j] = sym;
+	}
+	for (i = 0; i < n; i++) { A[i] = freqs[syms[i]]; }
+
+	/* Combine weights, replacing them with indices of parent nodes */
+	A[0] += A[1]; root = 0; leaf = 2;
+	for (next = 1; next < n - 1; next++) {
+		if (leaf >= n || A[root] < A[leaf]) {
+			A[next] = A[root]; A[root++] = next;
+		} else {
+			A[next] = A[leaf++];
+		}
+
+		if (leaf >= n || (root < next && A[root] < A[leaf])) {
+			A[next] += A[root]; A[root++] = next;
+		} else {
+			A[next] += A[leaf++];
+		}
+	}
+
+	/* Convert parent indices into depths of internal nodes */
+	A[n - 2] = 0;
+	for (next = n - 3; next >= 0; next--) { A[next] = A[A[next]] + 1; }
+
+	/* Convert internal node depths into leaf depths */
+	avbl = 1; used = 0; depth = 0; root = n - 2; next = n - 1;
+	while (avbl > 0) {
+		while (root >= 0 && A[root] == depth) { used++; root--; }
+		while (avbl > used) { A[next--] = depth; avbl--; }
+		avbl = 2 * used; depth++; used = 0;
+	}
+
+	/* Limit codewords to maxBits, by moving overly long codewords up the tree */
+	Mem_Set(numCodes, 0, sizeof(numCodes));
+	for (i = 0; i < n; i++) { numCodes[min(A[i], 31)]++; }
+	for (i = maxBits + 1; i < 32; i++) { numCodes[maxBits] += numCodes[i]; }
+
+	total = 0;
+	for (i = maxBits; i > 0; i--) { total += (cc_uint32)numCodes[i] << (maxBits - i); }
+
+	while (total != (1UL << maxBits)) {
+		numCodes[maxBits]--;
+		for (i = maxBits - 1; i > 0; i--) {
+			if (!numCodes[i]) continue;
+			numCodes[i]--; numCodes[i + 1] += 2; break;
+		}
+		total--;
 	}
 
-	res = Stream_Write(state->Dest, state->Output, DEFLATE_OUT_SIZE - state->AvailOut);
+	/* Least frequently used symbols get the longest codewords */
+	for (i = maxBits, j = 0; i > 0; i--) {
+		for (sym = numCodes[i]; sym > 0; sym--) { lens[syms[j++]] = i; }
+	}
+}
+
+/* Run length encodes the bit lengths of the literal/length and distance codewords */
+/*  (16 = repeat previous length, 17 = short run of zeroes, 18 = long run of zeroes) */
+static int Deflate_EncodeCodeLens(const cc_uint8* lens, int count, cc_uint8* codes, cc_uint8* extra) {
+	int i = 0, n = 0, run, part;
+	cc_uint8 len;
+
+	while (i < count) {
+		len = lens[i];
+		for (run = 1; i + run < count && lens[i + run] == len; run++) { }
+
+		if (!len && run >= 3) {
+			part = min(run, 138);
+			codes[n] = part >= 11 ? 18 : 17;
+			extra[n] = part >= 11 ? part - 11 : part - 3;
+			n++; i += part;
+		} else if (len && run >= 4) {
+			/* Repeat code can only repeat length that was just written */
+			part = min(run - 1, 6);
+			codes[n] = len; extra[n] = 0; n++;
+			codes[n] = 16;  extra[n] = part - 3; n++;
+			i += 1 + part;
+		} else {
+			codes[n] = len; extra[n] = 0;
+			n++; i++;
+		}
+	}
+	return n;
+}
+
+/* Calculates number of bits needed to write the symbols of the current block with the given codeword lengths */
+static cc_uint32 Deflate_CalcDataBits(struct DeflateState* state, const cc_uint8* litsLens, const cc_uint8* distsLens) {
+	cc_uint32 bits = 0;
+	int i;
+
+	for (i = 0; i < DEFLATE_NUM_LITS; i++) {
+		bits += state->LitsFreqs[i] * litsLens[i];
+	}
+	for (i = 257; i < DEFLATE_NUM_LITS; i++) {
+		bits += state->LitsFreqs[i] * len_bits[i - 257];
+	}
+	for (i = 0; i < DEFLATE_NUM_DISTS; i++) {
+		bits += state->DistsFreqs[i] * (distsLens[i] + dist_bits[i]);
+	}
+	return bits;
+}
+
+/* Constructs a huffman encoding table (for values to codewords) */
+static void Deflate_BuildTable(const cc_uint8* lens, int count, cc_uint16* codewords, cc_uint8* bitlens) {
+	int i, j, offset, codeword;
+	struct HuffmanTable table;
+
+	/* NOTE: Can ignore since lens table is not user controlled */
+	(void)Huffman_Build(&table, lens, count, NULL, NULL, 0);
+	for (i = 0; i < INFLATE_MAX_BITS; i++) {
+		if (!table.EndCodewords[i]) continue;
+		count = table.EndCodewords[i] - table.FirstCodewords[i];
+
+		for (j = 0; j < count; j++) {
+			offset   = table.Values[table.FirstOffsets[i] + j];
+			codeword = table.FirstCodewords[i] + j;
+			bitlens[offset]   = i;
+			codewords[offset] = Huffman_ReverseBits(codeword, i);
+		}
+	}
+}
+
+/* Writes all the data in the Output buffer to the destination stream */
+static cc_result Deflate_FlushOutput(struct DeflateState* state) {
+	cc_result res = Stream_Write(state->Dest, state->Output, DEFLATE_OUT_SIZE - state->AvailOut);
 	state->NextOut  = state->Output;
 	state->AvailOut = DEFLATE_OUT_SIZE;
+	return res;
+}
+
+/* Writes the given data as an uncompressed block */
+static cc_result Deflate_WriteStored(struct DeflateState* state, const cc_uint8* data, int len) {
+	cc_result res;
+	/* Uncompressed data must start on a byte boundary */
+	if (state->NumBits & 7) { Deflate_PushBits(state, 0, 8 - (state->NumBits & 7)); }
+	Deflate_FlushBits(state);
+
+	Deflate_PushBits(state, len,  16); Deflate_FlushBits(state);
+	Deflate_PushBits(state, len ^ 0xFFFF, 16); Deflate_FlushBits(state);
+
+	if ((res = Deflate_FlushOutput(state))) return res;
+	return Stream_Write(state->Dest, data, len);
+}
+
+/* Writes the literal/length and distance codeword lengths of a dynamic huffman block */
+static cc_result Deflate_WriteDynamicHeader(struct DeflateState* state, int numLits, int numDists, int numCodeLens,
+											const cc_uint8* codes, const cc_uint8* extra, int numCodes,
+											const cc_uint8* clensLens) {
+	cc_uint16 clensCodewords[INFLATE_MAX_CODELENS];
+	cc_uint8 clensBits[INFLATE_MAX_CODELENS];
+	cc_result res;
+	int i, code;
+
+	Deflate_PushBits(state, numLits  - 257, 5); Deflate_FlushBits(state);
+	Deflate_PushBits(state, numDists - 1,   5); Deflate_FlushBits(state);
+	Deflate_PushBits(state, numCodeLens - 4, 4); Deflate_FlushBits(state);
+
+	for (i = 0; i < numCodeLens; i++) {
+		Deflate_PushBits(state, clensLens[codelens_order[i]], 3);
+		Deflate_FlushBits(state);
+	}
+
+	Mem_Set(clensBits, 0, sizeof(clensBits));
+	Deflate_BuildTable(clensLens, INFLATE_MAX_CODELENS, clensCodewords, clensBits);
+
+	for (i = 0; i < numCodes; i++) {
+		code = codes[i];
+		Deflate_PushBits(state, clensCodewords[code], clensBits[code]);
+		if (code == 16) { Deflate_PushBits(state, extra[i], 2); }
+		if (code == 17) { Deflate_PushBits(state, extra[i], 3); }
+		if (code == 18) { Deflate_PushBits(state, extra[i], 7); }
+		Deflate_FlushBits(state);
+
+		if (state->AvailOut >= 32) continue;
+		if ((res = Deflate_FlushOutput(state))) return res;
+	}
+	return 0;
+}
+
+/* Writes the literals and length-distance pairs of the current block */
+static cc_result Deflate_WriteSymbols(struct DeflateState* state) {
+	int i, j, len, dist;
+	cc_result res;
+
+	for (i = 0; i < state->NumSyms; i++) {
+		len  = state->SymLits[i];
+		dist = state->SymDists[i];
+
+		if (!dist) {
+			Deflate_PushLit(state, len);
+			Deflate_FlushBits(state);
+		} else {
+			j = Deflate_LenCode(state, len);
+			Deflate_PushLit(state, j + 257);
+			if (len_bits[j]) { Deflate_PushBits(state, len - deflate_len[j], len_bits[j]); }
+			Deflate_FlushBits(state);
+
+			j = Deflate_DistCode(state, dist);
+			Deflate_PushDist(state, j);
+			Deflate_FlushBits(state);
+			if (dist_bits[j]) { Deflate_PushBits(state, dist - deflate_dist[j], dist_bits[j]); }
+			Deflate_FlushBits(state);
+		}
+
+		/* leave room for a few bytes and literals at end */
+		if (state->AvailOut >= 20) continue;
+		if ((res = Deflate_FlushOutput(state))) return res;
+	}
+
+	/* Write huffman encoded "literal 256" to terminate symbols */
+	Deflate_PushLit(state, 256);
+	Deflate_FlushBits(state);
+	return 0;
+}
+
+#define DEFLATE_BLOCK_STORED  0
+#define DEFLATE_BLOCK_FIXED   1
+#define DEFLATE_BLOCK_DYNAMIC 2
+/* Writes the current block, using whichever of uncompressed, fixed huffman, */
+/*  or dynamic huffman encoding would produce the least amount of output */
+static cc_result Deflate_WriteBlock(struct DeflateState* state, const cc_uint8* data, int len, cc_bool final) {
+	cc_uint8 litsLens[DEFLATE_NUM_LITS], distsLens[DEFLATE_NUM_DISTS];
+	cc_uint8 lens[DEFLATE_NUM_LITS + DEFLATE_NUM_DISTS];
+	cc_uint8 codes[DEFLATE_NUM_LITS + DEFLATE_NUM_DISTS];
+	cc_uint8 extra[DEFLATE_NUM_LITS + DEFLATE_NUM_DISTS];
+	cc_uint16 clensFreqs[INFLATE_MAX_CODELENS];
+	cc_uint8 clensLens[INFLATE_MAX_CODELENS];
+	int numLits, numDists, numCodeLens, numCodes, i, type;
+	cc_uint32 storedBits, fixedBits, dynamicBits;
+	cc_result res;
+
+	/* No point working out size of compressed blocks when nothing was compressed */
+	if (state->Level == DEFLATE_LEVEL_STORE) {
+		Deflate_PushBits(state, final, 1);
+		Deflate_PushBits(state, DEFLATE_BLOCK_STORED, 2);
+		Deflate_FlushBits(state);
+		return Deflate_WriteStored(state, data, len);
+	}
+
+	Deflate_CalcCodeLens(state->LitsFreqs,  DEFLATE_NUM_LITS,  DEFLATE_MAX_CODE_BITS, litsLens);
+	Deflate_CalcCodeLens(state->DistsFreqs, DEFLATE_NUM_DISTS, DEFLATE_MAX_CODE_BITS, distsLens);
+
+	/* Trailing unused codewords don't need to be written */
+	for (numLits  = DEFLATE_NUM_LITS;  numLits  > 257 && !litsLens[numLits - 1];   numLits--)  { }
+	for (numDists = DEFLATE_NUM_DISTS; numDists > 1   && !distsLens[numDists - 1]; numDists--) { }
+
+	/* Literal/length and distance codeword lengths are written as one sequence */
+	Mem_Copy(lens,           litsLens,  numLits);
+	Mem_Copy(lens + numLits, distsLens, numDists);
+	numCodes = Deflate_EncodeCodeLens(lens, numLits + numDists, codes, extra);
+
+	Mem_Set(clensFreqs, 0, sizeof(clensFreqs));
+	for (i = 0; i < numCodes; i++) { clensFreqs[codes[i]]++; }
+	Deflate_CalcCodeLens(clensFreqs, INFLATE_MAX_CODELENS, DEFLATE_MAX_CODELEN_BITS, clensLens);
+	for (numCodeLens = INFLATE_MAX_CODELENS; numCodeLens > 4 && !clensLens[codelens_order[numCodeLens - 1]]; numCodeLens--) { }
+
+	/* Work out which type of block would be smallest */
+	dynamicBits = 5 + 5 + 4 + 3 * numCodeLens;
+	for (i = 0; i < numCodes; i++) {
+		dynamicBits += clensLens[codes[i]];
+		if (codes[i] == 16) dynamicBits += 2;
+		if (codes[i] == 17) dynamicBits += 3;
+		if (codes[i] == 18) dynamicBits += 7;
+	}
+	dynamicBits += Deflate_CalcDataBits(state, litsLens, distsLens);
+
+	fixedBits  = Deflate_CalcDataBits(state, fixed_lits, fixed_dists);
+	storedBits = 7 + 32 + 8 * (cc_uint32)len;
+
+	type = DEFLATE_BLOCK_DYNAMIC;
+	if (fixedBits  <= dynamicBits)              type = DEFLATE_BLOCK_FIXED;
+	if (storedBits < min(fixedBits, dynamicBits)) type = DEFLATE_BLOCK_STORED;
+
+	Deflate_PushBits(state, final, 1);
+	Deflate_PushBits(state, type,  2);
+	Deflate_FlushBits(state);
+	if (type == DEFLATE_BLOCK_STORED) return Deflate_WriteStored(state, data, len);
+
+	if (type == DEFLATE_BLOCK_FIXED) {
+		Deflate_BuildTable(fixed_lits,  INFLATE_MAX_LITS,  state->LitsCodewords,  state->LitsLens);
+		Deflate_BuildTable(fixed_dists, INFLATE_MAX_DISTS, state->DistsCodewords, state->DistsLens);
+	} else {
+		res = Deflate_WriteDynamicHeader(state, numLits, numDists, numCodeLens, codes, extra, numCodes, clensLens);
+		if (res) return res;
+
+		Deflate_BuildTable(litsLens,  DEFLATE_NUM_LITS,  state->LitsCodewords,  state->LitsLens);
+		Deflate_BuildTable(distsLens, DEFLATE_NUM_DISTS, state->DistsCodewords, state->DistsLens);
+	}
+	return Deflate_WriteSymbols(state);
+}
+
+/* Compresses current block of data, then writes it to the output */
+static cc_result Deflate_FlushBlock(struct DeflateState* state, int len, cc_bool final) {
+	cc_uint8* data = state->Input + DEFLATE_BLOCK_SIZE;
+	cc_result res;
+
+	Deflate_CompressBlock(state, len);
+	res = Deflate_WriteBlock(state, data, len, final);
+	if (!res) res = Deflate_FlushOutput(state);
 
 	Deflate_MoveBlock(state);
 	return res;
@@ -958,26 +1521,22 @@ static cc_result Deflate_StreamWrite(struct Stream* stream, const cc_uint8* data
 		data += len;
 
 		if (state->InputPosition == DEFLATE_BUFFER_SIZE) {
-			res = Deflate_FlushBlock(state, DEFLATE_BLOCK_SIZE);
+			res = Deflate_FlushBlock(state, DEFLATE_BLOCK_SIZE, false);
 			if (res) return res;
 		}
 	}
 	return 0;
 }
 
-/* Flushes any buffered data, then writes terminating symbol */
+/* Flushes any buffered data as the final block */
 static cc_result Deflate_StreamClose(struct Stream* stream) {
 	struct DeflateState* state;
 	cc_result res;
 
 	state = (struct DeflateState*)stream->Meta.Inflate;
-	res   = Deflate_FlushBlock(state, state->InputPosition - DEFLATE_BLOCK_SIZE);
+	res   = Deflate_FlushBlock(state, state->InputPosition - DEFLATE_BLOCK_SIZE, true);
 	if (res) return res;
 
-	/* Write huffman encoded "literal 256" to terminate symbols */
-	Deflate_PushLit(state, 256);
-	Deflate_FlushBits(state);
-
 	/* In case last byte still has a few extra bits */
 	if (state->NumBits) {
 		while (state->NumBits < 8) { Deflate_PushBits(state, 0, 1); }
@@ -987,26 +1546,6 @@ static cc_result Deflate_StreamClose(struct Stream* stream) {
 	return Stream_Write(state->Dest, state->Output, DEFLATE_OUT_SIZE - state->AvailOut);
 }
 
-/* Constructs a huffman encoding table (for values to codewords) */
-static void Deflate_BuildTable(const cc_uint8* lens, int count, cc_uint16* codewords, cc_uint8* bitlens) {
-	int i, j, offset, codeword;
-	struct HuffmanTable table;
-
-	/* NOTE: Can ignore since lens table is not user controlled */
-	(void)Huffman_Build(&table, lens, count);
-	for (i = 0; i < INFLATE_MAX_BITS; i++) {
-		if (!table.EndCodewords[i]) continue;
-		count = table.EndCodewords[i] - table.FirstCodewords[i];
-
-		for (j = 0; j < count; j++) {
-			offset   = table.Values[table.FirstOffsets[i] + j];
-			codeword = table.FirstCodewords[i] + j;
-			bitlens[offset]   = i;
-			codewords[offset] = Huffman_ReverseBits(codeword, i);
-		}
-	}
-}
-
 void Deflate_MakeStream(struct Stream* stream, struct DeflateState* state, struct Stream* underlying) {
 	Stream_Init(stream);
 	stream->Meta.Inflate = state;
@@ -1021,11 +1560,41 @@ void Deflate_MakeStream(struct Stream* stream, struct DeflateState* state, struc
 	state->NextOut  = state->Output;
 	state->AvailOut = DEFLATE_OUT_SIZE;
 	state->Dest     = underlying;
-	state->WroteHeader = false;
+
+	state->Level    = DEFLATE_LEVEL_DEFAULT;
 
 	Mem_Set(state->Head, 0, sizeof(state->Head));
 	Mem_Set(state->Prev, 0, sizeof(state->Prev));
-	Deflate_BuildTable(fixed_lits, INFLATE_MAX_LITS, state->LitsCodewords, state->LitsLens);
+	Deflate_InitCodes(state);
+}
+
+/* Primes the compressor with data that came immediately before the data to be compressed */
+/* NOTE: Only the last DEFLATE_BLOCK_SIZE bytes are used, as matches never look back further than a block */
+static void Deflate_SetDictionary(struct DeflateState* state, const cc_uint8* data, int len) {
+	cc_uint8* cur;
+	int i;
+	if (len > DEFLATE_BLOCK_SIZE) { data += len - DEFLATE_BLOCK_SIZE; len = DEFLATE_BLOCK_SIZE; }
+
+	cur = state->Input + DEFLATE_BLOCK_SIZE - len;
+	Mem_Copy(cur, data, len);
+	/* Hashing reads 4 bytes, so last few bytes can't be inserted */
+	for (i = 0; i < len - 3; i++) { Deflate_Insert(state, cur + i); }
+}
+
+/* Compresses any buffered data, then pads output to a byte boundary using an empty uncompressed block */
+/* NOTE: The output can then be directly followed by the output of another DEFLATE stream */
+static cc_result Deflate_SyncFlush(struct DeflateState* state) {
+	cc_result res;
+	if (state->InputPosition > DEFLATE_BLOCK_SIZE) {
+		res = Deflate_FlushBlock(state, state->InputPosition - DEFLATE_BLOCK_SIZE, false);
+		if (res) return res;
+	}
+
+	Deflate_PushBits(state, 0, 1);
+	Deflate_PushBits(state, DEFLATE_BLOCK_STORED, 2);
+	Deflate_FlushBits(state);
+	if ((res = Deflate_WriteStored(state, NULL, 0))) return res;
+	return Deflate_FlushOutput(state);
 }
 
 
@@ -1045,15 +1614,8 @@ static cc_result GZip_StreamClose(struct Stream* stream) {
 
 static cc_result GZip_StreamWrite(struct Stream* stream, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
 	struct GZipState* state = (struct GZipState*)stream->Meta.Inflate;
-	cc_uint32 i, crc32 = state->Crc32;
 	state->Size += count;
-
-	/* TODO: Optimise this calculation */
-	for (i = 0; i < count; i++) {
-		crc32 = Utils_Crc32Table[(crc32 ^ data[i]) & 0xFF] ^ (crc32 >> 8);
-	}
-
-	state->Crc32 = crc32;
+	state->Crc32 = Utils_Crc32Update(state->Crc32, data, count);
 	return Deflate_StreamWrite(stream, data, count, modified);
 }
 
@@ -1076,6 +1638,308 @@ void GZip_MakeStream(struct Stream* stream, struct GZipState* state, struct Stre
 }
 
 
+/*########################################################################################################################*
+*-------------------------------------------------GZip (parallel compress)------------------------------------------------*
+*#########################################################################################################################*/
+#define GZIP_PARALLEL_BLOCK_SIZE (128 * 1024)
+#define GZIP_PARALLEL_DICT_SIZE  DEFLATE_BLOCK_SIZE
+#define GZIP_PARALLEL_MAX_WORKERS 16
+
+struct GZipWorker {
+	void* thread;
+	void* jobReady;   /* Signalled when a job has been assigned to this worker (or it should quit) */
+	void* jobDone;    /* Signalled when this worker has finished compressing its job */
+	cc_bool pending;  /* Whether a job has been assigned, but not yet written to the destination */
+	cc_bool quit, final;
+	int dictLen, len; /* Length of dictionary and data to compress in input */
+	cc_uint32 crc32;  /* CRC32 of just the data to compress */
+	cc_result res;
+	struct Stream output; /* Memory that compressed output is written to */
+	struct DeflateState deflate;
+	cc_uint8 input[GZIP_PARALLEL_DICT_SIZE + GZIP_PARALLEL_BLOCK_SIZE];
+};
+
+static struct GZipParallelState {
+	struct GZipWorker* workers;
+	int numWorkers, cur, nextId;
+	void* mutex;
+	struct Stream* dest;
+	cc_uint32 crc32, size;
+	cc_bool wroteHeader;
+	cc_result res; /* First error that occurred */
+} gzip_par;
+
+/* Calculates the CRC32 of A followed by B, from CRC32 of A, CRC32 of B, and length of B */
+/*  (based on crc32_combine from zlib, which uses a matrix representing the effect of a zero bit) */
+static cc_uint32 GZip_Gf2Times(const cc_uint32* mat, cc_uint32 vec) {
+	cc_uint32 sum = 0;
+	for (; vec; vec >>= 1, mat++) { if (vec & 1) sum ^= *mat; }
+	return sum;
+}
+
+static void GZip_Gf2Square(cc_uint32* square, const cc_uint32* mat) {
+	int i;
+	for (i = 0; i < 32; i++) { square[i] = GZip_Gf2Times(mat, mat[i]); }
+}
+
+static cc_uint32 GZip_CombineCrc32(cc_uint32 crcA, cc_uint32 crcB, cc_uint32 lenB) {
+	cc_uint32 even[32], odd[32], row;
+	int i;
+	if (!lenB) return crcA;
+
+	/* Operator for one zero bit */
+	odd[0] = 0xEDB88320UL; row = 1;
+	for (i = 1; i < 32; i++) { odd[i] = row; row <<= 1; }
+
+	GZip_Gf2Square(even, odd); /* Operator for two zero bits */
+	GZip_Gf2Square(odd, even); /* Operator for four zero bits */
+
+	/* Apply lenB zero bytes to crcA (first squaring gives operator for one zero byte) */
+	for (;;) {
+		GZip_Gf2Square(even, odd);
+		if (lenB & 1) crcA = GZip_Gf2Times(even, crcA);
+		if (!(lenB >>= 1)) break;
+
+		GZip_Gf2Square(odd, even);
+		if (lenB & 1) crcA = GZip_Gf2Times(odd, crcA);
+		if (!(lenB >>= 1)) break;
+	}
+	return crcA ^ crcB;
+}
+
+static cc_result GZipWorker_WriteOutput(struct Stream* s, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	cc_uint32 used = s->Meta.Mem.Length - s->Meta.Mem.Left;
+	cc_uint8* base;
+
+	if (count > s->Meta.Mem.Left) {
+		base = (cc_uint8*)Mem_TryRealloc(s->Meta.Mem.Base, used + count + 4096, 1);
+		if (!base) return ERR_OUT_OF_MEMORY;
+
+		s->Meta.Mem.Base   = base;
+		s->Meta.Mem.Cur    = base + used;
+		s->Meta.Mem.Length = used + count + 4096;
+		s->Meta.Mem.Left   = s->Meta.Mem.Length - used;
+	}
+
+	Mem_Copy(s->Meta.Mem.Cur, data, count);
+	s->Meta.Mem.Cur  += count;
+	s->Meta.Mem.Left -= count;
+	*modified = count;
+	return 0;
+}
+
+/* Compresses the data in this worker's input, using the data before it as a dictionary */
+static cc_result GZipWorker_Compress(struct GZipWorker* w) {
+	cc_uint8* data = w->input + GZIP_PARALLEL_DICT_SIZE;
+	struct Stream compStream;
+	cc_result res;
+
+	w->crc32 = Utils_CRC32(data, w->len);
+
+	w->output.Meta.Mem.Cur  = w->output.Meta.Mem.Base;
+	w->output.Meta.Mem.Left = w->output.Meta.Mem.Length;
+
+	Deflate_MakeStream(&compStream, &w->deflate, &w->output);
+	Deflate_SetDictionary(&w->deflate, data - w->dictLen, w->dictLen);
+	if ((res = Stream_Write(&compStream, data, w->len))) return res;
+
+	/* Only last block sets the final block bit, all others have to be byte aligned */
+	/*  so that the output of the next block can just be appended after them */
+	if (w->final) return compStream.Close(&compStream);
+	return Deflate_SyncFlush(&w->deflate);
+}
+
+static void GZipWorker_Run(void) {
+	struct GZipWorker* w;
+	Mutex_Lock(gzip_par.mutex);
+	{
+		w = &gzip_par.workers[gzip_par.nextId++];
+	}
+	Mutex_Unlock(gzip_par.mutex);
+
+	for (;;) {
+		Waitable_Wait(w->jobReady);
+		if (w->quit) return;
+
+		w->res = GZipWorker_Compress(w);
+		Waitable_Signal(w->jobDone);
+	}
+}
+
+/* Waits for the given worker to finish its job (if any), then writes the compressed output */
+static cc_result GZipParallel_Finish(struct GZipWorker* w) {
+	static cc_uint8 header[10] = { 0x1F, 0x8B, 0x08 }; /* GZip header */
+	cc_uint32 outLen;
+	cc_result res;
+	if (!w->pending) return 0;
+
+	Waitable_Wait(w->jobDone);
+	w->pending = false;
+	if (gzip_par.res) return gzip_par.res;
+	if (w->res) { gzip_par.res = w->res; return w->res; }
+
+	if (!gzip_par.wroteHeader) {
+		gzip_par.wroteHeader = true;
+		if ((res = Stream_Write(gzip_par.dest, header, sizeof(header)))) { gzip_par.res = res; return res; }
+	}
+
+	outLen = w->output.Meta.Mem.Length - w->output.Meta.Mem.Left;
+	if ((res = Stream_Write(gzip_par.dest, w->output.Meta.Mem.Base, outLen))) { gzip_par.res = res; return res; }
+
+	gzip_par.crc32 = GZip_CombineCrc32(gzip_par.crc32, w->crc32, w->len);
+	gzip_par.size += w->len;
+	return 0;
+}
+
+/* Hands the data in the current worker's input to the worker to compress, */
+/*  then moves onto (and waits for if needed) the next worker */
+static cc_result GZipParallel_Dispatch(cc_bool final) {
+	struct GZipWorker* w = &gzip_par.workers[gzip_par.cur];
+	struct GZipWorker* next;
+	cc_result res;
+
+	w->final   = final;
+	w->pending = true;
+	Waitable_Signal(w->jobReady);
+	if (final) return 0;
+
+	/* Workers are used in round robin order, so the next worker's job is always the oldest */
+	gzip_par.cur = (gzip_par.cur + 1) % gzip_par.numWorkers;
+	next = &gzip_par.workers[gzip_par.cur];
+	if ((res = GZipParallel_Finish(next))) return res;
+
+	/* End of the block just dispatched is the dictionary for the next block */
+	next->dictLen = min(w->len, GZIP_PARALLEL_DICT_SIZE);
+	next->len     = 0;
+	Mem_Copy(next->input + GZIP_PARALLEL_DICT_SIZE - next->dictLen, 
+			w->input + GZIP_PARALLEL_DICT_SIZE + w->len - next->dictLen, next->dictLen);
+	return 0;
+}
+
+static cc_result GZipParallel_StreamWrite(struct Stream* stream, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	struct GZipWorker* w;
+	cc_uint32 len;
+	cc_result res;
+
+	*modified = 0;
+	if (gzip_par.res) return gzip_par.res;
+
+	while (count > 0) {
+		w   = &gzip_par.workers[gzip_par.cur];
+		len = min(count, (cc_uint32)(GZIP_PARALLEL_BLOCK_SIZE - w->len));
+
+		Mem_Copy(w->input + GZIP_PARALLEL_DICT_SIZE + w->len, data, len);
+		w->len    += len;
+		data      += len;
+		count     -= len;
+		*modified += len;
+
+		if (w->len < GZIP_PARALLEL_BLOCK_SIZE) continue;
+		if ((res = GZipParallel_Dispatch(false))) return res;
+	}
+	return 0;
+}
+
+static void GZipParallel_Free(void) {
+	struct GZipWorker* w;
+	int i;
+
+	/* Threads claim workers in whatever order they start in, so workers[i].thread isn't */
+	/*  necessarily the thread using workers[i] - hence all workers must be told to quit */
+	/*  before joining any thread, and all threads joined before freeing anything */
+	for (i = 0; i < gzip_par.numWorkers; i++) {
+		w = &gzip_par.workers[i];
+		w->quit = true;
+		if (w->jobReady) Waitable_Signal(w->jobReady);
+	}
+	for (i = 0; i < gzip_par.numWorkers; i++) {
+		w = &gzip_par.workers[i];
+		if (w->thread) Thread_Join(w->thread);
+	}
+
+	for (i = 0; i < gzip_par.numWorkers; i++) {
+		w = &gzip_par.workers[i];
+		if (w->jobReady) Waitable_Free(w->jobReady);
+		if (w->jobDone)  Waitable_Free(w->jobDone);
+		Mem_Free(w->output.Meta.Mem.Base);
+	}
+
+	if (gzip_par.mutex) Mutex_Free(gzip_par.mutex);
+	Mem_Free(gzip_par.workers);
+	gzip_par.workers = NULL;
+	gzip_par.mutex   = NULL;
+}
+
+static cc_result GZipParallel_StreamClose(struct Stream* stream) {
+	cc_uint8 data[8];
+	cc_result res, finishRes;
+	int i;
+
+	/* Last block is still dispatched even when empty, as it contains the final block bit */
+	res = gzip_par.res;
+	if (!res) GZipParallel_Dispatch(true);
+
+	/* Write out all remaining jobs, from oldest to newest (i.e. the last block) */
+	for (i = 1; i <= gzip_par.numWorkers; i++) {
+		finishRes = GZipParallel_Finish(&gzip_par.workers[(gzip_par.cur + i) % gzip_par.numWorkers]);
+		if (!res) res = finishRes;
+	}
+
+	if (!res) {
+		Stream_SetU32_LE(&data[0], gzip_par.crc32);
+		Stream_SetU32_LE(&data[4], gzip_par.size);
+		res = Stream_Write(gzip_par.dest, data, sizeof(data));
+	}
+
+	GZipParallel_Free();
+	return res;
+}
+
+static cc_bool GZipParallel_Init(int numWorkers, struct Stream* underlying) {
+	struct GZipWorker* w;
+	int i;
+
+	gzip_par.workers = (struct GZipWorker*)Mem_TryAllocCleared(numWorkers, sizeof(struct GZipWorker));
+	if (!gzip_par.workers) return false;
+
+	gzip_par.numWorkers  = numWorkers;
+	gzip_par.cur         = 0;
+	gzip_par.nextId      = 0;
+	gzip_par.dest        = underlying;
+	gzip_par.crc32       = 0;
+	gzip_par.size        = 0;
+	gzip_par.wroteHeader = false;
+	gzip_par.res         = 0;
+	gzip_par.mutex       = Mutex_Create();
+
+	for (i = 0; i < numWorkers; i++) {
+		w = &gzip_par.workers[i];
+		Stream_Init(&w->output);
+		w->output.Write = GZipWorker_WriteOutput;
+		w->jobReady     = Waitable_Create();
+		w->jobDone      = Waitable_Create();
+	}
+	/* Started separately, because threads use the workers array */
+	for (i = 0; i < numWorkers; i++) {
+		gzip_par.workers[i].thread = Thread_Start(GZipWorker_Run);
+	}
+	return true;
+}
+
+void GZip_MakeParallelStream(struct Stream* stream, struct GZipState* state, struct Stream* underlying) {
+	int numWorkers = min(Thread_ProcessorCount(), GZIP_PARALLEL_MAX_WORKERS);
+
+	/* Fallback to only using this thread when multiple threads wouldn't help */
+	if (numWorkers <= 1 || gzip_par.workers || !GZipParallel_Init(numWorkers, underlying)) {
+		GZip_MakeStream(stream, state, underlying); return;
+	}
+
+	Stream_Init(stream);
+	stream->Write = GZipParallel_StreamWrite;
+	stream->Close = GZipParallel_StreamClose;
+}
+
+
 /*########################################################################################################################*
 *-----------------------------------------------------ZLib (compress)-----------------------------------------------------*
 *#########################################################################################################################*/
@@ -1091,17 +1955,7 @@ static cc_result ZLib_StreamClose(struct Stream* stream) {
 
 static cc_result ZLib_StreamWrite(struct Stream* stream, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
 	struct ZLibState* state = (struct ZLibState*)stream->Meta.Inflate;
-	cc_uint32 i, adler32 = state->Adler32;
-	cc_uint32 s1 = adler32 & 0xFFFF, s2 = (adler32 >> 16) & 0xFFFF;
-
-	/* TODO: Optimise this calculation */
-	for (i = 0; i < count; i++) {
-		#define ADLER32_BASE 65521
-		s1 = (s1 + data[i]) % ADLER32_BASE;
-		s2 = (s2 + s1)      % ADLER32_BASE;
-	}
-
-	state->Adler32 = (s2 << 16) | s1;
+	state->Adler32 = Utils_Adler32Update(state->Adler32, data, count);
 	return Deflate_StreamWrite(stream, data, count, modified);
 }
 
@@ -1126,14 +1980,12 @@ void ZLib_MakeStream(struct Stream* stream, struct ZLibState* state, struct Stre
 /*########################################################################################################################*
 *--------------------------------------------------------ZipEntry---------------------------------------------------------*
 *#########################################################################################################################*/
-#define ZIP_MAXNAMELEN 512
 static cc_result Zip_ReadLocalFileHeader(struct ZipState* state, struct ZipEntry* entry) {
 	struct Stream* stream = state->input;
 	cc_uint8 header[26];
 	cc_uint32 compressedSize, uncompressedSize;
 	int method, pathLen, extraLen;
 
-	cc_string path; char pathBuffer[ZIP_MAXNAMELEN];
 	struct Stream portion, compStream;
 	struct InflateState inflate;
 	cc_result res;
@@ -1149,24 +2001,19 @@ static cc_result Zip_ReadLocalFileHeader(struct ZipState* state, struct ZipEntry
 
 	pathLen  = Stream_GetU16_LE(&header[22]);
 	extraLen = Stream_GetU16_LE(&header[24]);
-	if (pathLen > ZIP_MAXNAMELEN) return ZIP_ERR_FILENAME_LEN;
-
-	/* NOTE: ZIP spec says path uses code page 437 for encoding */
-	path = String_Init(pathBuffer, pathLen, pathLen);	
-	if ((res = Stream_Read(stream, (cc_uint8*)pathBuffer, pathLen))) return res;
 	state->_curEntry = entry;
 
-	if (!state->SelectEntry(&path)) return 0;
+	/* path is skipped, as it's the same as the path in central directory entry */
 	/* local file may have extra data before actual data (e.g. ZIP64) */
-	if ((res = stream->Skip(stream, extraLen))) return res;
+	if ((res = stream->Skip(stream, pathLen + extraLen))) return res;
 
 	if (method == 0) {
 		Stream_ReadonlyPortion(&portion, stream, uncompressedSize);
-		return state->ProcessEntry(&path, &portion, state);
+		return state->ProcessEntry(&entry->Path, &portion, state);
 	} else if (method == 8) {
 		Stream_ReadonlyPortion(&portion, stream, compressedSize);
 		Inflate_MakeStream2(&compStream, &inflate, &portion);
-		return state->ProcessEntry(&path, &compStream, state);
+		return state->ProcessEntry(&entry->Path, &compStream, state);
 	} else {
 		Platform_Log1("Unsupported.zip entry compression method: %i", &method);
 		/* TODO: Should this be an error */
@@ -1174,36 +2021,40 @@ static cc_result Zip_ReadLocalFileHeader(struct ZipState* state, struct ZipEntry
 	return 0;
 }
 
-static cc_result Zip_ReadCentralDirectory(struct ZipState* state) {
-	struct Stream* stream = state->input;
-	struct ZipEntry* entry;
-	cc_uint8 header[42];
-
-	cc_string path; char pathBuffer[ZIP_MAXNAMELEN];
-	int pathLen, extraLen, commentLen;
-	cc_result res;
-	if ((res = Stream_Read(stream, header, sizeof(header)))) return res;
+/* Hashes the given path, ignoring case */
+static cc_uint32 Zip_HashPath(const cc_string* path) {
+	cc_uint32 hash = 2166136261UL;
+	char c;
+	int i;
 
-	pathLen = Stream_GetU16_LE(&header[24]);
-	if (pathLen > ZIP_MAXNAMELEN) return ZIP_ERR_FILENAME_LEN;
+	for (i = 0; i < path->length; i++) {
+		c = path->buffer[i]; Char_MakeLower(c);
+		hash = (hash ^ (cc_uint8)c) * 16777619UL;
+	}
+	return hash;
+}
 
-	/* NOTE: ZIP spec says path uses code page 437 for encoding */
-	path = String_Init(pathBuffer, pathLen, pathLen);
-	if ((res = Stream_Read(stream, (cc_uint8*)pathBuffer, pathLen))) return res;
+/* Reads a central directory entry (after signature) from the central directory data */
+static cc_result Zip_ReadCentralDirectory(struct ZipEntry* entry, cc_uint8** data, cc_uint8* end) {
+	cc_uint8* header = *data + 4;
+	int pathLen, extraLen, commentLen;
+	if (end - header < 42) return ZIP_ERR_INVALID_CENTRAL_DIR;
 
-	/* skip data following central directory entry header */
+	pathLen    = Stream_GetU16_LE(&header[24]);
 	extraLen   = Stream_GetU16_LE(&header[26]);
 	commentLen = Stream_GetU16_LE(&header[28]);
-	if ((res = stream->Skip(stream, extraLen + commentLen))) return res;
+	if (end - header < 42 + pathLen + extraLen + commentLen) return ZIP_ERR_INVALID_CENTRAL_DIR;
 
-	if (!state->SelectEntry(&path)) return 0;
-	if (state->_usedEntries >= ZIP_MAX_ENTRIES) return ZIP_ERR_TOO_MANY_ENTRIES;
-	entry = &state->entries[state->_usedEntries++];
+	/* NOTE: ZIP spec says path uses code page 437 for encoding */
+	entry->Path = String_Init((char*)&header[42], pathLen, pathLen);
 
 	entry->CRC32             = Stream_GetU32_LE(&header[12]);
 	entry->CompressedSize    = Stream_GetU32_LE(&header[16]);
 	entry->UncompressedSize  = Stream_GetU32_LE(&header[20]);
 	entry->LocalHeaderOffset = Stream_GetU32_LE(&header[38]);
+
+	/* skip data following central directory entry header */
+	*data = header + 42 + pathLen + extraLen + commentLen;
 	return 0;
 }
 
@@ -1214,8 +2065,9 @@ static cc_result Zip_ReadEndOfCentralDirectory(struct ZipState* state) {
 	cc_result res;
 	if ((res = Stream_Read(stream, header, sizeof(header)))) return res;
 
-	state->_totalEntries  = Stream_GetU16_LE(&header[6]);
-	state->_centralDirBeg = Stream_GetU32_LE(&header[12]);
+	state->_totalEntries   = Stream_GetU16_LE(&header[6]);
+	state->_centralDirSize = Stream_GetU32_LE(&header[8]);
+	state->_centralDirBeg  = Stream_GetU32_LE(&header[12]);
 	return 0;
 }
 
@@ -1232,16 +2084,18 @@ void Zip_Init(struct ZipState* state, struct Stream* input) {
 	state->obj   = NULL;
 	state->ProcessEntry = Zip_DefaultProcessor;
 	state->SelectEntry  = Zip_DefaultSelector;
+
+	state->_totalEntries = 0;
+	state->_centralDir   = NULL;
+	state->_buckets      = NULL;
+	state->entries       = NULL;
 }
 
-cc_result Zip_Extract(struct ZipState* state) {
+static cc_result Zip_FindEndOfCentralDirectory(struct ZipState* state, cc_uint32 stream_len) {
 	struct Stream* stream = state->input;
-	cc_uint32 stream_len;
 	cc_uint32 sig = 0;
 	int i, count;
-
 	cc_result res;
-	if ((res = stream->Length(stream, &stream_len))) return res;
 
 	/* At -22 for nearly all zips, but try a bit further back in case of comment */
 	count = min(257, stream_len);
@@ -1254,38 +2108,116 @@ cc_result Zip_Extract(struct ZipState* state) {
 	}
 
 	if (sig != ZIP_SIG_ENDOFCENTRALDIR) return ZIP_ERR_NO_END_OF_CENTRAL_DIR;
-	res = Zip_ReadEndOfCentralDirectory(state);
-	if (res) return res;
+	return Zip_ReadEndOfCentralDirectory(state);
+}
+
+cc_result Zip_ReadDirectory(struct ZipState* state) {
+	struct Stream* stream = state->input;
+	struct ZipEntry* entry;
+	cc_uint8* data;
+	cc_uint8* end;
+	cc_uint32 stream_len, sig, hash;
+	int i, count, numBuckets;
+
+	cc_result res;
+	if ((res = stream->Length(stream, &stream_len)))                return res;
+	if ((res = Zip_FindEndOfCentralDirectory(state, stream_len))) return res;
 
+	if (state->_centralDirBeg > stream_len || state->_centralDirSize > stream_len - state->_centralDirBeg) {
+		return ZIP_ERR_INVALID_CENTRAL_DIR;
+	}
 	res = stream->Seek(stream, state->_centralDirBeg);
 	if (res) return ZIP_ERR_SEEK_CENTRAL_DIR;
-	state->_usedEntries = 0;
 
-	/* Read all the central directory entries */
-	for (i = 0; i < state->_totalEntries; i++) {
-		if ((res = Stream_ReadU32_LE(stream, &sig))) return res;
+	count = state->_totalEntries;
+	for (numBuckets = 16; numBuckets < count; numBuckets <<= 1) { }
+	state->_totalEntries = 0;
+	state->_bucketsMask  = numBuckets - 1;
 
-		if (sig == ZIP_SIG_CENTRALDIR) {
-			res = Zip_ReadCentralDirectory(state);
-			if (res) return res;
-		} else if (sig == ZIP_SIG_ENDOFCENTRALDIR) {
-			break;
-		} else {
-			return ZIP_ERR_INVALID_CENTRAL_DIR;
-		}
+	/* Read the whole central directory at once, instead of reading each entry separately */
+	state->_centralDir = (cc_uint8*)Mem_TryAlloc(state->_centralDirSize + 1, 1);
+	state->entries     = (struct ZipEntry*)Mem_TryAlloc(count + 1, sizeof(struct ZipEntry));
+	state->_buckets    = (int*)Mem_TryAlloc(numBuckets, sizeof(int));
+
+	if (!state->_centralDir || !state->entries || !state->_buckets) {
+		Zip_Free(state); return ERR_OUT_OF_MEMORY;
+	}
+	if ((res = Stream_Read(stream, state->_centralDir, state->_centralDirSize))) {
+		Zip_Free(state); return res;
 	}
 
-	/* Now read the local file header entries */
-	for (i = 0; i < state->_usedEntries; i++) {
-		struct ZipEntry* entry = &state->entries[i];
-		res = stream->Seek(stream, entry->LocalHeaderOffset);
-		if (res) return ZIP_ERR_SEEK_LOCAL_DIR;
+	for (i = 0; i < numBuckets; i++) { state->_buckets[i] = -1; }
+	data = state->_centralDir;
+	end  = state->_centralDir + state->_centralDirSize;
 
-		if ((res = Stream_ReadU32_LE(stream, &sig))) return res;
-		if (sig != ZIP_SIG_LOCALFILEHEADER) return ZIP_ERR_INVALID_LOCAL_DIR;
+	for (i = 0; i < count && (end - data) >= 4; i++) {
+		sig = Stream_GetU32_LE(data);
+		if (sig == ZIP_SIG_ENDOFCENTRALDIR) break;
+		if (sig != ZIP_SIG_CENTRALDIR) { res = ZIP_ERR_INVALID_CENTRAL_DIR; break; }
 
-		res = Zip_ReadLocalFileHeader(state, entry);
-		if (res) return res;
+		entry = &state->entries[state->_totalEntries];
+		if ((res = Zip_ReadCentralDirectory(entry, &data, end))) break;
+
+		hash = Zip_HashPath(&entry->Path) & state->_bucketsMask;
+		entry->_next = state->_buckets[hash];
+		state->_buckets[hash] = state->_totalEntries++;
 	}
-	return 0;
+
+	if (res) Zip_Free(state);
+	return res;
+}
+
+struct ZipEntry* Zip_FindEntry(struct ZipState* state, const cc_string* path) {
+	struct ZipEntry* entry;
+	int i;
+	if (!state->entries) return NULL;
+
+	i = state->_buckets[Zip_HashPath(path) & state->_bucketsMask];
+	for (; i >= 0; i = entry->_next) {
+		entry = &state->entries[i];
+		if (String_CaselessEquals(&entry->Path, path)) return entry;
+	}
+	return NULL;
+}
+
+cc_result Zip_ExtractEntry(struct ZipState* state, struct ZipEntry* entry) {
+	struct Stream* stream = state->input;
+	cc_uint32 sig = 0;
+	cc_result res;
+
+	res = stream->Seek(stream, entry->LocalHeaderOffset);
+	if (res) return ZIP_ERR_SEEK_LOCAL_DIR;
+
+	if ((res = Stream_ReadU32_LE(stream, &sig))) return res;
+	if (sig != ZIP_SIG_LOCALFILEHEADER) return ZIP_ERR_INVALID_LOCAL_DIR;
+	return Zip_ReadLocalFileHeader(state, entry);
+}
+
+void Zip_Free(struct ZipState* state) {
+	Mem_Free(state->_centralDir);
+	Mem_Free(state->entries);
+	Mem_Free(state->_buckets);
+
+	state->_totalEntries = 0;
+	state->_centralDir   = NULL;
+	state->_buckets      = NULL;
+	state->entries       = NULL;
+}
+
+cc_result Zip_Extract(struct ZipState* state) {
+	struct ZipEntry* entry;
+	cc_bool readDirectory = !state->entries;
+	cc_result res = 0;
+	int i;
+
+	if (readDirectory && (res = Zip_ReadDirectory(state))) return res;
+
+	for (i = 0; i < state->_totalEntries; i++) {
+		entry = &state->entries[i];
+		if (!state->SelectEntry(&entry->Path)) continue;
+		if ((res = Zip_ExtractEntry(state, entry))) break;
+	}
+
+	if (readDirectory) Zip_Free(state);
+	return res;
 }
@@ -27,12 +27,12 @@ cc_result ZLibHeader_Read(struct Stream* s, struct ZLibHeader* header);
 #define INFLATE_MAX_DISTS 32
 #define INFLATE_MAX_LITS_DISTS (INFLATE_MAX_LITS + INFLATE_MAX_DISTS)
 #define INFLATE_MAX_BITS 16
-#define INFLATE_FAST_BITS 9
+#define INFLATE_FAST_BITS 11
 #define INFLATE_WINDOW_SIZE 0x8000UL
 #define INFLATE_WINDOW_MASK 0x7FFFUL
 
 struct HuffmanTable {
-	cc_int16 Fast[1 << INFLATE_FAST_BITS];      /* Fast lookup table for huffman codes */
+	cc_uint32 Fast[1 << INFLATE_FAST_BITS];     /* Fast lookup table for huffman codes (see Huffman_Build) */
 	cc_uint16 FirstCodewords[INFLATE_MAX_BITS]; /* Starting codeword for each bit length */
 	cc_uint16 EndCodewords[INFLATE_MAX_BITS];   /* (Last codeword + 1) for each bit length. 0 is ignored. */
 	cc_uint16 FirstOffsets[INFLATE_MAX_BITS];   /* Base offset into Values for codewords of each bit length. */
@@ -42,12 +42,13 @@ struct HuffmanTable {
 struct InflateState {
 	cc_uint8 State;
 	cc_bool LastBlock; /* Whether the last DEFLATE block has been encounted in the stream */
-	cc_uint32 Bits;    /* Holds bits across byte boundaries */
+	cc_uint64 Bits;    /* Holds bits across byte boundaries */
 	cc_uint32 NumBits; /* Number of bits in Bits buffer */
 
 	cc_uint8* NextIn;   /* Pointer within Input buffer to next byte that can be read */
 	cc_uint32 AvailIn;  /* Max number of bytes that can be read from Input buffer */
 	cc_uint8* Output;   /* Pointer for output data */
+	cc_uint8* OutputBeg; /* Start of output data that has not been copied into Window yet */
 	cc_uint32 AvailOut; /* Max number of bytes that can be written to Output buffer */
 	struct Stream* Source;  /* Source for filling Input buffer */
 
@@ -71,6 +72,7 @@ struct InflateState {
 CC_API void Inflate_Init2(struct InflateState* state, struct Stream* source);
 /* Attempts to decompress as much of the currently pending data as possible. */
 /* NOTE: This is a low level call - usually you treat as a stream via Inflate_MakeStream. */
+/* NOTE: Data between OutputBeg and Output must be kept intact, as it's used for resolving back-references. */
 void Inflate_Process(struct InflateState* s);
 /* Deompresses input data read from another stream using DEFLATE. Read only stream. */
 /* NOTE: This only uncompresses pure DEFLATE compressed data. */
@@ -81,25 +83,50 @@ CC_API void Inflate_MakeStream2(struct Stream* stream, struct InflateState* stat
 #define DEFLATE_BLOCK_SIZE  16384
 #define DEFLATE_BUFFER_SIZE 32768
 #define DEFLATE_OUT_SIZE 8192
-#define DEFLATE_HASH_SIZE 0x1000UL
-#define DEFLATE_HASH_MASK 0x0FFFUL
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_HASH_SIZE (1 << DEFLATE_HASH_BITS)
+
+/* Only writes uncompressed blocks (fastest, but output is larger than input) */
+#define DEFLATE_LEVEL_STORE   0
+/* Only compresses runs of the same byte (e.g. layers of air or stone in maps) */
+#define DEFLATE_LEVEL_RLE     1
+/* Searches a few previous matches, without lazy evaluation */
+#define DEFLATE_LEVEL_FAST    2
+/* Balance between speed and compression ratio */
+#define DEFLATE_LEVEL_DEFAULT 3
+/* Searches far more previous matches (slowest, but smallest output) */
+#define DEFLATE_LEVEL_MAX     4
+
 struct DeflateState {
 	cc_uint32 Bits;         /* Holds bits across byte boundaries */
 	cc_uint32 NumBits;      /* Number of bits in Bits buffer */
 	cc_uint32 InputPosition;
+	/* How much effort is spent finding matches. (see DEFLATE_LEVEL_ defines) */
+	/* NOTE: Defaults to DEFLATE_LEVEL_DEFAULT, can be changed any time after Deflate_MakeStream */
+	int Level;
 
 	cc_uint8* NextOut;    /* Pointer within Output buffer to next byte that can be written */
 	cc_uint32 AvailOut;   /* Max number of bytes that can be written to Output buffer */
 	struct Stream* Dest; /* Destination that Output buffer is written to */
 
-	cc_uint16 LitsCodewords[INFLATE_MAX_LITS]; /* Codewords for each value */
-	cc_uint8 LitsLens[INFLATE_MAX_LITS];       /* Bit lengths of each codeword */
+	cc_uint16 LitsCodewords[INFLATE_MAX_LITS];   /* Codewords for each literal/length value */
+	cc_uint8 LitsLens[INFLATE_MAX_LITS];         /* Bit lengths of each literal/length codeword */
+	cc_uint16 DistsCodewords[INFLATE_MAX_DISTS]; /* Codewords for each distance value */
+	cc_uint8 DistsLens[INFLATE_MAX_DISTS];       /* Bit lengths of each distance codeword */
+
+	/* Symbols of current block, which are only written once the best type of block is known */
+	int NumSyms;
+	cc_uint16 SymLits[DEFLATE_BLOCK_SIZE];       /* Literal, or length of a match */
+	cc_uint16 SymDists[DEFLATE_BLOCK_SIZE];      /* Distance of a match, or 0 if a literal */
+	cc_uint16 LitsFreqs[INFLATE_MAX_LITS];       /* Number of times each literal/length value is used */
+	cc_uint16 DistsFreqs[INFLATE_MAX_DISTS];     /* Number of times each distance value is used */
+	cc_uint8 LenCodes[258 + 1];                  /* Length code (relative to 257) of each match length */
+	cc_uint8 DistCodes[512];                     /* Distance code of each match distance (see Deflate_DistCode) */
 	
 	cc_uint8 Input[DEFLATE_BUFFER_SIZE];
 	cc_uint8 Output[DEFLATE_OUT_SIZE];
-	int Head[DEFLATE_HASH_SIZE];
-	int Prev[DEFLATE_BUFFER_SIZE];
-	cc_bool WroteHeader;
+	cc_uint16 Head[DEFLATE_HASH_SIZE];   /* Most recent position in Input with each hash, or 0 if none */
+	cc_uint16 Prev[DEFLATE_BUFFER_SIZE]; /* Previous position in Input with same hash as each position */
 };
 /* Compresses input data using DEFLATE, then writes compressed output to another stream. Write only stream. */
 /* DEFLATE compression is pure compressed data, there is no header or footer. */
@@ -109,6 +136,11 @@ struct GZipState { struct DeflateState Base; cc_uint32 Crc32, Size; };
 /* Compresses input data using GZIP, then writes compressed output to another stream. Write only stream. */
 /* GZIP compression is GZIP header, followed by DEFLATE compressed data, followed by GZIP footer. */
 CC_API void GZip_MakeStream(struct Stream* stream, struct GZipState* state, struct Stream* underlying);
+/* Compresses input data using GZIP across multiple threads, then writes compressed output to another stream. */
+/* Input is split into 128 KB blocks which are compressed independently, so output is slightly larger. */
+/* NOTE: Falls back to GZip_MakeStream (using state) when multiple threads aren't available. */
+/* NOTE: The stream MUST always be closed, even if an error occurs while writing to it. */
+CC_API void GZip_MakeParallelStream(struct Stream* stream, struct GZipState* state, struct Stream* underlying);
 
 struct ZLibState { struct DeflateState Base; cc_uint32 Adler32; };
 /* Compresses input data using ZLIB, then writes compressed output to another stream. Write only stream. */
@@ -116,8 +148,11 @@ struct ZLibState { struct DeflateState Base; cc_uint32 Adler32; };
 CC_API void ZLib_MakeStream(struct Stream* stream, struct ZLibState* state, struct Stream* underlying);
 
 /* Minimal data needed to describe an entry in a .zip archive. */
-struct ZipEntry { cc_uint32 CompressedSize, UncompressedSize, LocalHeaderOffset, CRC32; };
-#define ZIP_MAX_ENTRIES 1024
+struct ZipEntry {
+	cc_uint32 CompressedSize, UncompressedSize, LocalHeaderOffset, CRC32;
+	cc_string Path; /* NOTE: Points into the central directory data loaded by Zip_ReadDirectory */
+	int _next;      /* (internal) Index of next entry in same hash bucket, or -1 if none */
+};
 struct ZipState;
 
 /* Stores state for reading and processing entries in a .zip archive. */
@@ -128,27 +163,42 @@ struct ZipState {
 	/* Return non-zero to indicate an error and stop further processing. */
 	/* NOTE: data stream MAY NOT be seekable. (i.e. entry data might be compressed) */
 	cc_result (*ProcessEntry)(const cc_string* path, struct Stream* data, struct ZipState* state);
-	/* Predicate used to select which entries in a .zip archive get processed. */
+	/* Predicate used to select which entries in a .zip archive get processed by Zip_Extract. */
 	/* NOTE: returning false entirely skips the entry. (avoids pointless seek to entry) */
 	cc_bool (*SelectEntry)(const cc_string* path);
 	/* Generic object/pointer for ProcessEntry callback. */
 	void* obj;
 
-	/* (internal) Number of entries selected by SelectEntry. */
-	int _usedEntries;
 	/* (internal) Total number of entries in the archive. */
 	int _totalEntries;
-	/* (internal) Offset to central directory entries. */
-	cc_uint32 _centralDirBeg;
+	/* (internal) Offset to and size of central directory entries. */
+	cc_uint32 _centralDirBeg, _centralDirSize;
 	/* (internal) Current entry being processed. */
 	struct ZipEntry* _curEntry;
-	/* Data for each entry in the .zip archive. */
-	struct ZipEntry entries[ZIP_MAX_ENTRIES];
+	/* (internal) Raw data of the central directory. */
+	cc_uint8* _centralDir;
+	/* (internal) Index of first entry in each hash bucket, or -1 if none. */
+	int* _buckets;
+	/* (internal) Number of hash buckets - 1. (number of buckets is always a power of two) */
+	int _bucketsMask;
+	/* Data for each entry in the .zip archive. (NULL until Zip_ReadDirectory is called) */
+	struct ZipEntry* entries;
 };
 
 /* Initialises .zip archive reader state to defaults. */
 CC_API void Zip_Init(struct ZipState* state, struct Stream* input);
 /* Reads and processes the entries in a .zip archive. */
 /* NOTE: Must have been initialised with Zip_Init first. */
+/* NOTE: Calls Zip_ReadDirectory and Zip_Free itself, if Zip_ReadDirectory wasn't called beforehand. */
 CC_API cc_result Zip_Extract(struct ZipState* state);
+
+/* Reads all the entries in the central directory of a .zip archive, so they can be looked up by path. */
+/* NOTE: Zip_Free must be called afterwards to free the memory used for the entries. */
+CC_API cc_result Zip_ReadDirectory(struct ZipState* state);
+/* Returns the entry with the given path (case insensitive), or NULL if there is no such entry. */
+CC_API struct ZipEntry* Zip_FindEntry(struct ZipState* state, const cc_string* path);
+/* Processes a single entry (using ProcessEntry), which need not be selected by SelectEntry. */
+CC_API cc_result Zip_ExtractEntry(struct ZipState* state, struct ZipEntry* entry);
+/* Frees memory allocated by Zip_ReadDirectory. */
+CC_API void Zip_Free(struct ZipState* state);
 #endif
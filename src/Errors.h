@@ -57,7 +57,7 @@ enum CC_ERRORS {
 	PNG_ERR_NO_DATA          = 0xCCDED02BUL, /* Image is missing all data */
 	PNG_ERR_INVALID_SCANLINE = 0xCCDED02CUL, /* Image row has invalid type */
 
-	ZIP_ERR_TOO_MANY_ENTRIES        = 0xCCDED02DUL, /* ZIP archive has too many entries */
+	/*ZIP_ERR_TOO_MANY_ENTRIES      = 0xCCDED02DUL, no longer used */
 	ZIP_ERR_SEEK_END_OF_CENTRAL_DIR = 0xCCDED02EUL, /* Failed to seek to end of central directory record */
 	ZIP_ERR_NO_END_OF_CENTRAL_DIR   = 0xCCDED02FUL, /* Failed to find end of central directory record */
 	ZIP_ERR_SEEK_CENTRAL_DIR        = 0xCCDED030UL, /* Failed to seek to central directory records */
@@ -115,5 +115,10 @@ enum CC_ERRORS {
 	ERR_NO_AUDIO_OUTPUT  = 0xCCDED05DUL, /* No audio output devices are connected */
 	ERR_INVALID_DATA_URL = 0xCCDED05EUL, /* Invalid URL provided to download from */
 	ERR_INVALID_OPEN_URL = 0xCCDED05FUL, /* Invalid URL provided to open in new tab */
+
+	CCR_ERR_IDENTIFIER = 0xCCDED060UL, /* CCR stream bytes #1-#4 aren't "CCRM" */
+	CCR_ERR_VERSION    = 0xCCDED061UL, /* CCR stream byte #5 isn't 2 */
+	CCR_ERR_REGION     = 0xCCDED062UL, /* CCR region size or index entry is invalid */
+	CCR_ERR_JOURNAL    = 0xCCDED063UL, /* CCR journal is incomplete or has an invalid change */
 };
 #endif
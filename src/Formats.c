@@ -17,17 +17,56 @@
 #include "Inventory.h"
 #include "TexturePack.h"
 #include "Utils.h"
+#include "Screens.h"
+#include "Options.h"
 
 
 /*########################################################################################################################*
 *--------------------------------------------------------General----------------------------------------------------------*
 *#########################################################################################################################*/
+#define MAP_MAX_DEFERRED 4
+typedef void (*Map_DeferredFunc)(void);
+
+/* Map data read by the importers. This is only applied to the game's world once importing has */
+/*  finished, so that importing can happen on a background thread while the game keeps running */
+static struct MapImportState {
+	BlockRaw* blocks;
+#ifdef EXTENDED_BLOCKS
+	BlockRaw* blocks2;
+#endif
+	int width, height, length, volume;
+	cc_uint8 uuid[WORLD_UUID_LEN];
+	Vec3 spawn;
+	float spawnYaw, spawnPitch;
+
+	/* Functions that change game state, which are called on the main thread once importing has finished */
+	Map_DeferredFunc deferred[MAP_MAX_DEFERRED];
+	int numDeferred;
+
+	cc_bool busy;
+	cc_result res;
+	IMapImporter importer;
+	struct Stream file, source;
+	cc_string path;
+	char _pathBuffer[FILENAME_SIZE];
+} map_import;
+
+volatile float Map_ImportProgress;
+volatile cc_bool Map_ImportDone;
+
+static void Map_Defer(Map_DeferredFunc func) {
+	if (map_import.numDeferred == MAP_MAX_DEFERRED) return;
+	map_import.deferred[map_import.numDeferred++] = func;
+}
+
+#define Map_Pack(x, y, z) (((y) * map_import.length + (z)) * map_import.width + (x))
+
 static cc_result Map_ReadBlocks(struct Stream* stream) {
-	World.Volume = World.Width * World.Length * World.Height;
-	World.Blocks = (BlockRaw*)Mem_TryAlloc(World.Volume, 1);
+	map_import.volume = map_import.width * map_import.length * map_import.height;
+	map_import.blocks = (BlockRaw*)Mem_TryAlloc(map_import.volume, 1);
 
-	if (!World.Blocks) return ERR_OUT_OF_MEMORY;
-	return Stream_Read(stream, World.Blocks, World.Volume);
+	if (!map_import.blocks) return ERR_OUT_OF_MEMORY;
+	return Stream_Read(stream, map_import.blocks, map_import.volume);
 }
 
 static cc_result Map_SkipGZipHeader(struct Stream* stream) {
@@ -44,46 +83,143 @@ static cc_result Map_SkipGZipHeader(struct Stream* stream) {
 IMapImporter Map_FindImporter(const cc_string* path) {
 	static const cc_string cw   = String_FromConst(".cw"),  lvl = String_FromConst(".lvl");
 	static const cc_string fcm  = String_FromConst(".fcm"), dat = String_FromConst(".dat");
-	static const cc_string mine = String_FromConst(".mine");
+	static const cc_string mine = String_FromConst(".mine"), ccr = String_FromConst(".ccr");
 
 	if (String_CaselessEnds(path,   &cw))  return Cw_Load;
 	if (String_CaselessEnds(path,  &lvl)) return Lvl_Load;
 	if (String_CaselessEnds(path,  &fcm)) return Fcm_Load;
 	if (String_CaselessEnds(path,  &dat)) return Dat_Load;
 	if (String_CaselessEnds(path, &mine)) return Dat_Load;
+	if (String_CaselessEnds(path,  &ccr)) return Ccr_Load;
 
 	return NULL;
 }
 
-cc_result Map_LoadFrom(const cc_string* path) {
-	cc_string relPath, fileName, fileExt;
-	IMapImporter importer;
-	struct Stream stream;
-	cc_result res;
-	Game_Reset();
-	
-	res = Stream_OpenFile(&stream, path);
-	if (res) { Logger_SysWarn2(res, "opening", path); return res; }
+static void Cw_FreeMetadata(void);
+static void Cw_ApplyMetadata(void);
 
-	importer = Map_FindImporter(path);
-	if (!importer) {
-		res = ERR_NOT_SUPPORTED;
-	} else if ((res = importer(&stream))) {
-		World_Reset();
-	}
+static void Map_FreeImport(void) {
+	Mem_Free(map_import.blocks);
+	map_import.blocks = NULL;
+#ifdef EXTENDED_BLOCKS
+	Mem_Free(map_import.blocks2);
+	map_import.blocks2 = NULL;
+#endif
+	map_import.numDeferred = 0;
+	Cw_FreeMetadata();
+}
+
+/* Tracks how much of the file has been read by the importer */
+static cc_result Map_SourceRead(struct Stream* s, cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	struct Stream* source = s->Meta.Portion.Source;
+	cc_result res = source->Read(source, data, count, modified);
+
+	s->Meta.Portion.Left -= min(*modified, s->Meta.Portion.Left);
+	Map_ImportProgress    = 1.0f - (float)s->Meta.Portion.Left / s->Meta.Portion.Length;
+	return res;
+}
+
+static cc_result Map_SourceSkip(struct Stream* s, cc_uint32 count) {
+	struct Stream* source = s->Meta.Portion.Source;
+	cc_result res = source->Skip(source, count);
+
+	s->Meta.Portion.Left -= min(count, s->Meta.Portion.Left);
+	Map_ImportProgress    = 1.0f - (float)s->Meta.Portion.Left / s->Meta.Portion.Length;
+	return res;
+}
 
+static void Map_ImportThread(void) {
+	cc_result res = map_import.importer(&map_import.source);
 	/* No point logging error for closing readonly file */
-	(void)stream.Close(&stream);
-	if (res) Logger_SysWarn2(res, "decoding", path);
+	(void)map_import.file.Close(&map_import.file);
+
+	map_import.res     = res;
+	Map_ImportProgress = 1.0f;
+	Map_ImportDone     = true;
+}
+
+void Map_EndImport(void) {
+	struct LocalPlayer* p = &LocalPlayer_Instance;
+	cc_string relPath, fileName, fileExt;
+	cc_result res = map_import.res;
+	int i;
+
+	Map_ImportDone  = false;
+	map_import.busy = false;
 
-	World_SetNewMap(World.Blocks, World.Width, World.Height, World.Length);
-	LocalPlayer_MoveToSpawn();
+	if (res) {
+		Logger_SysWarn2(res, "decoding", &map_import.path);
+		Map_FreeImport();
+	} else {
+		for (i = 0; i < map_import.numDeferred; i++) { map_import.deferred[i](); }
+		map_import.numDeferred = 0;
+		Cw_ApplyMetadata();
+
+		/* The player's spawn is left as it was in Map_LoadFrom when the map failed to load */
+		p->Spawn      = map_import.spawn;
+		p->SpawnYaw   = map_import.spawnYaw;
+		p->SpawnPitch = map_import.spawnPitch;
+		Mem_Copy(World.Uuid, map_import.uuid, WORLD_UUID_LEN);
+	}
+
+#ifdef EXTENDED_BLOCKS
+	if (map_import.blocks2) World_SetMapUpper(map_import.blocks2);
+	map_import.blocks2 = NULL;
+#endif
+	World_SetNewMap(map_import.blocks, map_import.width, map_import.height, map_import.length);
+	map_import.blocks = NULL;
+	if (!res) LocalPlayer_MoveToSpawn();
 
-	relPath = *path;
+	relPath = map_import.path;
 	Utils_UNSAFE_GetFilename(&relPath);
 	String_UNSAFE_Separate(&relPath, '.', &fileName, &fileExt);
 	String_Copy(&World.Name, &fileName);
-	return res;
+}
+
+cc_result Map_LoadFrom(const cc_string* path) {
+	struct LocalPlayer* p = &LocalPlayer_Instance;
+	struct MapImportState* m = &map_import;
+	cc_uint32 length;
+	cc_result res;
+	if (m->busy) return ERR_NOT_SUPPORTED;
+	Game_Reset();
+
+	String_InitArray(m->path, m->_pathBuffer);
+	String_AppendString(&m->path, path);
+	m->width  = 0; m->height = 0; m->length = 0; m->volume = 0;
+	Mem_Set(m->uuid, 0, WORLD_UUID_LEN);
+	m->spawn      = p->Spawn;
+	m->spawnYaw   = p->SpawnYaw;
+	m->spawnPitch = p->SpawnPitch;
+	
+	/* Apply any changes that weren't fully saved, before reading the file */
+	m->importer = Map_FindImporter(path);
+	if (m->importer == Ccr_Load) Ccr_RecoverJournal(path);
+
+	res = Stream_OpenFile(&m->file, path);
+	if (res) { Logger_SysWarn2(res, "opening", path); return res; }
+
+	if (!m->importer) {
+		(void)m->file.Close(&m->file);
+		m->res = ERR_NOT_SUPPORTED;
+		Map_EndImport();
+		return ERR_NOT_SUPPORTED;
+	}
+
+	if (m->file.Length(&m->file, &length) || !length) length = 1;
+	Stream_Init(&m->source);
+	m->source.Read = Map_SourceRead;
+	m->source.Skip = Map_SourceSkip;
+	m->source.Meta.Portion.Source = &m->file;
+	m->source.Meta.Portion.Left   = length;
+	m->source.Meta.Portion.Length = length;
+
+	m->busy            = true;
+	Map_ImportDone     = false;
+	Map_ImportProgress = 0.0f;
+	MapImportingScreen_Show(&m->path);
+	Thread_Detach(Thread_Start(Map_ImportThread));
+	return 0;
 }
 
 
@@ -131,34 +267,39 @@ static cc_result Lvl_ReadCustomBlocks(struct Stream* stream) {
 	cc_result res;
 	int x, y, z, i;
 
+	BlockRaw* blocks = map_import.blocks;
+	int width  = map_import.width;
+	int height = map_import.height;
+	int length = map_import.length;
+
 	/* skip bounds checks when we know chunk is entirely inside map */
-	int adjWidth  = World.Width  & ~0x0F;
-	int adjHeight = World.Height & ~0x0F;
-	int adjLength = World.Length & ~0x0F;
+	int adjWidth  = width  & ~0x0F;
+	int adjHeight = height & ~0x0F;
+	int adjLength = length & ~0x0F;
 
-	for (y = 0; y < World.Height; y += LVL_CHUNKSIZE) {
-		for (z = 0; z < World.Length; z += LVL_CHUNKSIZE) {
-			for (x = 0; x < World.Width; x += LVL_CHUNKSIZE) {
+	for (y = 0; y < height; y += LVL_CHUNKSIZE) {
+		for (z = 0; z < length; z += LVL_CHUNKSIZE) {
+			for (x = 0; x < width; x += LVL_CHUNKSIZE) {
 
 				if ((res = stream->ReadU8(stream, &hasCustom))) return res;
 				if (hasCustom != 1) continue;
 				if ((res = Stream_Read(stream, chunk, sizeof(chunk)))) return res;
-				baseIndex = World_Pack(x, y, z);
+				baseIndex = Map_Pack(x, y, z);
 
 				if ((x + LVL_CHUNKSIZE) <= adjWidth && (y + LVL_CHUNKSIZE) <= adjHeight && (z + LVL_CHUNKSIZE) <= adjLength) {
 					for (i = 0; i < sizeof(chunk); i++) {
 						xx = i & 0xF; yy = (i >> 8) & 0xF; zz = (i >> 4) & 0xF;
 
-						index = baseIndex + World_Pack(xx, yy, zz);
-						World.Blocks[index] = World.Blocks[index] == LVL_CUSTOMTILE ? chunk[i] : World.Blocks[index];
+						index = baseIndex + Map_Pack(xx, yy, zz);
+						blocks[index] = blocks[index] == LVL_CUSTOMTILE ? chunk[i] : blocks[index];
 					}
 				} else {
 					for (i = 0; i < sizeof(chunk); i++) {
 						xx = i & 0xF; yy = (i >> 8) & 0xF; zz = (i >> 4) & 0xF;
-						if ((x + xx) >= World.Width || (y + yy) >= World.Height || (z + zz) >= World.Length) continue;
+						if ((x + xx) >= width || (y + yy) >= height || (z + zz) >= length) continue;
 
-						index = baseIndex + World_Pack(xx, yy, zz);
-						World.Blocks[index] = World.Blocks[index] == LVL_CUSTOMTILE ? chunk[i] : World.Blocks[index];
+						index = baseIndex + Map_Pack(xx, yy, zz);
+						blocks[index] = blocks[index] == LVL_CUSTOMTILE ? chunk[i] : blocks[index];
 					}
 				}
 			}
@@ -167,6 +308,11 @@ static cc_result Lvl_ReadCustomBlocks(struct Stream* stream) {
 	return 0;
 }
 
+static void Lvl_WarnCustomBlocks(void) {
+	Chat_AddRaw("&cEnd of stream reading .lvl custom blocks section");
+	Chat_AddRaw("&c  Some blocks may therefore appear incorrectly");
+}
+
 cc_result Lvl_Load(struct Stream* stream) {
 	cc_uint8 header[18];
 	cc_uint8* blocks;
@@ -174,7 +320,7 @@ cc_result Lvl_Load(struct Stream* stream) {
 	cc_result res;
 	int i;
 
-	struct LocalPlayer* p = &LocalPlayer_Instance;
+	struct MapImportState* m = &map_import;
 	struct Stream compStream;
 	struct InflateState state;
 	Inflate_MakeStream2(&compStream, &state, stream);
@@ -183,27 +329,27 @@ cc_result Lvl_Load(struct Stream* stream) {
 	if ((res = Stream_Read(&compStream, header, sizeof(header)))) return res;
 	if (Stream_GetU16_LE(&header[0]) != 1874) return LVL_ERR_VERSION;
 
-	World.Width  = Stream_GetU16_LE(&header[2]);
-	World.Length = Stream_GetU16_LE(&header[4]);
-	World.Height = Stream_GetU16_LE(&header[6]);
+	m->width  = Stream_GetU16_LE(&header[2]);
+	m->length = Stream_GetU16_LE(&header[4]);
+	m->height = Stream_GetU16_LE(&header[6]);
 
-	p->Spawn.X = Stream_GetU16_LE(&header[8]);
-	p->Spawn.Z = Stream_GetU16_LE(&header[10]);
-	p->Spawn.Y = Stream_GetU16_LE(&header[12]);
-	p->SpawnYaw   = Math_Packed2Deg(header[14]);
-	p->SpawnPitch = Math_Packed2Deg(header[15]);
+	m->spawn.X = Stream_GetU16_LE(&header[8]);
+	m->spawn.Z = Stream_GetU16_LE(&header[10]);
+	m->spawn.Y = Stream_GetU16_LE(&header[12]);
+	m->spawnYaw   = Math_Packed2Deg(header[14]);
+	m->spawnPitch = Math_Packed2Deg(header[15]);
 	/* (2) pervisit, perbuild permissions */
 
 	if ((res = Map_ReadBlocks(&compStream))) return res;
-	blocks = World.Blocks;
+	blocks = m->blocks;
 	/* Bulk convert 4 blocks at once */
-	for (i = 0; i < (World.Volume & ~3); i += 4) {
+	for (i = 0; i < (m->volume & ~3); i += 4) {
 		*blocks = Lvl_table[*blocks]; blocks++;
 		*blocks = Lvl_table[*blocks]; blocks++;
 		*blocks = Lvl_table[*blocks]; blocks++;
 		*blocks = Lvl_table[*blocks]; blocks++;
 	}
-	for (; i < World.Volume; i++) {
+	for (; i < m->volume; i++) {
 		*blocks = Lvl_table[*blocks]; blocks++;
 	}
 
@@ -218,8 +364,7 @@ cc_result Lvl_Load(struct Stream* stream) {
 	res = Lvl_ReadCustomBlocks(&compStream);
 	/* At least one map out there has a corrupted 0xBD section */
 	if (res == ERR_END_OF_STREAM) {
-		Chat_AddRaw("&cEnd of stream reading .lvl custom blocks section");
-		Chat_AddRaw("&c  Some blocks may therefore appear incorrectly");
+		Map_Defer(Lvl_WarnCustomBlocks);
 		res = 0;
 	}
 	return res;
@@ -259,7 +404,7 @@ cc_result Fcm_Load(struct Stream* stream) {
 	cc_result res;
 	int i, count;
 
-	struct LocalPlayer* p = &LocalPlayer_Instance;
+	struct MapImportState* m = &map_import;
 	struct Stream compStream;
 	struct InflateState state;
 	Inflate_MakeStream2(&compStream, &state, stream);
@@ -268,19 +413,19 @@ cc_result Fcm_Load(struct Stream* stream) {
 	if (Stream_GetU32_LE(&header[0]) != 0x0FC2AF40UL)        return FCM_ERR_IDENTIFIER;
 	if (header[4] != 13) return FCM_ERR_REVISION;
 	
-	World.Width  = Stream_GetU16_LE(&header[5]);
-	World.Height = Stream_GetU16_LE(&header[7]);
-	World.Length = Stream_GetU16_LE(&header[9]);
+	m->width  = Stream_GetU16_LE(&header[5]);
+	m->height = Stream_GetU16_LE(&header[7]);
+	m->length = Stream_GetU16_LE(&header[9]);
 	
-	p->Spawn.X = ((int)Stream_GetU32_LE(&header[11])) / 32.0f;
-	p->Spawn.Y = ((int)Stream_GetU32_LE(&header[15])) / 32.0f;
-	p->Spawn.Z = ((int)Stream_GetU32_LE(&header[19])) / 32.0f;
-	p->SpawnYaw   = Math_Packed2Deg(header[23]);
-	p->SpawnPitch = Math_Packed2Deg(header[24]);
+	m->spawn.X = ((int)Stream_GetU32_LE(&header[11])) / 32.0f;
+	m->spawn.Y = ((int)Stream_GetU32_LE(&header[15])) / 32.0f;
+	m->spawn.Z = ((int)Stream_GetU32_LE(&header[19])) / 32.0f;
+	m->spawnYaw   = Math_Packed2Deg(header[23]);
+	m->spawnPitch = Math_Packed2Deg(header[24]);
 
 	/* header[25] (4) date modified */
 	/* header[29] (4) date created */
-	Mem_Copy(&World.Uuid, &header[33], WORLD_UUID_LEN);
+	Mem_Copy(m->uuid, &header[33], WORLD_UUID_LEN);
 	/* header[49] (26) layer index */
 	count = (int)Stream_GetU32_LE(&header[75]);
 
@@ -366,26 +511,79 @@ static cc_string NbtTag_String(struct NbtTag* tag) {
 	return tag->value.str.text;
 }
 
-static cc_result Nbt_ReadString(struct Stream* stream, cc_string* str) {
-	cc_uint8 buffer[NBT_STRING_SIZE * 4];
-	int len;
+typedef void (*Nbt_Callback)(struct NbtTag* tag);
+/* Returns whether the data of a large byte array tag is needed, instead of just being skipped over */
+typedef cc_bool (*Nbt_ArrayFilter)(struct NbtTag* tag);
+
+/* Tags are parsed from a buffer filled in large reads, rather than with many small reads from the stream */
+/* Large byte arrays (e.g. blocks) bypass the buffer, and are read straight from the stream into their allocation */
+#define NBT_BUFFER_SIZE 8192
+struct NbtReader {
+	struct Stream* stream;
+	cc_uint8* cur; /* Start of unread data in buffer */
+	cc_uint8* end; /* End of unread data in buffer */
+	Nbt_Callback callback;
+	Nbt_ArrayFilter wantsArray;
+	cc_uint8 buffer[NBT_BUFFER_SIZE];
+};
+
+/* Ensures at least count bytes of unread data are in the buffer */
+static cc_result Nbt_Fill(struct NbtReader* r, cc_uint32 count) {
+	cc_uint32 i, left = (cc_uint32)(r->end - r->cur), read;
 	cc_result res;
+	if (left >= count) return 0;
 
-	if ((res = Stream_Read(stream, buffer, 2)))   return res;
-	len = Stream_GetU16_BE(buffer);
+	for (i = 0; i < left; i++) { r->buffer[i] = r->cur[i]; }
+	r->cur = r->buffer;
+	r->end = r->buffer + left;
 
-	if (len > Array_Elems(buffer)) return CW_ERR_STRING_LEN;
-	if ((res = Stream_Read(stream, buffer, len))) return res;
+	while (left < count) {
+		res = r->stream->Read(r->stream, r->end, NBT_BUFFER_SIZE - left, &read);
+		if (res)   return res;
+		if (!read) return ERR_END_OF_STREAM;
 
-	String_AppendUtf8(str, buffer, len);
+		r->end += read; left += read;
+	}
 	return 0;
 }
 
-typedef void (*Nbt_Callback)(struct NbtTag* tag);
-static cc_result Nbt_ReadTag(cc_uint8 typeId, cc_bool readTagName, struct Stream* stream, struct NbtTag* parent, Nbt_Callback callback) {
+/* Reads data into dst, with only the data already in the buffer being copied from it */
+static cc_result Nbt_ReadData(struct NbtReader* r, cc_uint8* dst, cc_uint32 count) {
+	cc_uint32 left = min(count, (cc_uint32)(r->end - r->cur));
+	Mem_Copy(dst, r->cur, left);
+	r->cur += left;
+
+	if (left == count) return 0;
+	return Stream_Read(r->stream, dst + left, count - left);
+}
+
+static cc_result Nbt_SkipData(struct NbtReader* r, cc_uint32 count) {
+	cc_uint32 left = min(count, (cc_uint32)(r->end - r->cur));
+	r->cur += left;
+
+	if (left == count) return 0;
+	return r->stream->Skip(r->stream, count - left);
+}
+
+static cc_result Nbt_ReadString(struct NbtReader* r, cc_string* str) {
+	cc_result res;
+	int len;
+
+	if ((res = Nbt_Fill(r, 2))) return res;
+	len = Stream_GetU16_BE(r->cur);
+	r->cur += 2;
+
+	if (len > NBT_STRING_SIZE * 4) return CW_ERR_STRING_LEN;
+	if ((res = Nbt_Fill(r, len))) return res;
+
+	String_AppendUtf8(str, r->cur, len);
+	r->cur += len;
+	return 0;
+}
+
+static cc_result Nbt_ReadTag(cc_uint8 typeId, cc_bool readTagName, struct NbtReader* r, struct NbtTag* parent) {
 	struct NbtTag tag;
 	cc_uint8 childType;
-	cc_uint8 tmp[5];	
 	cc_result res;
 	cc_uint32 i, count;
 	
@@ -396,62 +594,73 @@ static cc_result Nbt_ReadTag(cc_uint8 typeId, cc_bool readTagName, struct Stream
 	String_InitArray(tag.name, tag._nameBuffer);
 
 	if (readTagName) {
-		res = Nbt_ReadString(stream, &tag.name);
+		res = Nbt_ReadString(r, &tag.name);
 		if (res) return res;
 	}
 
 	switch (typeId) {
 	case NBT_I8:
-		res = stream->ReadU8(stream, &tag.value.u8);
+		if ((res = Nbt_Fill(r, 1))) break;
+		tag.value.u8 = *r->cur++;
 		break;
 	case NBT_I16:
-		res = Stream_Read(stream, tmp, 2);
-		tag.value.u16 = Stream_GetU16_BE(tmp);
+		if ((res = Nbt_Fill(r, 2))) break;
+		tag.value.u16 = Stream_GetU16_BE(r->cur);
+		r->cur += 2;
 		break;
 	case NBT_I32:
 	case NBT_F32:
-		res = Stream_ReadU32_BE(stream, &tag.value.u32);
+		if ((res = Nbt_Fill(r, 4))) break;
+		tag.value.u32 = Stream_GetU32_BE(r->cur);
+		r->cur += 4;
 		break;
 	case NBT_I64:
 	case NBT_R64:
-		res = stream->Skip(stream, 8);
+		res = Nbt_SkipData(r, 8);
 		break; /* (8) data */
 
 	case NBT_I8S:
-		if ((res = Stream_ReadU32_BE(stream, &tag.dataSize))) break;
+		if ((res = Nbt_Fill(r, 4))) break;
+		tag.dataSize = Stream_GetU32_BE(r->cur);
+		r->cur += 4;
 
 		if (NbtTag_IsSmall(&tag)) {
-			res = Stream_Read(stream, tag.value.small, tag.dataSize);
+			res = Nbt_ReadData(r, tag.value.small, tag.dataSize);
+		} else if (!r->wantsArray(&tag)) {
+			/* Unused arrays aren't passed to the callback at all */
+			return Nbt_SkipData(r, tag.dataSize);
 		} else {
 			tag.value.big = (cc_uint8*)Mem_TryAlloc(tag.dataSize, 1);
 			if (!tag.value.big) return ERR_OUT_OF_MEMORY;
 
-			res = Stream_Read(stream, tag.value.big, tag.dataSize);
+			res = Nbt_ReadData(r, tag.value.big, tag.dataSize);
 			if (res) Mem_Free(tag.value.big);
 		}
 		break;
 	case NBT_STR:
 		String_InitArray(tag.value.str.text, tag.value.str.buffer);
-		res = Nbt_ReadString(stream, &tag.value.str.text);
+		res = Nbt_ReadString(r, &tag.value.str.text);
 		break;
 
 	case NBT_LIST:
-		if ((res = Stream_Read(stream, tmp, 5))) break;
-		childType = tmp[0];
-		count = Stream_GetU32_BE(&tmp[1]);
+		if ((res = Nbt_Fill(r, 5))) break;
+		childType = r->cur[0];
+		count = Stream_GetU32_BE(&r->cur[1]);
+		r->cur += 5;
 
 		for (i = 0; i < count; i++) {
-			res = Nbt_ReadTag(childType, false, stream, &tag, callback);
+			res = Nbt_ReadTag(childType, false, r, &tag);
 			if (res) break;
 		}
 		break;
 
 	case NBT_DICT:
 		for (;;) {
-			if ((res = stream->ReadU8(stream, &childType))) break;
+			if ((res = Nbt_Fill(r, 1))) break;
+			childType = *r->cur++;
 			if (childType == NBT_END) break;
 
-			res = Nbt_ReadTag(childType, true, stream, &tag, callback);
+			res = Nbt_ReadTag(childType, true, r, &tag);
 			if (res) break;
 		}
 		break;
@@ -461,7 +670,7 @@ static cc_result Nbt_ReadTag(cc_uint8 typeId, cc_bool readTagName, struct Stream
 
 	if (res) return res;
 	tag.result = 0;
-	callback(&tag);
+	r->callback(&tag);
 	/* NOTE: callback must set DataBig to NULL, if doesn't want it to be freed */
 	if (!NbtTag_IsSmall(&tag)) Mem_Free(tag.value.big);
 	return tag.result;
@@ -593,43 +802,44 @@ static BlockRaw* Cw_GetBlocks(struct NbtTag* tag) {
 		Mem_Copy(ptr, tag->value.small, tag->dataSize);
 	} else {
 		ptr = tag->value.big;
-		tag->value.big = NULL; /* So Nbt_ReadTag doesn't call Mem_Free on World.Blocks */
+		tag->value.big = NULL; /* So Nbt_ReadTag doesn't call Mem_Free on the blocks */
 	}
 	return ptr;
 }
 
 static void Cw_Callback_1(struct NbtTag* tag) {
-	if (IsTag(tag, "X")) { World.Width  = NbtTag_U16(tag); return; }
-	if (IsTag(tag, "Y")) { World.Height = NbtTag_U16(tag); return; }
-	if (IsTag(tag, "Z")) { World.Length = NbtTag_U16(tag); return; }
+	struct MapImportState* m = &map_import;
+	if (IsTag(tag, "X")) { m->width  = NbtTag_U16(tag); return; }
+	if (IsTag(tag, "Y")) { m->height = NbtTag_U16(tag); return; }
+	if (IsTag(tag, "Z")) { m->length = NbtTag_U16(tag); return; }
 
 	if (IsTag(tag, "UUID")) {
 		if (tag->dataSize != WORLD_UUID_LEN) {
 			tag->result = CW_ERR_UUID_LEN;
 		} else {
-			Mem_Copy(World.Uuid, tag->value.small, WORLD_UUID_LEN);
+			Mem_Copy(m->uuid, tag->value.small, WORLD_UUID_LEN);
 		}
 		return;
 	}
 
 	if (IsTag(tag, "BlockArray")) {
-		World.Volume = tag->dataSize;
-		World.Blocks = Cw_GetBlocks(tag);
+		m->volume = tag->dataSize;
+		m->blocks = Cw_GetBlocks(tag);
 	}
 #ifdef EXTENDED_BLOCKS
-	if (IsTag(tag, "BlockArray2")) World_SetMapUpper(Cw_GetBlocks(tag));
+	if (IsTag(tag, "BlockArray2")) m->blocks2 = Cw_GetBlocks(tag);
 #endif
 }
 
 static void Cw_Callback_2(struct NbtTag* tag) {
-	struct LocalPlayer* p = &LocalPlayer_Instance;
+	struct MapImportState* m = &map_import;
 	if (!IsTag(tag->parent, "Spawn")) return;
 	
-	if (IsTag(tag, "X")) { p->Spawn.X = NbtTag_I16(tag); return; }
-	if (IsTag(tag, "Y")) { p->Spawn.Y = NbtTag_I16(tag); return; }
-	if (IsTag(tag, "Z")) { p->Spawn.Z = NbtTag_I16(tag); return; }
-	if (IsTag(tag, "H")) { p->SpawnYaw   = Math_Packed2Deg(NbtTag_U8(tag)); return; }
-	if (IsTag(tag, "P")) { p->SpawnPitch = Math_Packed2Deg(NbtTag_U8(tag)); return; }
+	if (IsTag(tag, "X")) { m->spawn.X = NbtTag_I16(tag); return; }
+	if (IsTag(tag, "Y")) { m->spawn.Y = NbtTag_I16(tag); return; }
+	if (IsTag(tag, "Z")) { m->spawn.Z = NbtTag_I16(tag); return; }
+	if (IsTag(tag, "H")) { m->spawnYaw   = Math_Packed2Deg(NbtTag_U8(tag)); return; }
+	if (IsTag(tag, "P")) { m->spawnPitch = Math_Packed2Deg(NbtTag_U8(tag)); return; }
 }
 
 static BlockID cw_curID;
@@ -790,33 +1000,150 @@ static void Cw_Callback_5(struct NbtTag* tag) {
 	}
 }
 
-static void Cw_Callback(struct NbtTag* tag) {
+/* Metadata tags may change game state (e.g. environment or block definitions), */
+/*  so are only applied on the main thread once the map has finished importing */
+#define CW_META_MAX_PARENTS 5
+struct CwMetaTag {
+	struct NbtTag tag;
+	int numParents;
+	cc_uint8 parentLens[CW_META_MAX_PARENTS];
+	char parentNames[CW_META_MAX_PARENTS][NBT_STRING_SIZE];
+};
+static struct CwMetaTag* cw_meta;
+static int cw_metaCount, cw_metaCapacity;
+
+static void Cw_DeferTag(struct NbtTag* tag, int depth) {
+	struct CwMetaTag* meta;
+	struct NbtTag* parent;
+	int i;
+
+	if (cw_metaCount == cw_metaCapacity) {
+		meta = (struct CwMetaTag*)Mem_TryRealloc(cw_meta, cw_metaCapacity + 64, sizeof(struct CwMetaTag));
+		if (!meta) { tag->result = ERR_OUT_OF_MEMORY; return; }
+
+		cw_meta          = meta;
+		cw_metaCapacity += 64;
+	}
+
+	meta = &cw_meta[cw_metaCount++];
+	meta->tag        = *tag;
+	meta->numParents = depth;
+	/* Take ownership of array data, so Nbt_ReadTag doesn't call Mem_Free on it */
+	if (!NbtTag_IsSmall(tag)) tag->value.big = NULL;
+
+	for (i = 0, parent = tag->parent; i < depth; i++, parent = parent->parent) {
+		meta->parentLens[i] = parent->name.length;
+		Mem_Copy(meta->parentNames[i], parent->name.buffer, parent->name.length);
+	}
+}
+
+static void Cw_FreeMetadata(void) {
+	int i;
+	for (i = 0; i < cw_metaCount; i++) {
+		if (!NbtTag_IsSmall(&cw_meta[i].tag)) Mem_Free(cw_meta[i].tag.value.big);
+	}
+
+	Mem_Free(cw_meta);
+	cw_meta         = NULL;
+	cw_metaCount    = 0;
+	cw_metaCapacity = 0;
+}
+
+static void Cw_ApplyMetadata(void) {
+	struct NbtTag parents[CW_META_MAX_PARENTS];
+	struct NbtTag* tag;
+	int i, j, count;
+
+	for (i = 0; i < cw_metaCount; i++) {
+		tag   = &cw_meta[i].tag;
+		count = cw_meta[i].numParents;
+
+		/* Callbacks only look at the names of parent tags */
+		for (j = 0; j < count; j++) {
+			parents[j].name   = String_Init(cw_meta[i].parentNames[j], cw_meta[i].parentLens[j], NBT_STRING_SIZE);
+			parents[j].parent = j < count - 1 ? &parents[j + 1] : NULL;
+		}
+
+		/* Strings still point to the buffers in the tag that was copied */
+		tag->parent      = &parents[0];
+		tag->name.buffer = tag->_nameBuffer;
+		if (tag->type == NBT_STR) tag->value.str.text.buffer = tag->value.str.buffer;
+
+		if (count == 4) Cw_Callback_4(tag);
+		if (count == 5) Cw_Callback_5(tag);
+	}
+	Cw_FreeMetadata();
+}
+
+#define Cw_IsCPEMetadata(tag) (IsTag(tag, "CPE") && IsTag((tag)->parent, "Metadata"))
+static int Cw_Depth(struct NbtTag* tag) {
 	struct NbtTag* tmp = tag->parent;
 	int depth = 0;
 	while (tmp) { depth++; tmp = tmp->parent; }
+	return depth;
+}
+
+static void Cw_Callback(struct NbtTag* tag) {
+	int depth = Cw_Depth(tag);
 
 	switch (depth) {
 	case 1: Cw_Callback_1(tag); return;
 	case 2: Cw_Callback_2(tag); return;
-	case 4: Cw_Callback_4(tag); return;
-	case 5: Cw_Callback_5(tag); return;
+	case 4: 
+		if (Cw_IsCPEMetadata(tag->parent->parent)) Cw_DeferTag(tag, depth);
+		return;
+	case 5: 
+		if (Cw_IsCPEMetadata(tag->parent->parent->parent)) Cw_DeferTag(tag, depth);
+		return;
 	}
 	/* ClassicWorld -> Metadata -> CPE -> ExtName -> [values]
 	        0             1         2        3          4   */
 }
 
+/* Only the block arrays and arrays in block definitions are used */
+static cc_bool Cw_WantsArray(struct NbtTag* tag) {
+	switch (Cw_Depth(tag)) {
+	case 1: return IsTag(tag, "BlockArray") || IsTag(tag, "BlockArray2");
+	case 4: return Cw_IsCPEMetadata(tag->parent->parent);
+	case 5: return Cw_IsCPEMetadata(tag->parent->parent->parent);
+	}
+	return false;
+}
+
+/* Reads the root ClassicWorld tag and all its children from the given decompressed stream */
+static cc_result Cw_ReadTags(struct Stream* stream) {
+	struct NbtReader* reader;
+	cc_result res;
+
+	reader = (struct NbtReader*)Mem_TryAlloc(1, sizeof(struct NbtReader));
+	if (!reader) return ERR_OUT_OF_MEMORY;
+
+	reader->stream     = stream;
+	reader->cur        = reader->buffer;
+	reader->end        = reader->buffer;
+	reader->callback   = Cw_Callback;
+	reader->wantsArray = Cw_WantsArray;
+
+	if (!(res = Nbt_Fill(reader, 1))) {
+		if (*reader->cur++ != NBT_DICT) {
+			res = CW_ERR_ROOT_TAG;
+		} else {
+			res = Nbt_ReadTag(NBT_DICT, true, reader, NULL);
+		}
+	}
+
+	Mem_Free(reader);
+	return res;
+}
+
 cc_result Cw_Load(struct Stream* stream) {
 	struct Stream compStream;
 	struct InflateState state;
 	cc_result res;
-	cc_uint8 tag;
 
 	Inflate_MakeStream2(&compStream, &state, stream);
 	if ((res = Map_SkipGZipHeader(stream))) return res;
-	if ((res = compStream.ReadU8(&compStream, &tag))) return res;
-
-	if (tag != NBT_DICT) return CW_ERR_ROOT_TAG;
-	return Nbt_ReadTag(NBT_DICT, true, &compStream, NULL, Cw_Callback);
+	return Cw_ReadTags(&compStream);
 }
 
 
@@ -1185,25 +1512,30 @@ static void UseClassic013Env(void) {
 	Env.FogCol       = PackedCol_Make(0x7F, 0xCC, 0xFF, 0xFF);
 }
 
-static cc_result Dat_LoadFormat0(struct Stream* stream) {
+static void UsePreclassicEnv(void) {
 	UseClassic013Env();
 	/* Similiar env to how it appears in preclassic client */
 	Env.EdgeBlock  = BLOCK_AIR;
 	Env.SidesBlock = BLOCK_AIR;
+}
+
+static cc_result Dat_LoadFormat0(struct Stream* stream) {
+	struct MapImportState* m = &map_import;
+	Map_Defer(UsePreclassicEnv);
 
 	/* Map 'format' is just the 256x64x256 blocks of the level */
-	World.Width  = 256;
-	World.Height =  64;
-	World.Length = 256;
+	m->width  = 256;
+	m->height =  64;
+	m->length = 256;
 
 	#define PC_VOLUME (256 * 64 * 256)
-	World.Volume = PC_VOLUME;
-	World.Blocks = (BlockRaw*)Mem_TryAlloc(PC_VOLUME, 1);
-	if (!World.Blocks) return ERR_OUT_OF_MEMORY;
+	m->volume = PC_VOLUME;
+	m->blocks = (BlockRaw*)Mem_TryAlloc(PC_VOLUME, 1);
+	if (!m->blocks) return ERR_OUT_OF_MEMORY;
 
 	/* First 5 bytes already read earlier as .dat header */
-	Mem_Set(World.Blocks, BLOCK_STONE, 5);
-	return Stream_Read(stream, World.Blocks + 5, PC_VOLUME - 5);
+	Mem_Set(m->blocks, BLOCK_STONE, 5);
+	return Stream_Read(stream, m->blocks + 5, PC_VOLUME - 5);
 }
 
 static cc_result Dat_LoadFormat1(struct Stream* stream) {
@@ -1212,20 +1544,20 @@ static cc_result Dat_LoadFormat1(struct Stream* stream) {
 	cc_uint8 header[8 + 2 + 2 + 2];
 	cc_result res;
 
-	UseClassic013Env();
+	Map_Defer(UseClassic013Env);
 	if ((res = Java_ReadString(stream,   level_name))) return res;
 	if ((res = Java_ReadString(stream, level_author))) return res;
 	if ((res = Stream_Read(stream, header, sizeof(header)))) return res;
 	
 	/* bytes 0-8 = created timestamp (currentTimeMillis) */
-	World.Width  = Stream_GetU16_BE(header +  8);
-	World.Length = Stream_GetU16_BE(header + 10);
-	World.Height = Stream_GetU16_BE(header + 12);
+	map_import.width  = Stream_GetU16_BE(header +  8);
+	map_import.length = Stream_GetU16_BE(header + 10);
+	map_import.height = Stream_GetU16_BE(header + 12);
 	return Map_ReadBlocks(stream);
 }
 
 static cc_result Dat_LoadFormat2(struct Stream* stream) {
-	struct LocalPlayer* p = &LocalPlayer_Instance;
+	struct MapImportState* m = &map_import;
 	struct JClassDesc classes[CLASS_CAPACITY];
 	cc_uint8 header[2 + 2];
 	struct JUnion obj;
@@ -1255,21 +1587,21 @@ static cc_result Dat_LoadFormat2(struct Stream* stream) {
 		fieldName = String_FromRaw((char*)field->FieldName, JNAME_SIZE);
 
 		if (String_CaselessEqualsConst(&fieldName, "width")) {
-			World.Width  = Java_I32(field);
+			m->width  = Java_I32(field);
 		} else if (String_CaselessEqualsConst(&fieldName, "height")) {
-			World.Length = Java_I32(field);
+			m->length = Java_I32(field);
 		} else if (String_CaselessEqualsConst(&fieldName, "depth")) {
-			World.Height = Java_I32(field);
+			m->height = Java_I32(field);
 		} else if (String_CaselessEqualsConst(&fieldName, "blocks")) {
 			if (field->Type != JFIELD_ARRAY) Logger_Abort("Blocks field must be Array");
-			World.Blocks = field->Value.Array.Ptr;
-			World.Volume = field->Value.Array.Size;
+			m->blocks = field->Value.Array.Ptr;
+			m->volume = field->Value.Array.Size;
 		} else if (String_CaselessEqualsConst(&fieldName, "xSpawn")) {
-			p->Spawn.X = (float)Java_I32(field);
+			m->spawn.X = (float)Java_I32(field);
 		} else if (String_CaselessEqualsConst(&fieldName, "ySpawn")) {
-			p->Spawn.Y = (float)Java_I32(field);
+			m->spawn.Y = (float)Java_I32(field);
 		} else if (String_CaselessEqualsConst(&fieldName, "zSpawn")) {
-			p->Spawn.Z = (float)Java_I32(field);
+			m->spawn.Z = (float)Java_I32(field);
 		}
 	}
 	return 0;
@@ -1311,6 +1643,194 @@ cc_result Dat_Load(struct Stream* stream) {
 }
 
 
+/*########################################################################################################################*
+*--------------------------------------------------------Map export-------------------------------------------------------*
+*#########################################################################################################################*/
+enum MapSaveRef { MAP_REF_BLOCKS, MAP_REF_BLOCKS2, MAP_REF_ZEROS };
+#define MAP_MAX_SAVE_REFS 4
+
+/* Exporters are run on the main thread, but only record the data they write (with the world's blocks */
+/*  recorded as a reference to a snapshot of them), which a background thread then writes to the file */
+static struct MapSaveState {
+	cc_bool busy;
+	volatile cc_bool done;
+	cc_result res;
+	const char* action; /* What was being done when an error occurred */
+	struct Stream file;
+	int volume;
+
+	cc_uint8* data; /* Data written by the exporter */
+	cc_uint32 len, capacity;
+	struct MapSaveRef_ { cc_uint32 offset; int type; } refs[MAP_MAX_SAVE_REFS];
+	int numRefs;
+
+	void* thread;
+	cc_string path;
+	char _pathBuffer[FILENAME_SIZE];
+} map_save;
+
+static cc_result MapSave_Record(struct Stream* s, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	cc_uint32 capacity;
+	cc_uint8* buffer;
+
+	if (map_save.len + count > map_save.capacity) {
+		capacity = map_save.len + count + 4096;
+		buffer   = (cc_uint8*)Mem_TryRealloc(map_save.data, capacity, 1);
+		if (!buffer) return ERR_OUT_OF_MEMORY;
+
+		map_save.data     = buffer;
+		map_save.capacity = capacity;
+	}
+
+	Mem_Copy(map_save.data + map_save.len, data, count);
+	map_save.len += count;
+	*modified     = count;
+	return 0;
+}
+
+static cc_result MapSave_RecordRef(int type) {
+	if (map_save.numRefs == MAP_MAX_SAVE_REFS) return ERR_NOT_SUPPORTED;
+
+	map_save.refs[map_save.numRefs].offset = map_save.len;
+	map_save.refs[map_save.numRefs].type   = type;
+	map_save.numRefs++;
+	return 0;
+}
+
+/* Writes the lower 8 bits (or upper 8 bits if upper) of the world's blocks */
+static cc_result Map_WriteBlocks(struct Stream* stream, cc_bool upper) {
+	if (stream->Write == MapSave_Record) return MapSave_RecordRef(upper ? MAP_REF_BLOCKS2 : MAP_REF_BLOCKS);
+#ifdef EXTENDED_BLOCKS
+	if (upper) return Stream_Write(stream, World.Blocks2, World.Volume);
+#endif
+	return Stream_Write(stream, World.Blocks, World.Volume);
+}
+
+static cc_result Map_WriteZerosTo(struct Stream* stream, int count) {
+	cc_uint8 chunk[8192] = { 0 };
+	cc_result res;
+	int i, len;
+
+	for (i = 0; i < count; i += sizeof(chunk)) {
+		len = min(count - i, (int)sizeof(chunk));
+		if ((res = Stream_Write(stream, chunk, len))) return res;
+	}
+	return 0;
+}
+
+/* Writes one 0 byte for each block in the world */
+static cc_result Map_WriteZeros(struct Stream* stream) {
+	if (stream->Write == MapSave_Record) return MapSave_RecordRef(MAP_REF_ZEROS);
+	return Map_WriteZerosTo(stream, World.Volume);
+}
+
+static cc_result MapSave_WriteRef(struct Stream* stream, int type) {
+	if (type == MAP_REF_BLOCKS)  return WorldSnapshot_Write(stream, false);
+	if (type == MAP_REF_BLOCKS2) return WorldSnapshot_Write(stream, true);
+	return Map_WriteZerosTo(stream, map_save.volume);
+}
+
+static void Map_SaveThread(void) {
+	struct Stream compStream;
+	struct GZipState state;
+	cc_uint32 beg = 0, end;
+	cc_result res = 0;
+	int i;
+
+	GZip_MakeParallelStream(&compStream, &state, &map_save.file);
+	for (i = 0; i <= map_save.numRefs && !res; i++) {
+		end = i < map_save.numRefs ? map_save.refs[i].offset : map_save.len;
+		res = Stream_Write(&compStream, map_save.data + beg, end - beg);
+		beg = end;
+
+		if (!res && i < map_save.numRefs) res = MapSave_WriteRef(&compStream, map_save.refs[i].type);
+	}
+
+	if (res) {
+		/* Still need to close to free the compressor threads */
+		compStream.Close(&compStream);
+		map_save.file.Close(&map_save.file);
+		map_save.action = "encoding";
+	} else if ((res = compStream.Close(&compStream))) {
+		map_save.file.Close(&map_save.file);
+		map_save.action = "closing";
+	} else {
+		res = map_save.file.Close(&map_save.file);
+		map_save.action = "closing";
+	}
+
+	map_save.res  = res;
+	map_save.done = true;
+}
+
+static void Map_FreeSave(void) {
+	WorldSnapshot_End();
+	Mem_Free(map_save.data);
+
+	map_save.data     = NULL;
+	map_save.len      = 0;
+	map_save.capacity = 0;
+	map_save.numRefs  = 0;
+	map_save.busy     = false;
+}
+
+void Map_FinishSave(void) {
+	cc_result res;
+	if (!map_save.busy) return;
+
+	Thread_Join(map_save.thread);
+	map_save.thread = NULL;
+	map_save.done   = false;
+	Map_FreeSave();
+
+	res = map_save.res;
+	if (res) {
+		Logger_SysWarn2(res, map_save.action, &map_save.path);
+	} else {
+		Chat_Add1("&eSaved map to: %s", &map_save.path);
+	}
+}
+
+static void Map_CheckSave(struct ScheduledTask* task) {
+	if (map_save.done) Map_FinishSave();
+}
+
+static void Ccr_FinishSave(void);
+cc_result Map_SaveTo(const cc_string* path, IMapExporter exporter) {
+	struct Stream stream;
+	cc_result res;
+	/* Only one map can be saved at a time */
+	Map_FinishSave();
+	Ccr_FinishSave();
+
+	/* Taken before creating the file, so an existing file isn't emptied when there's no map to save */
+	/*  (ERR_NOT_SUPPORTED when no map is loaded, ERR_OUT_OF_MEMORY when it can't be snapshotted) */
+	res = WorldSnapshot_Begin();
+	if (res) { Logger_SysWarn2(res, "snapshotting", path); return res; }
+
+	res = Stream_CreateFile(&map_save.file, path);
+	if (res) { WorldSnapshot_End(); Logger_SysWarn2(res, "creating", path); return res; }
+
+	Stream_Init(&stream);
+	stream.Write = MapSave_Record;
+	res = exporter(&stream);
+
+	map_save.busy = true;
+	if (res) {
+		Map_FreeSave();
+		map_save.file.Close(&map_save.file);
+		Logger_SysWarn2(res, "encoding", path); return res;
+	}
+
+	String_InitArray(map_save.path, map_save._pathBuffer);
+	String_AppendString(&map_save.path, path);
+	map_save.volume = World.Volume;
+	map_save.done   = false;
+	map_save.thread = Thread_Start(Map_SaveThread);
+	return 0;
+}
+
+
 /*########################################################################################################################*
 *--------------------------------------------------ClassicWorld export----------------------------------------------------*
 *#########################################################################################################################*/
@@ -1399,12 +1919,11 @@ static cc_result Cw_WriteBockDef(struct Stream* stream, int b) {
 	return Stream_Write(stream, buffer, (int)(cur - buffer));
 }
 
-cc_result Cw_Save(struct Stream* stream) {
-	cc_uint8 buffer[2048];
+/* Writes the root tag, along with the world's dimensions, UUID and spawn */
+static cc_result Cw_WriteHeader(struct Stream* stream) {
+	cc_uint8 buffer[256];
 	cc_uint8* cur;
 	struct LocalPlayer* p = &LocalPlayer_Instance;
-	cc_result res;
-	int b;
 
 	cur = buffer;
 	cur = Nbt_WriteDict(cur,   "ClassicWorld");
@@ -1423,20 +1942,16 @@ cc_result Cw_Save(struct Stream* stream) {
 		cur  = Nbt_WriteUInt8(cur,  "H", Math_Deg2Packed(p->SpawnYaw));
 		cur  = Nbt_WriteUInt8(cur,  "P", Math_Deg2Packed(p->SpawnPitch));
 	} *cur++ = NBT_END;
-	cur = Nbt_WriteArray(cur, "BlockArray", World.Volume);
-
-	if ((res = Stream_Write(stream, buffer, (int)(cur - buffer)))) return res;
-	if ((res = Stream_Write(stream, World.Blocks, World.Volume)))  return res;
 
-#ifdef EXTENDED_BLOCKS
-	if (World.Blocks != World.Blocks2) {
-		cur = buffer;
-		cur = Nbt_WriteArray(cur, "BlockArray2", World.Volume);
+	return Stream_Write(stream, buffer, (int)(cur - buffer));
+}
 
-		if ((res = Stream_Write(stream, buffer, (int)(cur - buffer)))) return res;
-		if ((res = Stream_Write(stream, World.Blocks2, World.Volume))) return res;
-	}
-#endif
+/* Writes the environment and block definitions, then ends the root tag */
+static cc_result Cw_WriteMetadata(struct Stream* stream) {
+	cc_uint8 buffer[2048];
+	cc_uint8* cur;
+	cc_result res;
+	int b;
 
 	cur = buffer;
 	cur = Nbt_WriteDict(cur, "Metadata");
@@ -1500,6 +2015,30 @@ cc_result Cw_Save(struct Stream* stream) {
 	return Stream_Write(stream, cw_end, sizeof(cw_end));
 }
 
+cc_result Cw_Save(struct Stream* stream) {
+	cc_uint8 buffer[64];
+	cc_uint8* cur;
+	cc_result res;
+
+	if ((res = Cw_WriteHeader(stream))) return res;
+	cur = buffer;
+	cur = Nbt_WriteArray(cur, "BlockArray", World.Volume);
+
+	if ((res = Stream_Write(stream, buffer, (int)(cur - buffer)))) return res;
+	if ((res = Map_WriteBlocks(stream, false)))                    return res;
+
+#ifdef EXTENDED_BLOCKS
+	if (World.Blocks != World.Blocks2) {
+		cur = buffer;
+		cur = Nbt_WriteArray(cur, "BlockArray2", World.Volume);
+
+		if ((res = Stream_Write(stream, buffer, (int)(cur - buffer)))) return res;
+		if ((res = Map_WriteBlocks(stream, true)))                     return res;
+	}
+#endif
+	return Cw_WriteMetadata(stream);
+}
+
 
 /*########################################################################################################################*
 *---------------------------------------------------Schematic export------------------------------------------------------*
@@ -1523,9 +2062,8 @@ NBT_END,
 };
 
 cc_result Schematic_Save(struct Stream* stream) {
-	cc_uint8 tmp[256], chunk[8192] = { 0 };
+	cc_uint8 tmp[256];
 	cc_result res;
-	int i;
 
 	Mem_Copy(tmp, sc_begin, sizeof(sc_begin));
 	{
@@ -1535,17 +2073,1127 @@ cc_result Schematic_Save(struct Stream* stream) {
 		Stream_SetU32_BE(&tmp[74], World.Volume);
 	}
 	if ((res = Stream_Write(stream, tmp, sizeof(sc_begin)))) return res;
-	if ((res = Stream_Write(stream, World.Blocks, World.Volume))) return res;
+	if ((res = Map_WriteBlocks(stream, false)))              return res;
 
 	Mem_Copy(tmp, sc_data, sizeof(sc_data));
 	{
 		Stream_SetU32_BE(&tmp[7], World.Volume);
 	}
 	if ((res = Stream_Write(stream, tmp, sizeof(sc_data)))) return res;
+	if ((res = Map_WriteZeros(stream)))                     return res;
+	return Stream_Write(stream, sc_end, sizeof(sc_end));
+}
+
 
-	for (i = 0; i < World.Volume; i += sizeof(chunk)) {
-		int count = World.Volume - i; count = min(count, sizeof(chunk));
-		if ((res = Stream_Write(stream, chunk, count))) return res;
+/*########################################################################################################################*
+*-----------------------------------------------ClassiCube region format--------------------------------------------------*
+*#########################################################################################################################*/
+/* ClassiCube region is a map format where the world is split into cubic regions that are compressed independently, */
+/*  so regions can be decompressed in parallel, only modified regions need to be compressed again when saving, */
+/*  and only some regions of a huge world can be loaded. All integers are little endian.
+	U8[4] "Identifier" ('C','C','R','M')
+	U8    "Version" (2)
+	U8    "Region shift" (4 for 16x16x16 regions, 5 for 32x32x32 regions)
+	U8    "Flags" (CCR_FLAG_UPPER if regions also store the upper 8 bits of blocks)
+	U8    "Reserved"
+	U16   "Width", "Height", "Length"
+	U32   "Metadata size", "Metadata capacity"
+	U8*   "Metadata" (DEFLATE compressed NBT, same as .cw file but without the block arrays)
+	      (padded to capacity, so that it can be rewritten in place if it changes)
+	INDEX "Regions" (for each region, in YZX order) {
+		U32 "Size"  (of the region's compressed data, or 0 if all blocks in the region are the same)
+		U32 "Value" (offset of compressed data from end of index, or the block if Size is 0)
 	}
-	return Stream_Write(stream, sc_end, sizeof(sc_end));
+	U8*   "Region data" (for each region, DEFLATE compressed blocks in YZX order, clipped to world bounds)
+	                    (lower 8 bits of blocks, then upper 8 bits of blocks if CCR_FLAG_UPPER)
+	                    (regions may be in any order, and there may be unused data between regions)
+*/
+/* NOTE: Version 1 files have no metadata capacity, so are rejected rather than misread */
+#define CCR_VERSION    2
+#define CCR_FLAG_UPPER 0x01
+#define CCR_HEADER_SIZE 22
+#define CCR_ENTRY_SIZE  8
+/* 32x32x32 regions compress better than 16x16x16 regions */
+#define CCR_SAVE_SHIFT  5
+#define CCR_MAX_SHIFT   5
+#define CCR_MAX_REGION_VOLUME (1 << (CCR_MAX_SHIFT * 3))
+#define CCR_MAX_THREADS 16
+/* Compressed region data is read in batches of around this size, which are then decompressed in parallel */
+#define CCR_BATCH_SIZE (4 * 1024 * 1024)
+static const cc_uint8 ccr_identifier[4] = { 'C','C','R','M' };
+
+struct CcrLayout { int width, height, length, shift, regionsX, regionsY, regionsZ, numRegions; };
+struct CcrRegion { cc_uint8* data; cc_uint32 size, value, offset; };
+
+static void Ccr_InitLayout(struct CcrLayout* l, int width, int height, int length, int shift) {
+	int size = 1 << shift;
+	l->width  = width; l->height = height; l->length = length;
+	l->shift  = shift;
+
+	l->regionsX   = (width  + size - 1) >> shift;
+	l->regionsY   = (height + size - 1) >> shift;
+	l->regionsZ   = (length + size - 1) >> shift;
+	l->numRegions = l->regionsX * l->regionsY * l->regionsZ;
+}
+
+/* Calculates the blocks covered by the given region, clipped to the world's bounds */
+static void Ccr_GetBounds(struct CcrLayout* l, int i, IVec3* beg, IVec3* end) {
+	int size = 1 << l->shift;
+	beg->X = (i % l->regionsX) << l->shift;
+	beg->Z = ((i / l->regionsX) % l->regionsZ) << l->shift;
+	beg->Y = (i / (l->regionsX * l->regionsZ)) << l->shift;
+
+	end->X = min(beg->X + size, l->width);
+	end->Y = min(beg->Y + size, l->height);
+	end->Z = min(beg->Z + size, l->length);
+}
+
+static int Ccr_GetVolume(struct CcrLayout* l, int i) {
+	IVec3 beg, end;
+	Ccr_GetBounds(l, i, &beg, &end);
+	return (end.X - beg.X) * (end.Y - beg.Y) * (end.Z - beg.Z);
 }
+
+/* Copies the given region's blocks to the world's blocks */
+static void Ccr_CopyRegion(struct CcrLayout* l, int i, BlockRaw* blocks, BlockRaw* region) {
+	IVec3 beg, end;
+	int x, y, z, index;
+	Ccr_GetBounds(l, i, &beg, &end);
+	x = end.X - beg.X;
+
+	for (y = beg.Y; y < end.Y; y++) {
+		for (z = beg.Z; z < end.Z; z++, region += x) {
+			index = (y * l->length + z) * l->width + beg.X;
+			Mem_Copy(blocks + index, region, x);
+		}
+	}
+}
+
+/* Sets every block in the given region to the given value */
+static void Ccr_FillRegion(struct CcrLayout* l, int i, BlockRaw* blocks, BlockRaw value) {
+	IVec3 beg, end;
+	int y, z;
+	Ccr_GetBounds(l, i, &beg, &end);
+
+	for (y = beg.Y; y < end.Y; y++) {
+		for (z = beg.Z; z < end.Z; z++) {
+			Mem_Set(blocks + (y * l->length + z) * l->width + beg.X, value, end.X - beg.X);
+		}
+	}
+}
+
+static cc_bool Ccr_IsUniform(const BlockRaw* blocks, int count) {
+	int i;
+	for (i = 1; i < count; i++) {
+		if (blocks[i] != blocks[0]) return false;
+	}
+	return true;
+}
+
+static cc_result Ccr_WriteOutput(struct Stream* s, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	cc_uint32 used = s->Meta.Mem.Length - s->Meta.Mem.Left;
+	cc_uint8* base;
+
+	if (count > s->Meta.Mem.Left) {
+		base = (cc_uint8*)Mem_TryRealloc(s->Meta.Mem.Base, used + count + 4096, 1);
+		if (!base) return ERR_OUT_OF_MEMORY;
+
+		s->Meta.Mem.Base   = base;
+		s->Meta.Mem.Cur    = base + used;
+		s->Meta.Mem.Length = used + count + 4096;
+		s->Meta.Mem.Left   = s->Meta.Mem.Length - used;
+	}
+
+	Mem_Copy(s->Meta.Mem.Cur, data, count);
+	s->Meta.Mem.Cur  += count;
+	s->Meta.Mem.Left -= count;
+	*modified = count;
+	return 0;
+}
+
+/* Initialises a stream that writes to a growable memory buffer */
+static void Ccr_MakeOutput(struct Stream* s) {
+	Stream_Init(s);
+	s->Write = Ccr_WriteOutput;
+	s->Meta.Mem.Base   = NULL;
+	s->Meta.Mem.Cur    = NULL;
+	s->Meta.Mem.Left   = 0;
+	s->Meta.Mem.Length = 0;
+}
+
+
+/*########################################################################################################################*
+*------------------------------------------------ClassiCube region workers------------------------------------------------*
+*#########################################################################################################################*/
+struct CcrWorker {
+	union {
+		struct DeflateState deflate;
+		struct InflateState inflate;
+	} state;
+	BlockRaw blocks[CCR_MAX_REGION_VOLUME * 2]; /* Lower 8 bits, then upper 8 bits */
+};
+
+/* Regions are compressed/decompressed by the calling thread and other threads, */
+/*  with each thread repeatedly taking the next unprocessed job until there are none left */
+typedef cc_result (*Ccr_JobFunc)(struct CcrWorker* w, int job);
+static struct CcrWork {
+	Ccr_JobFunc func;
+	void* mutex;
+	int next, count, numStarted, numWorkers;
+	cc_result res;
+	struct CcrWorker* workers[CCR_MAX_THREADS];
+} ccr_work;
+
+static void Ccr_RunWorker(struct CcrWorker* w) {
+	cc_result res;
+	int job;
+
+	for (;;) {
+		Mutex_Lock(ccr_work.mutex);
+		{
+			/* Stop early if another job failed */
+			job = ccr_work.res ? ccr_work.count : ccr_work.next++;
+		}
+		Mutex_Unlock(ccr_work.mutex);
+		if (job >= ccr_work.count) return;
+
+		res = ccr_work.func(w, job);
+		if (!res) continue;
+
+		Mutex_Lock(ccr_work.mutex);
+		{
+			if (!ccr_work.res) ccr_work.res = res;
+		}
+		Mutex_Unlock(ccr_work.mutex);
+	}
+}
+
+static void Ccr_WorkerThread(void) {
+	int worker;
+	Mutex_Lock(ccr_work.mutex);
+	{
+		worker = ccr_work.numStarted++;
+	}
+	Mutex_Unlock(ccr_work.mutex);
+	Ccr_RunWorker(ccr_work.workers[worker]);
+}
+
+static cc_result Ccr_BeginWork(void) {
+	int i, numWorkers = min(Thread_ProcessorCount(), CCR_MAX_THREADS);
+	ccr_work.numWorkers = 0;
+
+	for (i = 0; i < numWorkers; i++) {
+		ccr_work.workers[i] = (struct CcrWorker*)Mem_TryAlloc(1, sizeof(struct CcrWorker));
+		if (!ccr_work.workers[i]) break;
+		ccr_work.numWorkers++;
+	}
+
+	if (!ccr_work.numWorkers) return ERR_OUT_OF_MEMORY;
+	if (!ccr_work.mutex) ccr_work.mutex = Mutex_Create();
+	return 0;
+}
+
+static void Ccr_EndWork(void) {
+	int i;
+	for (i = 0; i < ccr_work.numWorkers; i++) {
+		Mem_Free(ccr_work.workers[i]);
+		ccr_work.workers[i] = NULL;
+	}
+	ccr_work.numWorkers = 0;
+}
+
+/* Calls func for every job from 0 to count, across all the workers */
+static cc_result Ccr_RunJobs(Ccr_JobFunc func, int count) {
+	void* threads[CCR_MAX_THREADS];
+	int i, numThreads = min(ccr_work.numWorkers, count) - 1;
+
+	ccr_work.func       = func;
+	ccr_work.next       = 0;
+	ccr_work.count      = count;
+	ccr_work.numStarted = 1; /* Calling thread uses first worker */
+	ccr_work.res        = 0;
+
+	for (i = 0; i < numThreads; i++) {
+		threads[i] = Thread_Start(Ccr_WorkerThread);
+	}
+	Ccr_RunWorker(ccr_work.workers[0]);
+
+	for (i = 0; i < numThreads; i++) {
+		Thread_Join(threads[i]);
+	}
+	return ccr_work.res;
+}
+
+
+/*########################################################################################################################*
+*-----------------------------------------------ClassiCube region import--------------------------------------------------*
+*#########################################################################################################################*/
+static struct CcrLoadState {
+	struct CcrLayout layout;
+	cc_bool upper;
+	struct CcrRegion* entries; /* Regions to load, sorted by offset (value is region index) */
+	int firstJob;              /* Entry of first region in the current batch */
+	cc_bool bounded;
+	IVec3 min, max;
+} ccr_load;
+
+void Ccr_SetLoadBounds(int minX, int minY, int minZ, int maxX, int maxY, int maxZ) {
+	ccr_load.bounded = true;
+	ccr_load.min.X = minX; ccr_load.min.Y = minY; ccr_load.min.Z = minZ;
+	ccr_load.max.X = maxX; ccr_load.max.Y = maxY; ccr_load.max.Z = maxZ;
+}
+
+void Ccr_ResetLoadBounds(void) { ccr_load.bounded = false; }
+
+static cc_bool Ccr_InLoadBounds(int i) {
+	IVec3 beg, end;
+	if (!ccr_load.bounded) return true;
+	Ccr_GetBounds(&ccr_load.layout, i, &beg, &end);
+
+	return beg.X <= ccr_load.max.X && end.X > ccr_load.min.X
+		&& beg.Y <= ccr_load.max.Y && end.Y > ccr_load.min.Y
+		&& beg.Z <= ccr_load.max.Z && end.Z > ccr_load.min.Z;
+}
+
+static cc_result Ccr_DecompressRegion(struct CcrWorker* w, int job) {
+	struct CcrRegion* r = &ccr_load.entries[ccr_load.firstJob + job];
+	struct CcrLayout* l = &ccr_load.layout;
+	struct Stream src, compStream;
+	int volume = Ccr_GetVolume(l, r->value);
+	cc_result res;
+
+	Stream_ReadonlyMemory(&src, r->data, r->size);
+	Inflate_MakeStream2(&compStream, &w->state.inflate, &src);
+
+	res = Stream_Read(&compStream, w->blocks, ccr_load.upper ? volume * 2 : volume);
+	if (res) return res;
+
+	Ccr_CopyRegion(l, r->value, map_import.blocks, w->blocks);
+#ifdef EXTENDED_BLOCKS
+	if (map_import.blocks2) Ccr_CopyRegion(l, r->value, map_import.blocks2, w->blocks + volume);
+#endif
+	return 0;
+}
+
+static cc_result Ccr_ReadMetadata(struct Stream* stream, cc_uint32 size) {
+	struct InflateState* state;
+	struct Stream src, compStream;
+	cc_uint8* data;
+	cc_result res;
+
+	data  = (cc_uint8*)Mem_TryAlloc(size, 1);
+	state = (struct InflateState*)Mem_TryAlloc(1, sizeof(struct InflateState));
+
+	if (!data || !state) {
+		res = ERR_OUT_OF_MEMORY;
+	} else if (!(res = Stream_Read(stream, data, size))) {
+		Stream_ReadonlyMemory(&src, data, size);
+		Inflate_MakeStream2(&compStream, state, &src);
+		res = Cw_ReadTags(&compStream);
+	}
+
+	Mem_Free(data);
+	Mem_Free(state);
+	return res;
+}
+
+static void Ccr_QuickSort(int left, int right) {
+	struct CcrRegion* keys = ccr_load.entries; struct CcrRegion key;
+
+	while (left < right) {
+		int i = left, j = right;
+		cc_uint32 pivot = keys[(i + j) >> 1].offset;
+
+		/* partition the list */
+		while (i <= j) {
+			while (pivot > keys[i].offset) i++;
+			while (pivot < keys[j].offset) j--;
+			QuickSort_Swap_Maybe();
+		}
+		/* recurse into the smaller subset */
+		QuickSort_Recurse(Ccr_QuickSort)
+	}
+}
+
+/* Fills in uniform regions, and works out which regions need to be read and decompressed */
+static int Ccr_ReadIndex(cc_uint8* index) {
+	struct CcrLayout* l = &ccr_load.layout;
+	cc_uint32 size, value;
+	int i, count = 0;
+
+	for (i = 0; i < l->numRegions; i++) {
+		size  = Stream_GetU32_LE(index + i * CCR_ENTRY_SIZE);
+		value = Stream_GetU32_LE(index + i * CCR_ENTRY_SIZE + 4);
+		if (!Ccr_InLoadBounds(i)) continue;
+
+		if (!size) {
+			Ccr_FillRegion(l, i, map_import.blocks, (BlockRaw)value);
+#ifdef EXTENDED_BLOCKS
+			if (map_import.blocks2) Ccr_FillRegion(l, i, map_import.blocks2, (BlockRaw)(value >> 8));
+#endif
+		} else {
+			ccr_load.entries[count].size   = size;
+			ccr_load.entries[count].offset = value;
+			ccr_load.entries[count].value  = i;
+			count++;
+		}
+	}
+
+	/* Region data is read in the order it is stored in */
+	if (count) Ccr_QuickSort(0, count - 1);
+	return count;
+}
+
+static cc_result Ccr_ReadRegions(struct Stream* stream, int count) {
+	struct CcrRegion* r;
+	cc_uint8* batch   = NULL;
+	cc_uint32 used    = 0, capacity = 0, offset = 0;
+	int i, numJobs    = 0;
+	cc_result res     = 0;
+	ccr_load.firstJob = 0;
+
+	for (i = 0; i < count; i++) {
+		r = &ccr_load.entries[i];
+		/* Skip over data of regions that aren't loaded or have since been replaced */
+		if (r->offset < offset) { res = CCR_ERR_REGION; break; }
+		if (r->offset > offset && (res = stream->Skip(stream, r->offset - offset))) break;
+		offset = r->offset + r->size;
+
+		/* Decompress all regions read so far, when batch can't hold any more data */
+		if (used + r->size > capacity && numJobs) {
+			res  = Ccr_RunJobs(Ccr_DecompressRegion, numJobs);
+			used = 0; numJobs = 0;
+			ccr_load.firstJob = i;
+			if (res) break;
+		}
+
+		if (r->size > capacity) {
+			capacity = max(r->size, CCR_BATCH_SIZE);
+			Mem_Free(batch);
+			batch = (cc_uint8*)Mem_TryAlloc(capacity, 1);
+			if (!batch) { res = ERR_OUT_OF_MEMORY; break; }
+		}
+
+		if ((res = Stream_Read(stream, batch + used, r->size))) break;
+		r->data = batch + used;
+		used   += r->size;
+		numJobs++;
+	}
+
+	if (!res && numJobs) res = Ccr_RunJobs(Ccr_DecompressRegion, numJobs);
+	Mem_Free(batch);
+	return res;
+}
+
+cc_result Ccr_Load(struct Stream* stream) {
+	struct MapImportState* m = &map_import;
+	struct CcrLayout* l = &ccr_load.layout;
+	cc_uint8 header[CCR_HEADER_SIZE];
+	cc_uint8* index;
+	cc_uint32 metaSize, metaCapacity;
+	cc_result res;
+	int shift, count;
+
+	if ((res = Stream_Read(stream, header, CCR_HEADER_SIZE))) return res;
+	if (!Mem_Equal(header, ccr_identifier, sizeof(ccr_identifier))) return CCR_ERR_IDENTIFIER;
+	if (header[4] != CCR_VERSION) return CCR_ERR_VERSION;
+
+	shift = header[5];
+	if (shift < 4 || shift > CCR_MAX_SHIFT) return CCR_ERR_REGION;
+	ccr_load.upper = header[6] & CCR_FLAG_UPPER;
+	metaSize     = Stream_GetU32_LE(&header[14]);
+	metaCapacity = Stream_GetU32_LE(&header[18]);
+	if (metaSize > metaCapacity) return CCR_ERR_REGION;
+
+	/* Metadata also contains the world's dimensions, but those in the header take priority */
+	if ((res = Ccr_ReadMetadata(stream, metaSize)))            return res;
+	if ((res = stream->Skip(stream, metaCapacity - metaSize))) return res;
+	m->width  = Stream_GetU16_LE(&header[8]);
+	m->height = Stream_GetU16_LE(&header[10]);
+	m->length = Stream_GetU16_LE(&header[12]);
+
+	if ((cc_uint64)m->width * m->height * m->length > Int32_MaxValue) return ERR_OUT_OF_MEMORY;
+	m->volume = m->width * m->height * m->length;
+	Ccr_InitLayout(l, m->width, m->height, m->length, shift);
+
+	/* Cleared, because regions outside the load bounds aren't read */
+	m->blocks = (BlockRaw*)Mem_TryAllocCleared(m->volume, 1);
+	if (!m->blocks) return ERR_OUT_OF_MEMORY;
+#ifdef EXTENDED_BLOCKS
+	if (ccr_load.upper) {
+		m->blocks2 = (BlockRaw*)Mem_TryAllocCleared(m->volume, 1);
+		if (!m->blocks2) return ERR_OUT_OF_MEMORY;
+	}
+#endif
+
+	index            = (cc_uint8*)Mem_TryAlloc(l->numRegions, CCR_ENTRY_SIZE);
+	ccr_load.entries = (struct CcrRegion*)Mem_TryAlloc(l->numRegions, sizeof(struct CcrRegion));
+
+	if (!index || !ccr_load.entries) {
+		res = ERR_OUT_OF_MEMORY;
+	} else if (!(res = Stream_Read(stream, index, l->numRegions * CCR_ENTRY_SIZE))) {
+		count = Ccr_ReadIndex(index);
+		if (!(res = Ccr_BeginWork())) res = Ccr_ReadRegions(stream, count);
+		Ccr_EndWork();
+	}
+
+	Mem_Free(index);
+	Mem_Free(ccr_load.entries);
+	ccr_load.entries = NULL;
+	return res;
+}
+
+
+/*########################################################################################################################*
+*-----------------------------------------------ClassiCube region export--------------------------------------------------*
+*#########################################################################################################################*/
+/* Compressed regions from the last save, so that later saves only need to compress modified regions */
+static struct CcrCache {
+	struct CcrLayout layout;
+	struct CcrRegion* regions; /* offset is where region's data is in the autosave file */
+	cc_uint8* dirty;
+	int* jobs; /* Indices of regions compressed by the last save */
+	int numJobs;
+	BlockRaw* blocks;
+	cc_bool upper;
+} ccr_cache;
+
+/* State of the autosave file */
+static struct CcrDiskState {
+	cc_bool valid;    /* Whether file contains the cached regions, apart from those marked as modified */
+	cc_bool changed;  /* Whether any blocks have been modified since the last autosave */
+	cc_uint32 metaCapacity;
+	cc_uint32 dataSize; /* Size of all region data in the file, including data of replaced regions */
+} ccr_disk;
+
+void Ccr_MarkDirty(int x, int y, int z) {
+	struct CcrLayout* l = &ccr_cache.layout;
+	ccr_disk.changed = true;
+	if (!ccr_cache.dirty) return;
+
+	x >>= l->shift; y >>= l->shift; z >>= l->shift;
+	ccr_cache.dirty[(y * l->regionsZ + z) * l->regionsX + x] = true;
+}
+
+static void Ccr_FreeCache(void) {
+	int i;
+	for (i = 0; ccr_cache.regions && i < ccr_cache.layout.numRegions; i++) {
+		Mem_Free(ccr_cache.regions[i].data);
+	}
+
+	Mem_Free(ccr_cache.regions);
+	Mem_Free(ccr_cache.dirty);
+	Mem_Free(ccr_cache.jobs);
+	ccr_cache.regions = NULL;
+	ccr_cache.dirty   = NULL;
+	ccr_cache.jobs    = NULL;
+	ccr_cache.blocks  = NULL;
+	ccr_disk.valid    = false;
+}
+
+/* Ensures cache is for the current world, with every region marked as modified if it wasn't */
+static cc_result Ccr_InitCache(cc_bool upper) {
+	struct CcrLayout* l = &ccr_cache.layout;
+	if (ccr_cache.regions && ccr_cache.blocks == World.Blocks && ccr_cache.upper == upper) return 0;
+	Ccr_FreeCache();
+
+	Ccr_InitLayout(l, World.Width, World.Height, World.Length, CCR_SAVE_SHIFT);
+	ccr_cache.regions = (struct CcrRegion*)Mem_TryAllocCleared(l->numRegions, sizeof(struct CcrRegion));
+	ccr_cache.dirty   = (cc_uint8*)Mem_TryAlloc(l->numRegions, 1);
+	ccr_cache.jobs    = (int*)Mem_TryAlloc(l->numRegions, sizeof(int));
+
+	if (!ccr_cache.regions || !ccr_cache.dirty || !ccr_cache.jobs) {
+		Ccr_FreeCache(); return ERR_OUT_OF_MEMORY;
+	}
+	Mem_Set(ccr_cache.dirty, true, l->numRegions);
+
+	ccr_cache.blocks = World.Blocks;
+	ccr_cache.upper  = upper;
+	return 0;
+}
+
+/* Copies the given region's blocks from the snapshot of the world's blocks */
+static cc_result Ccr_ReadRegion(struct CcrLayout* l, int i, BlockRaw* region, cc_bool upper) {
+	IVec3 beg, end;
+	int x, y, z, index;
+	cc_result res;
+	Ccr_GetBounds(l, i, &beg, &end);
+	x = end.X - beg.X;
+
+	for (y = beg.Y; y < end.Y; y++) {
+		for (z = beg.Z; z < end.Z; z++, region += x) {
+			index = (y * l->length + z) * l->width + beg.X;
+			if ((res = WorldSnapshot_Read(region, index, x, upper))) return res;
+		}
+	}
+	return 0;
+}
+
+static cc_result Ccr_CompressRegion(struct CcrWorker* w, int job) {
+	int i = ccr_cache.jobs[job];
+	struct CcrRegion* r = &ccr_cache.regions[i];
+	struct CcrLayout* l = &ccr_cache.layout;
+	int volume = Ccr_GetVolume(l, i);
+	int size   = volume;
+	struct Stream output, compStream;
+	cc_result res;
+
+	if ((res = Ccr_ReadRegion(l, i, w->blocks, false))) return res;
+#ifdef EXTENDED_BLOCKS
+	if (ccr_cache.upper) {
+		if ((res = Ccr_ReadRegion(l, i, w->blocks + volume, true))) return res;
+		size *= 2;
+	}
+#endif
+
+	Mem_Free(r->data);
+	r->data = NULL;
+	r->size = 0;
+
+	/* Regions with only one type of block (e.g. air or stone) only need that block stored */
+	if (Ccr_IsUniform(w->blocks, volume) && (size == volume || Ccr_IsUniform(w->blocks + volume, volume))) {
+		r->value = size == volume ? w->blocks[0] : (w->blocks[0] | (w->blocks[volume] << 8));
+		return 0;
+	}
+
+	Ccr_MakeOutput(&output);
+	Deflate_MakeStream(&compStream, &w->state.deflate, &output);
+	res = Stream_Write(&compStream, w->blocks, size);
+	if (!res) res = compStream.Close(&compStream);
+
+	if (res) { Mem_Free(output.Meta.Mem.Base); return res; }
+	r->data = output.Meta.Mem.Base;
+	r->size = output.Meta.Mem.Length - output.Meta.Mem.Left;
+	return 0;
+}
+
+static cc_result Ccr_CompressMetadata(struct CcrWorker* w, struct Stream* raw, struct Stream* output) {
+	struct Stream compStream;
+	cc_result res;
+	Deflate_MakeStream(&compStream, &w->state.deflate, output);
+
+	res = Stream_Write(&compStream, raw->Meta.Mem.Base, raw->Meta.Mem.Length - raw->Meta.Mem.Left);
+	if (res) return res;
+	return compStream.Close(&compStream);
+}
+
+/* Writes the world's metadata into the given output, then lists the regions modified since the last save */
+/* NOTE: Must be called on the main thread, with the world's blocks already snapshotted */
+static cc_result Ccr_GatherChanges(struct Stream* raw) {
+	cc_bool upper = false;
+	cc_result res;
+	int i;
+#ifdef EXTENDED_BLOCKS
+	upper = World.Blocks != World.Blocks2;
+#endif
+
+	if ((res = Ccr_InitCache(upper)))  return res;
+	if ((res = Cw_WriteHeader(raw)))   return res;
+	if ((res = Cw_WriteMetadata(raw))) return res;
+
+	ccr_cache.numJobs = 0;
+	for (i = 0; i < ccr_cache.layout.numRegions; i++) {
+		if (!ccr_cache.dirty[i]) continue;
+		ccr_cache.jobs[ccr_cache.numJobs++] = i;
+		ccr_cache.dirty[i] = false;
+	}
+	return 0;
+}
+
+/* Compresses the gathered metadata into the given output, and all the gathered regions */
+/* NOTE: On failure, regions may have only been partially compressed, so the cache must be freed */
+static cc_result Ccr_CompressChanges(struct Stream* raw, struct Stream* meta) {
+	cc_result res;
+	if ((res = Ccr_BeginWork())) { Ccr_EndWork(); return res; }
+
+	res = Ccr_RunJobs(Ccr_CompressRegion, ccr_cache.numJobs);
+	if (!res) res = Ccr_CompressMetadata(ccr_work.workers[0], raw, meta);
+	Ccr_EndWork();
+	return res;
+}
+
+static void Ccr_MakeHeader(cc_uint8* header, cc_uint32 metaSize, cc_uint32 metaCapacity) {
+	struct CcrLayout* l = &ccr_cache.layout;
+	Mem_Copy(header, ccr_identifier, sizeof(ccr_identifier));
+
+	header[4] = CCR_VERSION;
+	header[5] = l->shift;
+	header[6] = ccr_cache.upper ? CCR_FLAG_UPPER : 0;
+	header[7] = 0;
+	Stream_SetU16_LE(&header[8],  l->width);
+	Stream_SetU16_LE(&header[10], l->height);
+	Stream_SetU16_LE(&header[12], l->length);
+	Stream_SetU32_LE(&header[14], metaSize);
+	Stream_SetU32_LE(&header[18], metaCapacity);
+}
+
+/* Writes the entire file, with region data in the same order as the index */
+static cc_result Ccr_WriteFile(struct Stream* stream, struct Stream* meta, cc_uint32 metaCapacity) {
+	static const cc_uint8 zeroes[256] = { 0 };
+	struct CcrLayout* l = &ccr_cache.layout;
+	cc_uint32 metaSize  = meta->Meta.Mem.Length - meta->Meta.Mem.Left;
+	cc_uint8 header[CCR_HEADER_SIZE];
+	struct CcrRegion* r;
+	cc_uint8* index;
+	cc_uint32 i, offset = 0;
+	cc_result res;
+
+	Ccr_MakeHeader(header, metaSize, metaCapacity);
+	if ((res = Stream_Write(stream, header, CCR_HEADER_SIZE)))       return res;
+	if ((res = Stream_Write(stream, meta->Meta.Mem.Base, metaSize))) return res;
+
+	for (i = metaSize; i < metaCapacity; i += sizeof(zeroes)) {
+		if ((res = Stream_Write(stream, zeroes, min(metaCapacity - i, sizeof(zeroes))))) return res;
+	}
+
+	index = (cc_uint8*)Mem_TryAlloc(l->numRegions, CCR_ENTRY_SIZE);
+	if (!index) return ERR_OUT_OF_MEMORY;
+
+	for (i = 0; i < l->numRegions; i++) {
+		r = &ccr_cache.regions[i];
+		r->offset = offset;
+		Stream_SetU32_LE(index + i * CCR_ENTRY_SIZE,     r->size);
+		Stream_SetU32_LE(index + i * CCR_ENTRY_SIZE + 4, r->size ? offset : r->value);
+		offset += r->size;
+	}
+
+	res = Stream_Write(stream, index, l->numRegions * CCR_ENTRY_SIZE);
+	Mem_Free(index);
+
+	for (i = 0; i < l->numRegions && !res; i++) {
+		r = &ccr_cache.regions[i];
+		if (r->size) res = Stream_Write(stream, r->data, r->size);
+	}
+	ccr_disk.dataSize = offset;
+	return res;
+}
+
+cc_result Ccr_Save(struct Stream* stream) {
+	struct Stream raw, meta;
+	cc_result res;
+	/* The cache is shared with saving in the background */
+	Ccr_FinishSave();
+	if ((res = WorldSnapshot_Begin())) return res;
+
+	Ccr_MakeOutput(&raw);
+	Ccr_MakeOutput(&meta);
+	res = Ccr_GatherChanges(&raw);
+
+	if (!res && (res = Ccr_CompressChanges(&raw, &meta))) Ccr_FreeCache();
+	if (!res) res = Ccr_WriteFile(stream, &meta, meta.Meta.Mem.Length - meta.Meta.Mem.Left);
+
+	Mem_Free(raw.Meta.Mem.Base);
+	Mem_Free(meta.Meta.Mem.Base);
+	WorldSnapshot_End();
+
+	/* Regions are no longer marked as modified, so autosave file can't be updated from them */
+	ccr_disk.valid = false;
+	return res;
+}
+
+
+/*########################################################################################################################*
+*----------------------------------------------ClassiCube region autosave-------------------------------------------------*
+*#########################################################################################################################*/
+/* In singleplayer, the world is periodically saved to a region file, with only modified regions written to it. */
+/* Changes are first written to a journal file, and only then applied to the region file. If the game crashes */
+/*  while applying changes, the journal is applied again the next time the region file is loaded. */
+/* Both files are flushed to disc before the journal is cleared, so that the journal isn't cleared before */
+/*  the changes it contains have actually been written to the region file. (e.g. if power is lost)
+	U8[4]  "Identifier" ('C','C','R','J')
+	U32    "Flags" (CCR_JOURNAL_TRUNCATE if the file should be emptied before applying changes)
+	U32    "Number of changes"
+	CHANGE "Changes" { U32 "Position", U32 "Size", U8* "Data" }
+	U32    "CRC32" (of all the preceding data, so incompletely written journals are ignored)
+*/
+#define CCR_JOURNAL_TRUNCATE    0x01
+#define CCR_JOURNAL_HEADER_SIZE 12
+#define CCR_AUTOSAVE_INTERVAL   60
+/* Extra space for metadata, so that changes to the environment don't require rewriting the whole file */
+#define CCR_META_SLACK 4096
+/* Whole file is rewritten once replaced region data takes up more space than this */
+#define CCR_MAX_UNUSED (1024 * 1024)
+static const cc_uint8 ccr_journalId[4] = { 'C','C','R','J' };
+static const cc_string ccr_autosavePath = String_FromConst("maps/autosave.ccr");
+
+static void Ccr_GetJournalPath(const cc_string* path, cc_string* dst) {
+	String_Copy(dst, path);
+	String_AppendConst(dst, ".journal");
+}
+
+static cc_result Ccr_BeginJournal(struct Stream* j, cc_uint32 flags) {
+	cc_uint8 header[CCR_JOURNAL_HEADER_SIZE];
+	Ccr_MakeOutput(j);
+
+	Mem_Copy(header, ccr_journalId, sizeof(ccr_journalId));
+	Stream_SetU32_LE(&header[4], flags);
+	Stream_SetU32_LE(&header[8], 0);
+	return Stream_Write(j, header, CCR_JOURNAL_HEADER_SIZE);
+}
+
+/* Starts a change, returning where its size needs to be written once the change's data has been written */
+static cc_result Ccr_BeginChange(struct Stream* j, cc_uint32 position, cc_uint32* sizePos) {
+	cc_uint8 tmp[8];
+	Stream_SetU32_LE(&tmp[0], position);
+	Stream_SetU32_LE(&tmp[4], 0);
+
+	*sizePos = j->Meta.Mem.Length - j->Meta.Mem.Left + 4;
+	return Stream_Write(j, tmp, sizeof(tmp));
+}
+
+static void Ccr_EndChange(struct Stream* j, cc_uint32 sizePos) {
+	cc_uint8* base = j->Meta.Mem.Base;
+	cc_uint32 used = j->Meta.Mem.Length - j->Meta.Mem.Left;
+
+	Stream_SetU32_LE(base + sizePos, used - (sizePos + 4));
+	Stream_SetU32_LE(base + 8, Stream_GetU32_LE(base + 8) + 1);
+}
+
+static cc_result Ccr_AddChange(struct Stream* j, cc_uint32 position, const void* data, cc_uint32 size) {
+	cc_uint32 sizePos;
+	cc_result res;
+
+	if ((res = Ccr_BeginChange(j, position, &sizePos)))     return res;
+	if ((res = Stream_Write(j, (const cc_uint8*)data, size))) return res;
+	Ccr_EndChange(j, sizePos);
+	return 0;
+}
+
+static cc_result Ccr_EndJournal(struct Stream* j) {
+	cc_uint8 tmp[4];
+	cc_uint32 used = j->Meta.Mem.Length - j->Meta.Mem.Left;
+
+	Stream_SetU32_LE(tmp, Utils_CRC32(j->Meta.Mem.Base, used));
+	return Stream_Write(j, tmp, sizeof(tmp));
+}
+
+static cc_result Ccr_ApplyJournal(const cc_string* path, cc_uint8* data, cc_uint32 len) {
+	struct Stream file;
+	cc_uint32 i, count, position, size;
+	cc_uint8* end = data + len - 4;
+	cc_result res, closeRes;
+
+	if (len < CCR_JOURNAL_HEADER_SIZE + 4 || !Mem_Equal(data, ccr_journalId, sizeof(ccr_journalId))) return CCR_ERR_JOURNAL;
+	if (Utils_CRC32(data, len - 4) != Stream_GetU32_LE(end)) return CCR_ERR_JOURNAL;
+
+	if (Stream_GetU32_LE(&data[4]) & CCR_JOURNAL_TRUNCATE) {
+		res = Stream_CreateFile(&file, path);
+	} else {
+		res = Stream_AppendFile(&file, path);
+	}
+	if (res) return res;
+
+	count = Stream_GetU32_LE(&data[8]);
+	data += CCR_JOURNAL_HEADER_SIZE;
+
+	for (i = 0; i < count && !res; i++) {
+		if (data + 8 > end) { res = CCR_ERR_JOURNAL; break; }
+		position = Stream_GetU32_LE(&data[0]);
+		size     = Stream_GetU32_LE(&data[4]);
+		data    += 8;
+
+		if (size > (cc_uint32)(end - data)) { res = CCR_ERR_JOURNAL; break; }
+		if (!(res = file.Seek(&file, position))) res = Stream_Write(&file, data, size);
+		data += size;
+	}
+
+	if (!res) res = File_Flush(file.Meta.File);
+	closeRes = file.Close(&file);
+	return res ? res : closeRes;
+}
+
+static void Ccr_ClearJournal(const cc_string* journalPath) {
+	struct Stream stream;
+	if (!Stream_CreateFile(&stream, journalPath)) stream.Close(&stream);
+}
+
+/* Writes the journal, then applies it to the given file */
+static cc_result Ccr_WriteJournal(const cc_string* path, struct Stream* j) {
+	cc_string journalPath; char journalBuffer[FILENAME_SIZE];
+	cc_uint32 used = j->Meta.Mem.Length - j->Meta.Mem.Left;
+	struct Stream stream;
+	cc_result res, closeRes;
+
+	String_InitArray(journalPath, journalBuffer);
+	Ccr_GetJournalPath(path, &journalPath);
+
+	if ((res = Stream_CreateFile(&stream, &journalPath))) return res;
+	res = Stream_Write(&stream, j->Meta.Mem.Base, used);
+	/* Region file must not be modified until the journal is definitely on disc */
+	if (!res) res = File_Flush(stream.Meta.File);
+	closeRes = stream.Close(&stream);
+	if (res || (res = closeRes)) return res;
+
+	/* Journal is kept if changes couldn't be applied, so they are applied when the file is next loaded */
+	if ((res = Ccr_ApplyJournal(path, j->Meta.Mem.Base, used))) return res;
+	Ccr_ClearJournal(&journalPath);
+	return 0;
+}
+
+void Ccr_RecoverJournal(const cc_string* path) {
+	cc_string journalPath; char journalBuffer[FILENAME_SIZE];
+	struct Stream stream;
+	cc_uint8* data = NULL;
+	cc_uint32 len;
+	cc_result res;
+
+	String_InitArray(journalPath, journalBuffer);
+	Ccr_GetJournalPath(path, &journalPath);
+	if (!File_Exists(&journalPath)) return;
+
+	if ((res = Stream_OpenFile(&stream, &journalPath))) return;
+	if (!(res = stream.Length(&stream, &len)) && len) {
+		data = (cc_uint8*)Mem_TryAlloc(len, 1);
+		res  = data ? Stream_Read(&stream, data, len) : ERR_OUT_OF_MEMORY;
+	}
+	(void)stream.Close(&stream);
+	if (res || !len) { Mem_Free(data); return; }
+
+	/* Incomplete journals are just discarded, as the file hasn't been changed at all then */
+	res = Ccr_ApplyJournal(path, data, len);
+	Mem_Free(data);
+
+	if (res && res != CCR_ERR_JOURNAL) {
+		Logger_SysWarn2(res, "recovering", path); return;
+	}
+	Ccr_ClearJournal(&journalPath);
+}
+
+/* Rewrites the whole file, with spare metadata space */
+static cc_result Ccr_AutosaveAll(struct Stream* j, struct Stream* meta) {
+	cc_uint32 metaSize = meta->Meta.Mem.Length - meta->Meta.Mem.Left;
+	cc_uint32 sizePos;
+	cc_result res;
+
+	ccr_disk.metaCapacity = metaSize + CCR_META_SLACK;
+	if ((res = Ccr_BeginJournal(j, CCR_JOURNAL_TRUNCATE)))           return res;
+	if ((res = Ccr_BeginChange(j, 0, &sizePos)))                      return res;
+	if ((res = Ccr_WriteFile(j, meta, ccr_disk.metaCapacity)))        return res;
+
+	Ccr_EndChange(j, sizePos);
+	return Ccr_EndJournal(j);
+}
+
+/* Appends the data of modified regions, then updates their index entries and the metadata */
+static cc_result Ccr_AutosaveChanges(struct Stream* j, struct Stream* meta) {
+	struct CcrLayout* l = &ccr_cache.layout;
+	cc_uint32 metaSize  = meta->Meta.Mem.Length - meta->Meta.Mem.Left;
+	cc_uint32 indexPos  = CCR_HEADER_SIZE + ccr_disk.metaCapacity;
+	cc_uint32 dataPos   = indexPos + l->numRegions * CCR_ENTRY_SIZE;
+	cc_uint8 header[CCR_HEADER_SIZE];
+	cc_uint8 entry[CCR_ENTRY_SIZE];
+	struct CcrRegion* r;
+	cc_uint32 sizePos;
+	cc_result res;
+	int i;
+
+	if ((res = Ccr_BeginJournal(j, 0)))                                 return res;
+	if ((res = Ccr_BeginChange(j, dataPos + ccr_disk.dataSize, &sizePos))) return res;
+
+	for (i = 0; i < ccr_cache.numJobs; i++) {
+		r = &ccr_cache.regions[ccr_cache.jobs[i]];
+		if (!r->size) continue;
+
+		r->offset = ccr_disk.dataSize;
+		ccr_disk.dataSize += r->size;
+		if ((res = Stream_Write(j, r->data, r->size))) return res;
+	}
+	Ccr_EndChange(j, sizePos);
+
+	for (i = 0; i < ccr_cache.numJobs; i++) {
+		r = &ccr_cache.regions[ccr_cache.jobs[i]];
+		Stream_SetU32_LE(&entry[0], r->size);
+		Stream_SetU32_LE(&entry[4], r->size ? r->offset : r->value);
+
+		res = Ccr_AddChange(j, indexPos + ccr_cache.jobs[i] * CCR_ENTRY_SIZE, entry, CCR_ENTRY_SIZE);
+		if (res) return res;
+	}
+
+	Ccr_MakeHeader(header, metaSize, ccr_disk.metaCapacity);
+	if ((res = Ccr_AddChange(j, 0, header, CCR_HEADER_SIZE)))                       return res;
+	if ((res = Ccr_AddChange(j, CCR_HEADER_SIZE, meta->Meta.Mem.Base, metaSize))) return res;
+	return Ccr_EndJournal(j);
+}
+
+static cc_bool Ccr_NeedsRewrite(struct Stream* meta) {
+	cc_uint32 metaSize = meta->Meta.Mem.Length - meta->Meta.Mem.Left;
+	cc_uint32 used = 0, total = ccr_disk.dataSize;
+	int i;
+
+	if (!ccr_disk.valid || metaSize > ccr_disk.metaCapacity) return true;
+	for (i = 0; i < ccr_cache.layout.numRegions; i++) {
+		used += ccr_cache.regions[i].size;
+	}
+	/* Modified regions are appended after all the existing region data */
+	for (i = 0; i < ccr_cache.numJobs; i++) {
+		total += ccr_cache.regions[ccr_cache.jobs[i]].size;
+	}
+	return total - used > max(used, CCR_MAX_UNUSED);
+}
+
+
+/*########################################################################################################################*
+*--------------------------------------------------ClassiCube region saving-----------------------------------------------*
+*#########################################################################################################################*/
+/* The list of modified regions and the world's metadata are gathered on the main thread, then the regions are */
+/*  compressed from a snapshot of the world's blocks and written to the file on a background thread */
+static struct CcrSaveState {
+	cc_bool busy, autosave;
+	volatile cc_bool done;
+	cc_bool compressed; /* Whether all the gathered regions were compressed */
+	cc_result res;
+	struct Stream raw, meta, journal;
+
+	void* thread;
+	cc_string path;
+	char _pathBuffer[FILENAME_SIZE];
+} ccr_save;
+
+static cc_result Ccr_WriteTo(const cc_string* path, struct Stream* meta) {
+	struct Stream stream;
+	cc_result res, closeRes;
+
+	if ((res = Stream_CreateFile(&stream, path))) return res;
+	res      = Ccr_WriteFile(&stream, meta, meta->Meta.Mem.Length - meta->Meta.Mem.Left);
+	closeRes = stream.Close(&stream);
+	return res ? res : closeRes;
+}
+
+/* Updates the given autosave file with the compressed regions, through a journal */
+static cc_result Ccr_WriteAutosave(const cc_string* path, struct Stream* journal, struct Stream* meta) {
+	cc_result res;
+	res = Ccr_NeedsRewrite(meta) ? Ccr_AutosaveAll(journal, meta) : Ccr_AutosaveChanges(journal, meta);
+	if (res) return res;
+	return Ccr_WriteJournal(path, journal);
+}
+
+static void Ccr_SaveThread(void) {
+	cc_result res = Ccr_CompressChanges(&ccr_save.raw, &ccr_save.meta);
+	ccr_save.compressed = !res;
+
+	if (!res && ccr_save.autosave) {
+		res = Ccr_WriteAutosave(&ccr_save.path, &ccr_save.journal, &ccr_save.meta);
+	} else if (!res) {
+		res = Ccr_WriteTo(&ccr_save.path, &ccr_save.meta);
+	}
+
+	ccr_save.res  = res;
+	ccr_save.done = true;
+}
+
+static void Ccr_FreeSave(void) {
+	WorldSnapshot_End();
+	Mem_Free(ccr_save.raw.Meta.Mem.Base);
+	Mem_Free(ccr_save.meta.Meta.Mem.Base);
+	Mem_Free(ccr_save.journal.Meta.Mem.Base);
+
+	Ccr_MakeOutput(&ccr_save.raw);
+	Ccr_MakeOutput(&ccr_save.meta);
+	Ccr_MakeOutput(&ccr_save.journal);
+	ccr_save.busy = false;
+}
+
+static void Ccr_FinishSave(void) {
+	cc_result res;
+	if (!ccr_save.busy) return;
+
+	Thread_Join(ccr_save.thread);
+	ccr_save.thread = NULL;
+	ccr_save.done   = false;
+	Ccr_FreeSave();
+
+	/* Regions may have only been partially compressed */
+	if (!ccr_save.compressed) Ccr_FreeCache();
+	res = ccr_save.res;
+
+	if (ccr_save.autosave) {
+		ccr_disk.valid = !res;
+		if (res) Logger_SysWarn2(res, "autosaving", &ccr_save.path);
+	} else {
+		/* Regions are no longer marked as modified, so autosave file can't be updated from them */
+		ccr_disk.valid = false;
+		if (res) {
+			Logger_SysWarn2(res, "saving", &ccr_save.path);
+		} else {
+			Chat_Add1("&eSaved map to: %s", &ccr_save.path);
+		}
+	}
+}
+
+static void Ccr_CheckSave(struct ScheduledTask* task) {
+	if (ccr_save.done) Ccr_FinishSave();
+}
+
+static cc_result Ccr_BeginSave(const cc_string* path, cc_bool autosave) {
+	cc_result res;
+	if ((res = WorldSnapshot_Begin())) return res;
+
+	Ccr_MakeOutput(&ccr_save.raw);
+	Ccr_MakeOutput(&ccr_save.meta);
+	Ccr_MakeOutput(&ccr_save.journal);
+
+	ccr_save.busy = true;
+	if ((res = Ccr_GatherChanges(&ccr_save.raw))) { Ccr_FreeSave(); return res; }
+
+	String_InitArray(ccr_save.path, ccr_save._pathBuffer);
+	String_AppendString(&ccr_save.path, path);
+	ccr_save.autosave = autosave;
+	ccr_save.done     = false;
+	ccr_save.thread   = Thread_Start(Ccr_SaveThread);
+	return 0;
+}
+
+cc_result Ccr_SaveTo(const cc_string* path) {
+	cc_result res;
+	/* Only one map can be saved at a time */
+	Map_FinishSave();
+	Ccr_FinishSave();
+
+	res = Ccr_BeginSave(path, false);
+	if (res) Logger_SysWarn2(res, "saving", path);
+	return res;
+}
+
+static void Ccr_Autosave(struct ScheduledTask* task) {
+	cc_result res;
+	if (!Server.IsSinglePlayer || !World.Loaded || !ccr_disk.changed || map_import.busy) return;
+	/* Previous autosave is still being written, or the world's blocks are being saved by Map_SaveTo */
+	if (ccr_save.busy || map_save.busy) return;
+	ccr_disk.changed = false;
+
+	res = Ccr_BeginSave(&ccr_autosavePath, true);
+	if (!res) return;
+
+	ccr_disk.valid = false;
+	Logger_SysWarn2(res, "autosaving", &ccr_autosavePath);
+}
+
+
+/*########################################################################################################################*
+*---------------------------------------------------Formats component-----------------------------------------------------*
+*#########################################################################################################################*/
+static void Formats_OnNewMap(void* obj) {
+	Ccr_FinishSave();
+	Ccr_FreeCache();
+}
+
+static void Formats_Init(void) {
+	int interval = Options_GetInt(OPT_AUTOSAVE_INTERVAL, 0, 3600, CCR_AUTOSAVE_INTERVAL);
+	ScheduledTask_Add(GAME_DEF_TICKS, Map_CheckSave);
+	ScheduledTask_Add(GAME_DEF_TICKS, Ccr_CheckSave);
+	if (interval) ScheduledTask_Add(interval, Ccr_Autosave);
+
+	Ccr_RecoverJournal(&ccr_autosavePath);
+	Event_Register_(&WorldEvents.NewMap, NULL, Formats_OnNewMap);
+}
+
+static void Formats_Free(void) {
+	Map_FinishSave();
+	Ccr_FinishSave();
+	Ccr_FreeCache();
+}
+
+struct IGameComponent Formats_Component = {
+	Formats_Init, /* Init  */
+	Formats_Free  /* Free  */
+};
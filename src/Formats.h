@@ -6,15 +6,25 @@
 */
 
 struct Stream;
+struct IGameComponent;
 /* Imports a world encoded in a particular map file format. */
 typedef cc_result (*IMapImporter)(struct Stream* stream);
 /* Attempts to find a suitable importer based on filename. */
 /* Returns NULL if no match found. */
 CC_API IMapImporter Map_FindImporter(const cc_string* path);
-/* Attempts to import the map from the given file. */
+/* Opens the given file, then imports the map from it on a background thread. */
 /* NOTE: Uses Map_FindImporter to import based on filename. */
+/* NOTE: Shows a loading screen, which calls Map_EndImport once the map has been imported. */
 CC_API cc_result Map_LoadFrom(const cc_string* path);
 
+/* Progress between 0 and 1 of importing the map being loaded by Map_LoadFrom */
+extern volatile float Map_ImportProgress;
+/* Whether the map being loaded by Map_LoadFrom has finished importing */
+extern volatile cc_bool Map_ImportDone;
+/* Applies the imported map (and its metadata) to the game's world. */
+/* NOTE: Must be called on the main thread, after Map_ImportDone is set to true. */
+void Map_EndImport(void);
+
 /* Imports a world from a .lvl MCSharp server map file. */
 /* Used by MCSharp/MCLawl/MCForge/MCDzienny/MCGalaxy. */
 cc_result Lvl_Load(struct Stream* stream);
@@ -28,10 +38,45 @@ cc_result Cw_Load(struct Stream* stream);
 /* Used by Minecraft Classic/WoM client. */
 cc_result Dat_Load(struct Stream* stream);
 
+/* Exports a world to the given stream */
+typedef cc_result (*IMapExporter)(struct Stream* stream);
+/* Creates the given file, then saves the world to it using the given exporter. */
+/* NOTE: Only metadata is exported immediately - the world's blocks are snapshotted, */
+/*  then compressed and written to the file on a background thread. */
+/* NOTE: Returns non-zero (after showing a warning) if saving could not be started. */
+CC_API cc_result Map_SaveTo(const cc_string* path, IMapExporter exporter);
+/* Waits for the map being saved by Map_SaveTo (if any) to finish being written. */
+void Map_FinishSave(void);
+/* Polls for Map_SaveTo completion, and finishes saving the map on shutdown */
+extern struct IGameComponent Formats_Component;
+
 /* Exports a world to a .cw ClassicWorld map file. */
 /* Compatible with ClassiCube/ClassicalSharp. */
 cc_result Cw_Save(struct Stream* stream);
 /* Exports a world to a .schematic Schematic map file. */
 /* Used by MCEdit and other tools. */
 cc_result Schematic_Save(struct Stream* stream);
+
+/* Imports a world from a .ccr ClassiCube region map file. */
+/* Regions are decompressed in parallel, and only regions within the load bounds are loaded. */
+cc_result Ccr_Load(struct Stream* stream);
+/* Exports a world to a .ccr ClassiCube region map file. */
+/* NOTE: Compressed regions are cached, so later saves only compress regions marked as modified. */
+/* NOTE: Unlike other exporters, output is not meant to be GZIP compressed. */
+/* NOTE: Blocks are compressed before returning, use Ccr_SaveTo instead to save in the game. */
+cc_result Ccr_Save(struct Stream* stream);
+/* Creates the given file, then saves the world to it as a .ccr ClassiCube region map file. */
+/* NOTE: Only the list of modified regions is gathered immediately - the world's blocks are snapshotted, */
+/*  then the modified regions are compressed and written to the file on a background thread. */
+/* NOTE: Returns non-zero (after showing a warning) if saving could not be started. */
+cc_result Ccr_SaveTo(const cc_string* path);
+/* Marks the region containing the given block as modified since the last Ccr_Save or autosave. */
+void Ccr_MarkDirty(int x, int y, int z);
+/* Applies changes from an autosave that didn't finish writing to the given .ccr file. */
+void Ccr_RecoverJournal(const cc_string* path);
+/* Restricts Ccr_Load to only loading the regions that overlap the given box of blocks. */
+/* NOTE: Blocks in all other regions are left as air. */
+CC_API void Ccr_SetLoadBounds(int minX, int minY, int minZ, int maxX, int maxY, int maxZ);
+/* Makes Ccr_Load load all regions again. */
+CC_API void Ccr_ResetLoadBounds(void);
 #endif
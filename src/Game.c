@@ -37,6 +37,7 @@
 #include "Picking.h"
 #include "Animations.h"
 #include "XR.h"
+#include "Formats.h"
 
 struct _GameData Game;
 cc_uint64 Game_FrameStart;
@@ -187,6 +188,7 @@ void Game_Reset(void) {
 void Game_UpdateBlock(int x, int y, int z, BlockID block) {
 	BlockID old = World_GetBlock(x, y, z);
 	World_SetBlock(x, y, z, block);
+	Ccr_MarkDirty(x, y, z);
 
 	if (Weather_Heightmap) {
 		EnvRenderer_OnBlockChanged(x, y, z, old, block);
@@ -380,6 +382,7 @@ static void Game_Load(void) {
 	Event_Register_(&WindowEvents.Closing,         NULL, Game_Free);
 	Event_Register_(&WindowEvents.InactiveChanged, NULL, HandleInactiveChanged);
 
+	Game_AddComponent(&Formats_Component);
 	Game_AddComponent(&World_Component);
 	Game_AddComponent(&Textures_Component);
 	Game_AddComponent(&Input_Component);
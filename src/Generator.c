@@ -1,17 +1,25 @@
 #include "Generator.h"
 #include "BlockID.h"
 #include "ExtMath.h"
-#include "Funcs.h"
 #include "Platform.h"
 #include "World.h"
 #include "Utils.h"
 
+/* On x86_64, scalar float maths is done with SSE instructions too, */
+/*  so noise computed with SSE2 is identical to noise computed one sample at a time */
+#if defined __x86_64__ || defined _M_X64
+#define CC_NOISE_SSE2
+#include <emmintrin.h>
+#endif
+#include "Funcs.h"
+
 volatile float Gen_CurrentProgress;
 volatile const char* Gen_CurrentState;
 volatile cc_bool Gen_Done;
 int Gen_Seed;
 cc_bool Gen_Vanilla;
 BlockRaw* Gen_Blocks;
+Gen_StateCallback Gen_StateFunc;
 
 static void Gen_Init(void) {
 	Gen_CurrentProgress = 0.0f;
@@ -19,6 +27,11 @@ static void Gen_Init(void) {
 	Gen_Done   = false;
 }
 
+static void Gen_SetState(const char* state) {
+	Gen_CurrentState = state;
+	if (Gen_StateFunc) Gen_StateFunc(state);
+}
+
 
 /*########################################################################################################################*
 *-----------------------------------------------------Flatgrass gen-------------------------------------------------------*
@@ -41,13 +54,13 @@ static void FlatgrassGen_MapSet(int yBeg, int yEnd, BlockRaw block) {
 void FlatgrassGen_Generate(void) {
 	Gen_Init();
 
-	Gen_CurrentState = "Setting air blocks";
+	Gen_SetState("Setting air blocks");
 	FlatgrassGen_MapSet(World.Height / 2, World.MaxY, BLOCK_AIR);
 
-	Gen_CurrentState = "Setting dirt blocks";
+	Gen_SetState("Setting dirt blocks");
 	FlatgrassGen_MapSet(0, World.Height / 2 - 2, BLOCK_DIRT);
 
-	Gen_CurrentState = "Setting grass blocks";
+	Gen_SetState("Setting grass blocks");
 	FlatgrassGen_MapSet(World.Height / 2 - 1, World.Height / 2 - 1, BLOCK_GRASS);
 
 	Gen_Done = true;
@@ -111,6 +124,72 @@ static float ImprovedNoise_Calc(const cc_uint8* p, float x, float y) {
 	return c1 + v * (c2 - c1);
 }
 
+#ifdef CC_NOISE_SSE2
+/* Gradients for each hash value, i.e. ((xFlags >> (hash << 1)) & 3) - 1 */
+static const float noise_gradX[16] = { 1,-1, 1,-1,  1,-1, 1,-1,  0, 0, 0, 0,  1, 0,-1, 0 };
+static const float noise_gradY[16] = { 1, 1,-1,-1,  0, 0, 0, 0,  1,-1, 1,-1,  1,-1, 1,-1 };
+
+/* Values of an octave that are the same for every sample in a row */
+/* (Y is split up into integer and fractional parts the same way as in ImprovedNoise_Calc) */
+struct NoiseRow { int Y; float y, v, freq, amplitude; };
+static void ImprovedNoise_InitRow(struct NoiseRow* row, float y, float freq, float amplitude) {
+	int yFloor;
+	y      = y * freq;
+	yFloor = y >= 0 ? (int)y : (int)y - 1;
+	row->Y = yFloor & 0xFF;
+	y     -= yFloor;
+
+	row->y = y;
+	row->v = y * y * y * (y * (y * 6 - 15) + 10); /* Fade(y) */
+	row->freq      = freq;
+	row->amplitude = amplitude;
+}
+
+/* Calculates the same result as ImprovedNoise_Calc for 4 samples in a row at once */
+static __m128 ImprovedNoise_Calc4(const cc_uint8* p, __m128 x, const struct NoiseRow* row) {
+	int X[4];
+	float gx[4][4], gy[4][4]; /* Gradients for [A], [B], [A + 1], [B + 1] */
+	__m128i xFloor;
+	__m128 u, y, y1, x1, g22, g12, g21, g11, c1, c2;
+	int i, A, B, hash;
+
+	/* Truncate, then subtract 1 when !(x >= 0) */
+	xFloor = _mm_cvttps_epi32(x);
+	xFloor = _mm_add_epi32(xFloor, _mm_castps_si128(_mm_cmpnge_ps(x, _mm_setzero_ps())));
+	x      = _mm_sub_ps(x, _mm_cvtepi32_ps(xFloor));
+	_mm_storeu_si128((__m128i*)X, _mm_and_si128(xFloor, _mm_set1_epi32(0xFF)));
+
+	/* Fade(x) */
+	u = _mm_sub_ps(_mm_mul_ps(x, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f));
+	u = _mm_add_ps(_mm_mul_ps(x, u), _mm_set1_ps(10.0f));
+	u = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(x, x), x), u);
+
+	/* Table lookups can't be vectorised with just SSE2 */
+	for (i = 0; i < 4; i++) {
+		A = p[X[i]] + row->Y; B = p[X[i] + 1] + row->Y;
+
+		hash = p[p[A]]     & 0xF; gx[0][i] = noise_gradX[hash]; gy[0][i] = noise_gradY[hash];
+		hash = p[p[B]]     & 0xF; gx[1][i] = noise_gradX[hash]; gy[1][i] = noise_gradY[hash];
+		hash = p[p[A + 1]] & 0xF; gx[2][i] = noise_gradX[hash]; gy[2][i] = noise_gradY[hash];
+		hash = p[p[B + 1]] & 0xF; gx[3][i] = noise_gradX[hash]; gy[3][i] = noise_gradY[hash];
+	}
+
+	y  = _mm_set1_ps(row->y);
+	y1 = _mm_set1_ps(row->y - 1);
+	x1 = _mm_sub_ps(x, _mm_set1_ps(1.0f));
+
+	g22 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(gx[0]), x),  _mm_mul_ps(_mm_loadu_ps(gy[0]), y));
+	g12 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(gx[1]), x1), _mm_mul_ps(_mm_loadu_ps(gy[1]), y));
+	c1  = _mm_add_ps(g22, _mm_mul_ps(u, _mm_sub_ps(g12, g22)));
+
+	g21 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(gx[2]), x),  _mm_mul_ps(_mm_loadu_ps(gy[2]), y1));
+	g11 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(gx[3]), x1), _mm_mul_ps(_mm_loadu_ps(gy[3]), y1));
+	c2  = _mm_add_ps(g21, _mm_mul_ps(u, _mm_sub_ps(g11, g21)));
+
+	return _mm_add_ps(c1, _mm_mul_ps(_mm_set1_ps(row->v), _mm_sub_ps(c2, c1)));
+}
+#endif
+
 
 struct OctaveNoise { cc_uint8 p[8][NOISE_TABLE_SIZE]; int octaves; };
 static void OctaveNoise_Init(struct OctaveNoise* n, RNGState* rnd, int octaves) {
@@ -135,6 +214,37 @@ static float OctaveNoise_Calc(const struct OctaveNoise* n, float x, float y) {
 	return sum;
 }
 
+/* Calculates OctaveNoise_Calc(n, xs[i], y) for every sample in a row */
+static void OctaveNoise_CalcRow(const struct OctaveNoise* n, const float* xs, float y, float* dst, int count) {
+	int i = 0;
+#ifdef CC_NOISE_SSE2
+	struct NoiseRow rows[8];
+	float amplitude = 1, freq = 1;
+	__m128 x, noise, sum;
+	int j;
+
+	for (j = 0; j < n->octaves; j++) {
+		ImprovedNoise_InitRow(&rows[j], y, freq, amplitude);
+		amplitude *= 2.0f;
+		freq *= 0.5f;
+	}
+
+	for (; i + 4 <= count; i += 4) {
+		x   = _mm_loadu_ps(xs + i);
+		sum = _mm_setzero_ps();
+
+		for (j = 0; j < n->octaves; j++) {
+			noise = ImprovedNoise_Calc4(n->p[j], _mm_mul_ps(x, _mm_set1_ps(rows[j].freq)), &rows[j]);
+			sum   = _mm_add_ps(sum, _mm_mul_ps(noise, _mm_set1_ps(rows[j].amplitude)));
+		}
+		_mm_storeu_ps(dst + i, sum);
+	}
+#endif
+	for (; i < count; i++) {
+		dst[i] = OctaveNoise_Calc(n, xs[i], y);
+	}
+}
+
 
 struct CombinedNoise { struct OctaveNoise noise1, noise2; };
 static void CombinedNoise_Init(struct CombinedNoise* n, RNGState* rnd, int octaves1, int octaves2) {
@@ -142,30 +252,134 @@ static void CombinedNoise_Init(struct CombinedNoise* n, RNGState* rnd, int octav
 	OctaveNoise_Init(&n->noise2, rnd, octaves2);
 }
 
-static float CombinedNoise_Calc(const struct CombinedNoise* n, float x, float y) {
-	float offset = OctaveNoise_Calc(&n->noise2, x, y);
-	return OctaveNoise_Calc(&n->noise1, x + offset, y);
+/* Calculates the noise for every sample in a row, with each sample's x first being offset by noise2 */
+/*  i.e. dst[i] = noise1(xs[i] + noise2(xs[i], y), y) */
+/* NOTE: tmp must be at least count elements long */
+static void CombinedNoise_CalcRow(const struct CombinedNoise* n, const float* xs, float y, float* dst, float* tmp, int count) {
+	int i;
+	OctaveNoise_CalcRow(&n->noise2, xs, y, tmp, count);
+	for (i = 0; i < count; i++) { tmp[i] = xs[i] + tmp[i]; }
+
+	OctaveNoise_CalcRow(&n->noise1, tmp, y, dst, count);
+}
+
+
+/*########################################################################################################################*
+*---------------------------------------------------Generation workers----------------------------------------------------*
+*#########################################################################################################################*/
+#define GEN_MAX_THREADS 16
+/* Independent parts of a generation step are run by the calling thread and other threads, */
+/*  with each thread repeatedly taking the next unprocessed job until there are none left */
+typedef void (*Gen_JobFunc)(int job);
+static struct GenWork {
+	Gen_JobFunc func;
+	void* mutex;
+	int next, count, done;
+	cc_bool progress;
+} gen_work;
+
+static int Gen_ThreadsCount(void) {
+	return min(Thread_ProcessorCount(), GEN_MAX_THREADS);
+}
+
+static void Gen_RunWorker(void) {
+	int job;
+
+	for (;;) {
+		Mutex_Lock(gen_work.mutex);
+		{
+			job = gen_work.next++;
+		}
+		Mutex_Unlock(gen_work.mutex);
+		if (job >= gen_work.count) return;
+
+		gen_work.func(job);
+		if (!gen_work.progress) continue;
+
+		Mutex_Lock(gen_work.mutex);
+		{
+			gen_work.done++;
+			Gen_CurrentProgress = (float)gen_work.done / gen_work.count;
+		}
+		Mutex_Unlock(gen_work.mutex);
+	}
+}
+
+/* Calls func for every job from 0 to count, across all the threads */
+/* If progress is true, Gen_CurrentProgress is updated as jobs are completed */
+static void Gen_RunJobs(Gen_JobFunc func, int count, cc_bool progress) {
+	void* threads[GEN_MAX_THREADS];
+	int i, numThreads = min(Gen_ThreadsCount(), count) - 1;
+
+	if (!gen_work.mutex) gen_work.mutex = Mutex_Create();
+	gen_work.func     = func;
+	gen_work.next     = 0;
+	gen_work.count    = count;
+	gen_work.done     = 0;
+	gen_work.progress = progress;
+
+	for (i = 0; i < numThreads; i++) {
+		threads[i] = Thread_Start(Gen_RunWorker);
+	}
+	Gen_RunWorker();
+
+	for (i = 0; i < numThreads; i++) {
+		Thread_Join(threads[i]);
+	}
 }
 
 
 /*########################################################################################################################*
 *----------------------------------------------------Notchy map gen-------------------------------------------------------*
 *#########################################################################################################################*/
-static int waterLevel, minHeight;
+static int waterLevel, minHeight, minStoneY;
 static cc_int16* Heightmap;
 static RNGState rnd;
+/* Noise used by the current generation step, which is shared by all the threads */
+static struct CombinedNoise combined1, combined2;
+static struct OctaveNoise octave1, octave2;
+
+/* Spheroids and plants are generated in batches using the RNG, and then placed in parallel, with each thread */
+/*  only placing blocks within its own slab of Z rows. Since every thread places blocks in the same order as */
+/*  they were generated in, the resulting world is identical to when the blocks are placed one at a time. */
+#define GEN_BATCH_SIZE 16384
+struct GenSpheroid { int x, y, z; float radius; };
+struct GenPlant    { int x, y, z; BlockRaw block, ground; };
+
+static union GenBatchEntry {
+	struct GenSpheroid spheroid;
+	struct GenPlant plant;
+} * batch;
+static int batchCount, batchSlabs;
+static BlockRaw batchBlock; /* Block spheroids replace stone with */
+
+static void NotchyGen_GetSlab(int slab, int* minZ, int* maxZ) {
+	*minZ = slab       * World.Length / batchSlabs;
+	*maxZ = (slab + 1) * World.Length / batchSlabs - 1;
+}
+
+static void NotchyGen_FlushBatch(Gen_JobFunc placeSlab) {
+	int numThreads = Gen_ThreadsCount();
+	if (!batchCount) return;
+
+	/* Use more slabs than threads, so threads that finish early can take another slab */
+	batchSlabs = numThreads == 1 ? 1 : min(numThreads * 4, World.Length);
+	Gen_RunJobs(placeSlab, batchSlabs, false);
+	batchCount = 0;
+}
 
-static void NotchyGen_FillOblateSpheroid(int x, int y, int z, float radius, BlockRaw block) {
+static void NotchyGen_FillOblateSpheroid(int x, int y, int z, float radius, BlockRaw block, int minZ, int maxZ) {
 	int xBeg = Math_Floor(max(x - radius, 0));
 	int xEnd = Math_Floor(min(x + radius, World.MaxX));
 	int yBeg = Math_Floor(max(y - radius, 0));
 	int yEnd = Math_Floor(min(y + radius, World.MaxY));
-	int zBeg = Math_Floor(max(z - radius, 0));
-	int zEnd = Math_Floor(min(z + radius, World.MaxZ));
+	int zBeg = max(Math_Floor(max(z - radius, 0)),           minZ);
+	int zEnd = min(Math_Floor(min(z + radius, World.MaxZ)), maxZ);
 
 	float radiusSq = radius * radius;
 	int index;
 	int xx, yy, zz, dx, dy, dz;
+	if (zBeg > zEnd) return;
 
 	for (yy = yBeg; yy <= yEnd; yy++) { dy = yy - y;
 		for (zz = zBeg; zz <= zEnd; zz++) { dz = zz - z;
@@ -181,83 +395,167 @@ static void NotchyGen_FillOblateSpheroid(int x, int y, int z, float radius, Bloc
 	}
 }
 
-#define STACK_FAST 8192
-static void NotchyGen_FloodFill(int index, BlockRaw block) {
-	int* stack;
-	int stack_default[STACK_FAST]; /* avoid allocating memory if possible */
-	int count = 0, limit = STACK_FAST;
-	int x, y, z;
+static void NotchyGen_FillSpheroidSlab(int slab) {
+	struct GenSpheroid* s;
+	int i, minZ, maxZ;
 
-	stack = stack_default;
-	if (index < 0) return; /* y below map, don't bother starting */
-	stack[count++] = index;
+	NotchyGen_GetSlab(slab, &minZ, &maxZ);
+	for (i = 0; i < batchCount; i++) {
+		s = &batch[i].spheroid;
+		NotchyGen_FillOblateSpheroid(s->x, s->y, s->z, s->radius, batchBlock, minZ, maxZ);
+	}
+}
 
-	while (count) {
-		index = stack[--count];
+static void NotchyGen_AddSpheroid(int x, int y, int z, float radius) {
+	struct GenSpheroid* s;
+	if (batchCount == GEN_BATCH_SIZE) NotchyGen_FlushBatch(NotchyGen_FillSpheroidSlab);
 
-		if (Gen_Blocks[index] != BLOCK_AIR) continue;
-		Gen_Blocks[index] = block;
+	s = &batch[batchCount++].spheroid;
+	s->x = x; s->y = y; s->z = z; s->radius = radius;
+}
+
+static void NotchyGen_PlacePlantSlab(int slab) {
+	struct GenPlant* p;
+	int i, index, minZ, maxZ;
+
+	NotchyGen_GetSlab(slab, &minZ, &maxZ);
+	for (i = 0; i < batchCount; i++) {
+		p = &batch[i].plant;
+		if (p->z < minZ || p->z > maxZ) continue;
+
+		index = World_Pack(p->x, p->y, p->z);
+		if (Gen_Blocks[index] == BLOCK_AIR && Gen_Blocks[index - World.OneY] == p->ground)
+			Gen_Blocks[index] = p->block;
+	}
+}
+
+/* Places the given plant, if the block is air and the block underneath it is the given ground block */
+static void NotchyGen_AddPlant(int x, int y, int z, BlockRaw block, BlockRaw ground) {
+	struct GenPlant* p;
+	if (batchCount == GEN_BATCH_SIZE) NotchyGen_FlushBatch(NotchyGen_PlacePlantSlab);
 
-		x = index  % World.Width;
-		y = index  / World.OneY;
-		z = (index / World.Width) % World.Length;
+	p = &batch[batchCount++].plant;
+	p->x = x; p->y = y; p->z = z; p->block = block; p->ground = ground;
+}
+
+#define STACK_FAST 2048
+/* Start of a run of air blocks along the X axis that still needs to be flood filled */
+struct FloodSeed { int x, y, z; };
+struct FloodStack { struct FloodSeed* seeds; int count, limit; };
+
+/* Adds a seed for each separate run of air blocks between x1 and x2 (inclusive) in the given row */
+static void NotchyGen_FloodSeeds(struct FloodStack* s, int x1, int x2, int y, int z) {
+	int row = World_Pack(0, y, z), x;
+	cc_bool inRun = false;
+	struct FloodSeed* seed;
+
+	for (x = x1; x <= x2; x++) {
+		if (Gen_Blocks[row + x] != BLOCK_AIR) { inRun = false; continue; }
+		if (inRun) continue;
+		inRun = true;
 
 		/* need to increase stack */
-		if (count >= limit - FACE_COUNT) {
-			Utils_Resize((void**)&stack, &limit, 4, STACK_FAST, STACK_FAST);
+		if (s->count == s->limit) {
+			Utils_Resize((void**)&s->seeds, &s->limit, sizeof(struct FloodSeed), STACK_FAST, STACK_FAST);
 		}
+		seed = &s->seeds[s->count++];
+		seed->x = x; seed->y = y; seed->z = z;
+	}
+}
 
-		if (x > 0)          { stack[count++] = index - 1; }
-		if (x < World.MaxX) { stack[count++] = index + 1; }
-		if (z > 0)          { stack[count++] = index - World.Width; }
-		if (z < World.MaxZ) { stack[count++] = index + World.Width; }
-		if (y > 0)          { stack[count++] = index - World.OneY; }
+/* Fills all air blocks connected to the given block horizontally or downwards */
+/* Whole runs of air along the X axis are filled at once, then only one seed is added */
+/*  for each run of air in the rows beside/below the run that was just filled */
+static void NotchyGen_FloodFill(int x, int y, int z, BlockRaw block) {
+	struct FloodSeed seeds_default[STACK_FAST]; /* avoid allocating memory if possible */
+	struct FloodStack s;
+	struct FloodSeed seed;
+	int row, x1, x2;
+
+	if (y < 0) return; /* y below map, don't bother starting */
+	s.seeds = seeds_default; s.count = 0; s.limit = STACK_FAST;
+	NotchyGen_FloodSeeds(&s, x, x, y, z);
+
+	while (s.count) {
+		seed = s.seeds[--s.count];
+		row  = World_Pack(0, seed.y, seed.z);
+		/* run was already filled from a different seed */
+		if (Gen_Blocks[row + seed.x] != BLOCK_AIR) continue;
+
+		for (x1 = seed.x; x1 > 0          && Gen_Blocks[row + x1 - 1] == BLOCK_AIR; x1--) { }
+		for (x2 = seed.x; x2 < World.MaxX && Gen_Blocks[row + x2 + 1] == BLOCK_AIR; x2++) { }
+		Mem_Set(&Gen_Blocks[row + x1], block, x2 - x1 + 1);
+
+		if (seed.z > 0)          NotchyGen_FloodSeeds(&s, x1, x2, seed.y, seed.z - 1);
+		if (seed.z < World.MaxZ) NotchyGen_FloodSeeds(&s, x1, x2, seed.y, seed.z + 1);
+		if (seed.y > 0)          NotchyGen_FloodSeeds(&s, x1, x2, seed.y - 1, seed.z);
 	}
-	if (limit > STACK_FAST) Mem_Free(stack);
+	if (s.limit > STACK_FAST) Mem_Free(s.seeds);
 }
 
 
-static void NotchyGen_CreateHeightmap(void) {
+/* Noise is calculated for chunks of samples along a row at once */
+#define GEN_ROW_CHUNK 256
+
+static void NotchyGen_HeightmapRow(int z) {
+	float xs[GEN_ROW_CHUNK], tmp[GEN_ROW_CHUNK];
+	float low[GEN_ROW_CHUNK], high[GEN_ROW_CHUNK], sel[GEN_ROW_CHUNK];
 	float hLow, hHigh, height;
-	int hIndex = 0, adjHeight;
-	int x, z;
-	struct CombinedNoise n1, n2;
-	struct OctaveNoise n3;
+	int hIndex = z * World.Width;
+	int x, i, j, count, numHigh;
 
-	CombinedNoise_Init(&n1, &rnd, 8, 8);
-	CombinedNoise_Init(&n2, &rnd, 8, 8);	
-	OctaveNoise_Init(&n3, &rnd, 6);
+	for (x = 0; x < World.Width; x += count) {
+		count = min(World.Width - x, GEN_ROW_CHUNK);
 
-	Gen_CurrentState = "Building heightmap";
-	for (z = 0; z < World.Length; z++) {
-		Gen_CurrentProgress = (float)z / World.Length;
+		for (i = 0; i < count; i++) { xs[i] = (x + i) * 1.3f; }
+		CombinedNoise_CalcRow(&combined1, xs, z * 1.3f, low, tmp, count);
+
+		for (i = 0; i < count; i++) { xs[i] = (float)(x + i); }
+		OctaveNoise_CalcRow(&octave1, xs, (float)z, sel, count);
 
-		for (x = 0; x < World.Width; x++) {
-			hLow   = CombinedNoise_Calc(&n1, x * 1.3f, z * 1.3f) / 6 - 4;
+		/* High noise is only needed for columns where the selector noise is <= 0 */
+		for (i = 0, numHigh = 0; i < count; i++) {
+			if (sel[i] <= 0) xs[numHigh++] = (x + i) * 1.3f;
+		}
+		CombinedNoise_CalcRow(&combined2, xs, z * 1.3f, high, tmp, numHigh);
+
+		for (i = 0, j = 0; i < count; i++) {
+			hLow   = low[i] / 6 - 4;
 			height = hLow;
 
-			if (OctaveNoise_Calc(&n3, (float)x, (float)z) <= 0) {
-				hHigh = CombinedNoise_Calc(&n2, x * 1.3f, z * 1.3f) / 5 + 6;
+			if (sel[i] <= 0) {
+				hHigh  = high[j++] / 5 + 6;
 				height = max(hLow, hHigh);
 			}
 
 			height *= 0.5f;
 			if (height < 0) height *= 0.8f;
-
-			adjHeight = (int)(height + waterLevel);
-			minHeight = min(adjHeight, minHeight);
-			Heightmap[hIndex++] = adjHeight;
+			Heightmap[hIndex++] = (int)(height + waterLevel);
 		}
 	}
 }
 
+static void NotchyGen_CreateHeightmap(void) {
+	int i;
+	CombinedNoise_Init(&combined1, &rnd, 8, 8);
+	CombinedNoise_Init(&combined2, &rnd, 8, 8);
+	OctaveNoise_Init(&octave1, &rnd, 6);
+
+	Gen_SetState("Building heightmap");
+	Gen_RunJobs(NotchyGen_HeightmapRow, World.Length, true);
+
+	for (i = 0; i < World.Width * World.Length; i++) {
+		minHeight = min(Heightmap[i], minHeight);
+	}
+}
+
 static int NotchyGen_CreateStrataFast(void) {
 	cc_uint32 oneY = (cc_uint32)World.OneY;
 	int stoneHeight, airHeight;
 	int y;
 
 	Gen_CurrentProgress = 0.0f;
-	Gen_CurrentState    = "Filling map";
+	Gen_SetState("Filling map");
 	/* Make lava layer at bottom */
 	Mem_Set(Gen_Blocks, BLOCK_STILL_LAVA, oneY);
 
@@ -280,43 +578,48 @@ static int NotchyGen_CreateStrataFast(void) {
 	return max(stoneHeight, 1);
 }
 
-static void NotchyGen_CreateStrata(void) {
-	int dirtThickness, dirtHeight;
-	int minStoneY, stoneHeight;
-	int hIndex = 0, maxY = World.MaxY, index = 0;
-	int x, y, z;
-	struct OctaveNoise n;
-
-	/* Try to bulk fill bottom of the map if possible */
-	minStoneY = NotchyGen_CreateStrataFast();
-	OctaveNoise_Init(&n, &rnd, 8);
-
-	Gen_CurrentState = "Creating strata";
-	for (z = 0; z < World.Length; z++) {
-		Gen_CurrentProgress = (float)z / World.Length;
+static void NotchyGen_StrataRow(int z) {
+	float xs[GEN_ROW_CHUNK], noise[GEN_ROW_CHUNK];
+	int dirtThickness, dirtHeight, stoneHeight;
+	int hIndex = z * World.Width, maxY = World.MaxY, index;
+	int x, y, i = GEN_ROW_CHUNK;
+
+	for (x = 0; x < World.Width; x++, i++) {
+		if (i == GEN_ROW_CHUNK) {
+			for (i = 0; i < GEN_ROW_CHUNK; i++) { xs[i] = (float)(x + i); }
+			OctaveNoise_CalcRow(&octave1, xs, (float)z, noise, min(World.Width - x, GEN_ROW_CHUNK));
+			i = 0;
+		}
 
-		for (x = 0; x < World.Width; x++) {
-			dirtThickness = (int)(OctaveNoise_Calc(&n, (float)x, (float)z) / 24 - 4);
-			dirtHeight    = Heightmap[hIndex++];
-			stoneHeight   = dirtHeight + dirtThickness;
+		dirtThickness = (int)(noise[i] / 24 - 4);
+		dirtHeight    = Heightmap[hIndex++];
+		stoneHeight   = dirtHeight + dirtThickness;
 
-			stoneHeight = min(stoneHeight, maxY);
-			dirtHeight  = min(dirtHeight,  maxY);
+		stoneHeight = min(stoneHeight, maxY);
+		dirtHeight  = min(dirtHeight,  maxY);
 
-			index = World_Pack(x, minStoneY, z);
-			for (y = minStoneY; y <= stoneHeight; y++) {
-				Gen_Blocks[index] = BLOCK_STONE; index += World.OneY;
-			}
+		index = World_Pack(x, minStoneY, z);
+		for (y = minStoneY; y <= stoneHeight; y++) {
+			Gen_Blocks[index] = BLOCK_STONE; index += World.OneY;
+		}
 
-			stoneHeight = max(stoneHeight, 0);
-			index = World_Pack(x, (stoneHeight + 1), z);
-			for (y = stoneHeight + 1; y <= dirtHeight; y++) {
-				Gen_Blocks[index] = BLOCK_DIRT; index += World.OneY;
-			}
+		stoneHeight = max(stoneHeight, 0);
+		index = World_Pack(x, (stoneHeight + 1), z);
+		for (y = stoneHeight + 1; y <= dirtHeight; y++) {
+			Gen_Blocks[index] = BLOCK_DIRT; index += World.OneY;
 		}
 	}
 }
 
+static void NotchyGen_CreateStrata(void) {
+	/* Try to bulk fill bottom of the map if possible */
+	minStoneY = NotchyGen_CreateStrataFast();
+	OctaveNoise_Init(&octave1, &rnd, 8);
+
+	Gen_SetState("Creating strata");
+	Gen_RunJobs(NotchyGen_StrataRow, World.Length, true);
+}
+
 static void NotchyGen_CarveCaves(void) {
 	int cavesCount, caveLen;
 	float caveX, caveY, caveZ;
@@ -325,8 +628,9 @@ static void NotchyGen_CarveCaves(void) {
 	int cenX, cenY, cenZ;
 	int i, j;
 
-	cavesCount       = World.Volume / 8192;
-	Gen_CurrentState = "Carving caves";
+	cavesCount = World.Volume / 8192;
+	batchBlock = BLOCK_AIR;
+	Gen_SetState("Carving caves");
 	for (i = 0; i < cavesCount; i++) {
 		Gen_CurrentProgress = (float)i / cavesCount;
 
@@ -357,9 +661,10 @@ static void NotchyGen_CarveCaves(void) {
 			radius = (World.Height - cenY) / (float)World.Height;
 			radius = 1.2f + (radius * 3.5f + 1.0f) * caveRadius;
 			radius = radius * Math_SinF(j * MATH_PI / caveLen);
-			NotchyGen_FillOblateSpheroid(cenX, cenY, cenZ, radius, BLOCK_AIR);
+			NotchyGen_AddSpheroid(cenX, cenY, cenZ, radius);
 		}
 	}
+	NotchyGen_FlushBatch(NotchyGen_FillSpheroidSlab);
 }
 
 static void NotchyGen_CarveOreVeins(float abundance, const char* state, BlockRaw block) {
@@ -369,8 +674,9 @@ static void NotchyGen_CarveOreVeins(float abundance, const char* state, BlockRaw
 	float radius;
 	int i, j;
 
-	numVeins         = (int)(World.Volume * abundance / 16384);
-	Gen_CurrentState = state;
+	numVeins   = (int)(World.Volume * abundance / 16384);
+	batchBlock = block;
+	Gen_SetState(state);
 	for (i = 0; i < numVeins; i++) {
 		Gen_CurrentProgress = (float)i / numVeins;
 
@@ -393,35 +699,29 @@ static void NotchyGen_CarveOreVeins(float abundance, const char* state, BlockRaw
 			deltaPhi   = deltaPhi   * 0.9f + Random_Float(&rnd) - Random_Float(&rnd);
 
 			radius = abundance * Math_SinF(j * MATH_PI / veinLen) + 1.0f;
-			NotchyGen_FillOblateSpheroid((int)veinX, (int)veinY, (int)veinZ, radius, block);
+			NotchyGen_AddSpheroid((int)veinX, (int)veinY, (int)veinZ, radius);
 		}
 	}
+	NotchyGen_FlushBatch(NotchyGen_FillSpheroidSlab);
 }
 
 static void NotchyGen_FloodFillWaterBorders(void) {
 	int waterY = waterLevel - 1;
-	int index1, index2;
 	int x, z;
-	Gen_CurrentState = "Flooding edge water";
+	Gen_SetState("Flooding edge water");
 
-	index1 = World_Pack(0, waterY, 0);
-	index2 = World_Pack(0, waterY, World.Length - 1);
 	for (x = 0; x < World.Width; x++) {
 		Gen_CurrentProgress = 0.0f + ((float)x / World.Width) * 0.5f;
 
-		NotchyGen_FloodFill(index1, BLOCK_STILL_WATER);
-		NotchyGen_FloodFill(index2, BLOCK_STILL_WATER);
-		index1++; index2++;
+		NotchyGen_FloodFill(x, waterY, 0,          BLOCK_STILL_WATER);
+		NotchyGen_FloodFill(x, waterY, World.MaxZ, BLOCK_STILL_WATER);
 	}
 
-	index1 = World_Pack(0,             waterY, 0);
-	index2 = World_Pack(World.Width - 1, waterY, 0);
 	for (z = 0; z < World.Length; z++) {
 		Gen_CurrentProgress = 0.5f + ((float)z / World.Length) * 0.5f;
 
-		NotchyGen_FloodFill(index1, BLOCK_STILL_WATER);
-		NotchyGen_FloodFill(index2, BLOCK_STILL_WATER);
-		index1 += World.Width; index2 += World.Width;
+		NotchyGen_FloodFill(0,          waterY, z, BLOCK_STILL_WATER);
+		NotchyGen_FloodFill(World.MaxX, waterY, z, BLOCK_STILL_WATER);
 	}
 }
 
@@ -429,15 +729,15 @@ static void NotchyGen_FloodFillWater(void) {
 	int numSources;
 	int i, x, y, z;
 
-	numSources       = World.Width * World.Length / 800;
-	Gen_CurrentState = "Flooding water";
+	numSources = World.Width * World.Length / 800;
+	Gen_SetState("Flooding water");
 	for (i = 0; i < numSources; i++) {
 		Gen_CurrentProgress = (float)i / numSources;
 
 		x = Random_Next(&rnd, World.Width);
 		z = Random_Next(&rnd, World.Length);
 		y = waterLevel - Random_Range(&rnd, 1, 3);
-		NotchyGen_FloodFill(World_Pack(x, y, z), BLOCK_STILL_WATER);
+		NotchyGen_FloodFill(x, y, z, BLOCK_STILL_WATER);
 	}
 }
 
@@ -445,57 +745,56 @@ static void NotchyGen_FloodFillLava(void) {
 	int numSources;
 	int i, x, y, z;
 
-	numSources       = World.Width * World.Length / 20000;
-	Gen_CurrentState = "Flooding lava";
+	numSources = World.Width * World.Length / 20000;
+	Gen_SetState("Flooding lava");
 	for (i = 0; i < numSources; i++) {
 		Gen_CurrentProgress = (float)i / numSources;
 
 		x = Random_Next(&rnd, World.Width);
 		z = Random_Next(&rnd, World.Length);
 		y = (int)((waterLevel - 3) * Random_Float(&rnd) * Random_Float(&rnd));
-		NotchyGen_FloodFill(World_Pack(x, y, z), BLOCK_STILL_LAVA);
+		NotchyGen_FloodFill(x, y, z, BLOCK_STILL_LAVA);
 	}
 }
 
-static void NotchyGen_CreateSurfaceLayer(void) {	
-	int hIndex = 0, index;
+static void NotchyGen_SurfaceRow(int z) {
+	int hIndex = z * World.Width, index;
 	BlockRaw above;
-	int x, y, z;
-	struct OctaveNoise n1, n2;
-
-	OctaveNoise_Init(&n1, &rnd, 8);
-	OctaveNoise_Init(&n2, &rnd, 8);
+	int x, y;
 
-	Gen_CurrentState = "Creating surface";
-	for (z = 0; z < World.Length; z++) {
-		Gen_CurrentProgress = (float)z / World.Length;
-
-		for (x = 0; x < World.Width; x++) {
-			y = Heightmap[hIndex++];
-			if (y < 0 || y >= World.Height) continue;
+	for (x = 0; x < World.Width; x++) {
+		y = Heightmap[hIndex++];
+		if (y < 0 || y >= World.Height) continue;
 
-			index = World_Pack(x, y, z);
-			above = y >= World.MaxY ? BLOCK_AIR : Gen_Blocks[index + World.OneY];
+		index = World_Pack(x, y, z);
+		above = y >= World.MaxY ? BLOCK_AIR : Gen_Blocks[index + World.OneY];
 
-			/* TODO: update heightmap */
-			if (above == BLOCK_STILL_WATER && (OctaveNoise_Calc(&n2, (float)x, (float)z) > 12)) {
-				Gen_Blocks[index] = BLOCK_GRAVEL;
-			} else if (above == BLOCK_AIR) {
-				Gen_Blocks[index] = (y <= waterLevel && (OctaveNoise_Calc(&n1, (float)x, (float)z) > 8)) ? BLOCK_SAND : BLOCK_GRASS;
-			}
+		/* TODO: update heightmap */
+		if (above == BLOCK_STILL_WATER && (OctaveNoise_Calc(&octave2, (float)x, (float)z) > 12)) {
+			Gen_Blocks[index] = BLOCK_GRAVEL;
+		} else if (above == BLOCK_AIR) {
+			Gen_Blocks[index] = (y <= waterLevel && (OctaveNoise_Calc(&octave1, (float)x, (float)z) > 8)) ? BLOCK_SAND : BLOCK_GRASS;
 		}
 	}
 }
 
+static void NotchyGen_CreateSurfaceLayer(void) {
+	OctaveNoise_Init(&octave1, &rnd, 8);
+	OctaveNoise_Init(&octave2, &rnd, 8);
+
+	Gen_SetState("Creating surface");
+	Gen_RunJobs(NotchyGen_SurfaceRow, World.Length, true);
+}
+
 static void NotchyGen_PlantFlowers(void) {
 	int numPatches;
 	BlockRaw block;
 	int patchX,  patchZ;
 	int flowerX, flowerY, flowerZ;
-	int i, j, k, index;
+	int i, j, k;
 
-	numPatches       = World.Width * World.Length / 3000;
-	Gen_CurrentState = "Planting flowers";
+	numPatches = World.Width * World.Length / 3000;
+	Gen_SetState("Planting flowers");
 	for (i = 0; i < numPatches; i++) {
 		Gen_CurrentProgress = (float)i / numPatches;
 
@@ -513,12 +812,11 @@ static void NotchyGen_PlantFlowers(void) {
 				flowerY = Heightmap[flowerZ * World.Width + flowerX] + 1;
 				if (flowerY <= 0 || flowerY >= World.Height) continue;
 
-				index = World_Pack(flowerX, flowerY, flowerZ);
-				if (Gen_Blocks[index] == BLOCK_AIR && Gen_Blocks[index - World.OneY] == BLOCK_GRASS)
-					Gen_Blocks[index] = block;
+				NotchyGen_AddPlant(flowerX, flowerY, flowerZ, block, BLOCK_GRASS);
 			}
 		}
 	}
+	NotchyGen_FlushBatch(NotchyGen_PlacePlantSlab);
 }
 
 static void NotchyGen_PlantMushrooms(void) {
@@ -526,10 +824,10 @@ static void NotchyGen_PlantMushrooms(void) {
 	BlockRaw block;
 	int patchX, patchY, patchZ;
 	int mushX,  mushY,  mushZ;
-	int i, j, k, index;
+	int i, j, k;
 
-	numPatches       = World.Volume / 2000;
-	Gen_CurrentState = "Planting mushrooms";
+	numPatches = World.Volume / 2000;
+	Gen_SetState("Planting mushrooms");
 	for (i = 0; i < numPatches; i++) {
 		Gen_CurrentProgress = (float)i / numPatches;
 
@@ -548,12 +846,11 @@ static void NotchyGen_PlantMushrooms(void) {
 				groundHeight = Heightmap[mushZ * World.Width + mushX];
 				if (mushY >= (groundHeight - 1)) continue;
 
-				index = World_Pack(mushX, mushY, mushZ);
-				if (Gen_Blocks[index] == BLOCK_AIR && Gen_Blocks[index - World.OneY] == BLOCK_STONE)
-					Gen_Blocks[index] = block;
+				NotchyGen_AddPlant(mushX, mushY, mushZ, block, BLOCK_STONE);
 			}
 		}
 	}
+	NotchyGen_FlushBatch(NotchyGen_PlacePlantSlab);
 }
 
 static void NotchyGen_PlantTrees(void) {
@@ -570,8 +867,8 @@ static void NotchyGen_PlantTrees(void) {
 	Tree_Blocks = Gen_Blocks;
 	Tree_Rnd    = &rnd;
 
-	numPatches       = World.Width * World.Length / 4000;
-	Gen_CurrentState = "Planting trees";
+	numPatches = World.Width * World.Length / 4000;
+	Gen_SetState("Planting trees");
 	for (i = 0; i < numPatches; i++) {
 		Gen_CurrentProgress = (float)i / numPatches;
 
@@ -608,6 +905,7 @@ static void NotchyGen_PlantTrees(void) {
 void NotchyGen_Generate(void) {
 	Gen_Init();
 	Heightmap = (cc_int16*)Mem_Alloc(World.Width * World.Length, 2, "gen heightmap");
+	batch     = (union GenBatchEntry*)Mem_Alloc(GEN_BATCH_SIZE, sizeof(union GenBatchEntry), "gen batch");
 
 	Random_Seed(&rnd, Gen_Seed);
 	waterLevel = World.Height / 2;	
@@ -630,7 +928,9 @@ void NotchyGen_Generate(void) {
 	NotchyGen_PlantTrees();
 
 	Mem_Free(Heightmap);
+	Mem_Free(batch);
 	Heightmap = NULL;
+	batch     = NULL;
 	Gen_Done  = true;
 }
 
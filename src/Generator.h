@@ -18,6 +18,11 @@ extern int Gen_Seed;
 extern cc_bool Gen_Vanilla;
 extern BlockRaw* Gen_Blocks;
 
+typedef void (*Gen_StateCallback)(const char* state);
+/* Called on the generating thread whenever the generator starts a new step. Can be NULL. */
+/* NOTE: The game just polls Gen_CurrentState, this is only needed for timing each step exactly. */
+extern Gen_StateCallback Gen_StateFunc;
+
 void FlatgrassGen_Generate(void);
 void NotchyGen_Generate(void);
 
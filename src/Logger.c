@@ -65,8 +65,6 @@ static const char* GetCCErrorDesc(cc_result res) {
 	case WAV_ERR_STREAM_TYPE: return "Invalid WAV type";
 	case WAV_ERR_DATA_TYPE:   return "Unsupported WAV audio format";
 
-	case ZIP_ERR_TOO_MANY_ENTRIES: return "Cannot load .zip files with over 1024 entries";
-
 	case PNG_ERR_INVALID_SIG:      return "Only PNG images supported";
 	case PNG_ERR_INVALID_HDR_SIZE: return "Invalid PNG header size";
 	case PNG_ERR_TOO_WIDE:         return "PNG image too wide";
@@ -80,6 +78,11 @@ static const char* GetCCErrorDesc(cc_result res) {
 	case CW_ERR_ROOT_TAG:   return "Invalid root NBT tag";
 	case CW_ERR_STRING_LEN: return "NBT string too long";
 
+	case CCR_ERR_IDENTIFIER: return "Invalid region map identifier";
+	case CCR_ERR_VERSION:    return "Unsupported region map version";
+	case CCR_ERR_REGION:     return "Invalid region map index";
+	case CCR_ERR_JOURNAL:    return "Invalid region map journal";
+
 	case ERR_DOWNLOAD_INVALID: return "Website denied download or doesn't exist";
 	case ERR_NO_AUDIO_OUTPUT:  return "No audio output devices plugged in";
 	case ERR_INVALID_DATA_URL: return "Cannot download from invalid URL";
@@ -1281,17 +1281,18 @@ void ClassicGenScreen_Show(void) {
 static struct SaveLevelScreen {
 	Screen_Body
 	struct FontDesc titleFont, textFont;
-	struct ButtonWidget save, alt, cancel;
+	struct ButtonWidget save, alt, region, cancel;
 	struct TextInputWidget input;
 	struct TextWidget mcEdit, desc;
 } SaveLevelScreen;
 
-static struct Widget* save_widgets[6] = {
+static struct Widget* save_widgets[7] = {
 	(struct Widget*)&SaveLevelScreen.save,   (struct Widget*)&SaveLevelScreen.alt,
-	(struct Widget*)&SaveLevelScreen.mcEdit, (struct Widget*)&SaveLevelScreen.cancel,
+	(struct Widget*)&SaveLevelScreen.mcEdit, (struct Widget*)&SaveLevelScreen.region,
+	(struct Widget*)&SaveLevelScreen.cancel,
 	(struct Widget*)&SaveLevelScreen.input,  (struct Widget*)&SaveLevelScreen.desc,
 };
-#define SAVE_MAX_VERTICES (3 * BUTTONWIDGET_MAX + MENUINPUTWIDGET_MAX + 2 * TEXTWIDGET_MAX)
+#define SAVE_MAX_VERTICES (4 * BUTTONWIDGET_MAX + MENUINPUTWIDGET_MAX + 2 * TEXTWIDGET_MAX)
 
 static void SaveLevelScreen_UpdateSave(struct SaveLevelScreen* s) {
 	ButtonWidget_SetConst(&s->save, 
@@ -1307,6 +1308,13 @@ static void SaveLevelScreen_UpdateAlt(struct SaveLevelScreen* s) {
 #endif
 }
 
+static void SaveLevelScreen_UpdateRegion(struct SaveLevelScreen* s) {
+#ifndef CC_BUILD_WEB
+	ButtonWidget_SetConst(&s->region,
+		s->region.optName ? "&cOverwrite existing?" : "Save region map", &s->titleFont);
+#endif
+}
+
 static void SaveLevelScreen_RemoveOverwrites(struct SaveLevelScreen* s) {
 	if (s->save.optName) {
 		s->save.optName = NULL;
@@ -1316,6 +1324,10 @@ static void SaveLevelScreen_RemoveOverwrites(struct SaveLevelScreen* s) {
 		s->alt.optName = NULL;
 		SaveLevelScreen_UpdateAlt(s);
 	}
+	if (s->region.optName) {
+		s->region.optName = NULL;
+		SaveLevelScreen_UpdateRegion(s);
+	}
 }
 
 #ifdef CC_BUILD_WEB
@@ -1342,6 +1354,7 @@ static void DownloadMap(const cc_string* path) {
 }
 #endif
 
+#ifdef CC_BUILD_WEB
 static void SaveLevelScreen_SaveMap(struct SaveLevelScreen* s, const cc_string* path) {
 	static const cc_string cw = String_FromConst(".cw");
 	struct Stream stream, compStream;
@@ -1350,19 +1363,12 @@ static void SaveLevelScreen_SaveMap(struct SaveLevelScreen* s, const cc_string*
 
 	res = Stream_CreateFile(&stream, path);
 	if (res) { Logger_SysWarn2(res, "creating", path); return; }
-	GZip_MakeStream(&compStream, &state, &stream);
+	GZip_MakeParallelStream(&compStream, &state, &stream);
 
-#ifdef CC_BUILD_WEB
 	res = Cw_Save(&compStream);
-#else
-	if (String_CaselessEnds(path, &cw)) {
-		res = Cw_Save(&compStream);
-	} else {
-		res = Schematic_Save(&compStream);
-	}
-#endif
-
 	if (res) {
+		/* Still need to close to free the compressor threads */
+		compStream.Close(&compStream);
 		stream.Close(&stream);
 		Logger_SysWarn2(res, "encoding", path); return;
 	}
@@ -1375,18 +1381,34 @@ static void SaveLevelScreen_SaveMap(struct SaveLevelScreen* s, const cc_string*
 	res = stream.Close(&stream);
 	if (res) { Logger_SysWarn2(res, "closing", path); return; }
 
-#ifdef CC_BUILD_WEB
 	if (String_CaselessEnds(path, &cw)) {
 		Chat_Add1("&eSaved map to: %s", path);
 	} else {
 		DownloadMap(path);
 	}
+	World.LastSave = Game.Time;
+	Gui_ShowPauseMenu();
+}
 #else
-	Chat_Add1("&eSaved map to: %s", path);
-#endif
+static void SaveLevelScreen_SaveMap(struct SaveLevelScreen* s, const cc_string* path) {
+	static const cc_string cw  = String_FromConst(".cw");
+	static const cc_string ccr = String_FromConst(".ccr");
+	IMapExporter exporter = Schematic_Save;
+	cc_result res;
+	if (String_CaselessEnds(path, &cw)) exporter = Cw_Save;
+
+	/* Blocks are compressed and written to disc in the background */
+	if (String_CaselessEnds(path, &ccr)) {
+		res = Ccr_SaveTo(path);
+	} else {
+		res = Map_SaveTo(path, exporter);
+	}
+
+	if (res) return;
 	World.LastSave = Game.Time;
 	Gui_ShowPauseMenu();
 }
+#endif
 
 static void SaveLevelScreen_Save(void* screen, void* widget, const char* fmt) {
 	cc_string path; char pathBuffer[FILENAME_SIZE];
@@ -1407,6 +1429,7 @@ static void SaveLevelScreen_Save(void* screen, void* widget, const char* fmt) {
 		btn->optName = "";
 		SaveLevelScreen_UpdateSave(s);
 		SaveLevelScreen_UpdateAlt(s);
+		SaveLevelScreen_UpdateRegion(s);
 	} else {
 		SaveLevelScreen_RemoveOverwrites(s);
 		SaveLevelScreen_SaveMap(s, &path);
@@ -1418,6 +1441,7 @@ static void SaveLevelScreen_Main(void* a, void* b) { SaveLevelScreen_Save(a, b,
 static void SaveLevelScreen_Alt(void* a, void* b)  { SaveLevelScreen_Save(a, b, "/%s.tmpmap"); }
 #else
 static void SaveLevelScreen_Alt(void* a, void* b)  { SaveLevelScreen_Save(a, b, "maps/%s.schematic"); }
+static void SaveLevelScreen_Region(void* a, void* b) { SaveLevelScreen_Save(a, b, "maps/%s.ccr"); }
 #endif
 
 static void SaveLevelScreen_Render(void* screen, double delta) {
@@ -1471,6 +1495,7 @@ static void SaveLevelScreen_ContextRecreated(void* screen) {
 	Screen_UpdateVb(screen);
 	SaveLevelScreen_UpdateSave(s);
 	SaveLevelScreen_UpdateAlt(s);
+	SaveLevelScreen_UpdateRegion(s);
 
 #ifndef CC_BUILD_WEB
 	TextWidget_SetConst(&s->mcEdit,   "&eCan be imported into MCEdit", &s->textFont);
@@ -1490,8 +1515,9 @@ static void SaveLevelScreen_Layout(void* screen) {
 #ifdef CC_BUILD_WEB
 	Widget_SetLocation(&s->alt,    ANCHOR_CENTRE, ANCHOR_CENTRE,    0,  70);
 #else
-	Widget_SetLocation(&s->alt,    ANCHOR_CENTRE, ANCHOR_CENTRE, -150, 120);
-	Widget_SetLocation(&s->mcEdit, ANCHOR_CENTRE, ANCHOR_CENTRE,  110, 120);
+	Widget_SetLocation(&s->alt,    ANCHOR_CENTRE, ANCHOR_CENTRE, -110, 120);
+	Widget_SetLocation(&s->region, ANCHOR_CENTRE, ANCHOR_CENTRE,  110, 120);
+	Widget_SetLocation(&s->mcEdit, ANCHOR_CENTRE, ANCHOR_CENTRE, -110, 155);
 #endif
 
 	Menu_LayoutBack(&s->cancel);
@@ -1516,8 +1542,10 @@ static void SaveLevelScreen_Init(void* screen) {
 #ifdef CC_BUILD_WEB
 	ButtonWidget_Init(&s->alt,  300, SaveLevelScreen_Alt);
 	s->widgets[2] = NULL; /* null mcEdit widget */
+	s->widgets[3] = NULL; /* null region widget */
 #else
-	ButtonWidget_Init(&s->alt,  200, SaveLevelScreen_Alt);
+	ButtonWidget_Init(&s->alt,    200, SaveLevelScreen_Alt);
+	ButtonWidget_Init(&s->region, 200, SaveLevelScreen_Region);
 	TextWidget_Init(&s->mcEdit);
 #endif
 
@@ -1775,7 +1803,7 @@ static void LoadLevelScreen_LoadEntries(struct ListScreen* s) {
 static void LoadLevelScreen_UploadCallback(const cc_string* path) { Map_LoadFrom(path); }
 static void LoadLevelScreen_UploadFunc(void* s, void* w) {
 	static const char* const filters[] = { 
-		".cw", ".dat", ".lvl", ".mine", ".fcm", NULL 
+		".cw", ".dat", ".lvl", ".mine", ".fcm", ".ccr", NULL 
 	};
 	cc_result res = Window_OpenFileDialog(filters, LoadLevelScreen_UploadCallback);
 	if (res) Logger_SimpleWarn(res, "showing open file dialog");
@@ -476,15 +476,18 @@ void Model_RegisterTexture(struct ModelTex* tex) {
 	LinkedList_Append(tex, textures_head, textures_tail);
 }
 
-static void Models_TextureChanged(void* obj, struct Stream* stream, const cc_string* name) {
+struct ModelTex* Model_GetTexture(const cc_string* name) {
 	struct ModelTex* tex;
 
 	for (tex = textures_head; tex; tex = tex->next) {
-		if (!String_CaselessEqualsConst(name, tex->name)) continue;
-
-		Game_UpdateTexture(&tex->texID, stream, name, &tex->skinType);
-		return;
+		if (String_CaselessEqualsConst(name, tex->name)) return tex;
 	}
+	return NULL;
+}
+
+static void Models_TextureChanged(void* obj, struct Stream* stream, const cc_string* name) {
+	struct ModelTex* tex = Model_GetTexture(name);
+	if (tex) Game_UpdateTexture(&tex->texID, stream, name, &tex->skinType);
 }
 
 
@@ -148,6 +148,8 @@ void Model_Unregister(struct Model* model);
 /* Adds a texture to the list of automatically managed model textures. */
 /* These textures are automatically loaded from texture packs. (e.g. "skeleton.png") */
 CC_API void Model_RegisterTexture(struct ModelTex* tex);
+/* Returns a pointer to the model texture whose name caselessly matches given name. */
+struct ModelTex* Model_GetTexture(const cc_string* name);
 
 /* Describes data for a box being built. */
 struct BoxDesc {
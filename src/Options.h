@@ -75,6 +75,7 @@ Copyright 2014-2022 ClassiCube | Licensed under BSD-3
 #define OPT_SKIN_SERVER "http-skinserver"
 #define OPT_RAW_INPUT "win-raw-input"
 #define OPT_DPI_SCALING "win-dpi-scaling"
+#define OPT_AUTOSAVE_INTERVAL "autosave-interval"
 
 #define LOPT_SESSION  "launcher-session"
 #define LOPT_USERNAME "launcher-cc-username"
@@ -185,6 +185,8 @@ cc_result File_Read(cc_file file, void* data, cc_uint32 count, cc_uint32* bytesR
 cc_result File_Write(cc_file file, const void* data, cc_uint32 count, cc_uint32* bytesWrote);
 /* Attempts to close the given file. */
 cc_result File_Close(cc_file file);
+/* Attempts to ensure all data written to the given file has actually been written to disk. */
+cc_result File_Flush(cc_file file);
 /* Attempts to seek to a position in the given file. */
 cc_result File_Seek(cc_file file, int offset, int seekType);
 /* Attempts to get the current position in the given file. */
@@ -204,6 +206,8 @@ CC_API void Thread_Detach(void* handle);
 /* Blocks the current thread, until the given thread has finished. */
 /* NOTE: This cannot be used on a thread that has been detached. */
 CC_API void Thread_Join(void* handle);
+/* Returns the number of threads that this machine can run at the same time. (1 if unknown) */
+int Thread_ProcessorCount(void);
 
 /* Allocates a new mutex. (used to synchronise access to a shared resource) */
 CC_API void* Mutex_Create(void);
@@ -248,6 +252,16 @@ CC_API void Socket_Close(cc_socket s);
 /* NOTE: A socket is considered writable once it has finished connecting. */
 CC_API cc_result Socket_Poll(cc_socket s, int mode, cc_bool* success);
 
+/* Creates a handle that can be used to wake up a thread blocked in Socket_WaitFor. */
+CC_API void* SocketWaker_Create(void);
+/* Frees a handle previously created using SocketWaker_Create. */
+CC_API void  SocketWaker_Free(void* handle);
+/* Wakes up the thread blocked in Socket_WaitFor, or causes its next call to return immediately. */
+CC_API void  SocketWaker_Wake(void* handle);
+/* Blocks the calling thread until the socket is readable (if reading) or writable (if writing), */
+/*  the waker is woken up, or milliseconds delay passes. */
+CC_API cc_result Socket_WaitFor(cc_socket s, cc_bool reading, cc_bool writing, void* waker, cc_uint32 milliseconds);
+
 #ifdef CC_BUILD_MOBILE
 void Platform_ShareScreenshot(const cc_string* filename);
 #endif
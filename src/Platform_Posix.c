@@ -245,6 +245,10 @@ cc_result File_Close(cc_file file) {
 	return close(file) == -1 ? errno : 0;
 }
 
+cc_result File_Flush(cc_file file) {
+	return fsync(file) == -1 ? errno : 0;
+}
+
 cc_result File_Seek(cc_file file, int offset, int seekType) {
 	static cc_uint8 modes[3] = { SEEK_SET, SEEK_CUR, SEEK_END };
 	return lseek(file, offset, modes[seekType]) == -1 ? errno : 0;
@@ -306,6 +310,15 @@ void Thread_Join(void* handle) {
 	Mem_Free(ptr);
 }
 
+int Thread_ProcessorCount(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+#else
+	return 1;
+#endif
+}
+
 void* Mutex_Create(void) {
 	pthread_mutex_t* ptr = (pthread_mutex_t*)Mem_Alloc(1, sizeof(pthread_mutex_t), "mutex");
 	int res = pthread_mutex_init(ptr, NULL);
@@ -561,6 +574,36 @@ void Socket_Close(cc_socket s) {
 	close(s);
 }
 
+/* Waker is a pipe, so that the waiting thread can poll it alongside the socket */
+void* SocketWaker_Create(void) {
+	int* fds = (int*)Mem_Alloc(2, sizeof(int), "socket waker");
+	if (pipe(fds) == -1) Logger_Abort2(errno, "Creating socket waker");
+
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+	return fds;
+}
+
+void SocketWaker_Free(void* handle) {
+	int* fds = (int*)handle;
+	close(fds[0]);
+	close(fds[1]);
+	Mem_Free(fds);
+}
+
+void SocketWaker_Wake(void* handle) {
+	int* fds = (int*)handle;
+	cc_uint8 value = 0;
+	/* Pipe being full doesn't matter, as the waiting thread will be woken up anyways */
+	ssize_t res = write(fds[1], &value, 1);
+	(void)res;
+}
+
+static void SocketWaker_Drain(int fd) {
+	cc_uint8 buffer[64];
+	while (read(fd, buffer, sizeof(buffer)) > 0) { }
+}
+
 #if defined CC_BUILD_DARWIN
 /* poll is broken on old OSX apparently https://daniel.haxx.se/docs/poll-vs-select.html */
 cc_result Socket_Poll(cc_socket s, int mode, cc_bool* success) {
@@ -580,6 +623,27 @@ cc_result Socket_Poll(cc_socket s, int mode, cc_bool* success) {
 	if (selectCount == -1) { *success = false; return errno; }
 	*success = FD_ISSET(s, &set) != 0; return 0;
 }
+
+cc_result Socket_WaitFor(cc_socket s, cc_bool reading, cc_bool writing, void* waker, cc_uint32 milliseconds) {
+	int* fds = (int*)waker;
+	fd_set readSet, writeSet;
+	struct timeval time;
+
+	time.tv_sec  = milliseconds / 1000;
+	time.tv_usec = (milliseconds % 1000) * 1000;
+	FD_ZERO(&readSet);
+	FD_ZERO(&writeSet);
+
+	FD_SET(fds[0], &readSet);
+	if (reading) FD_SET(s, &readSet);
+	if (writing) FD_SET(s, &writeSet);
+
+	if (select(max(s, fds[0]) + 1, &readSet, &writeSet, NULL, &time) == -1) {
+		return errno == EINTR ? 0 : errno;
+	}
+	if (FD_ISSET(fds[0], &readSet)) SocketWaker_Drain(fds[0]);
+	return 0;
+}
 #else
 #include <poll.h>
 cc_result Socket_Poll(cc_socket s, int mode, cc_bool* success) {
@@ -595,6 +659,23 @@ cc_result Socket_Poll(cc_socket s, int mode, cc_bool* success) {
 	*success = (pfd.revents & flags) != 0;
 	return 0;
 }
+
+cc_result Socket_WaitFor(cc_socket s, cc_bool reading, cc_bool writing, void* waker, cc_uint32 milliseconds) {
+	int* fds = (int*)waker;
+	struct pollfd pfds[2];
+
+	/* Negative descriptors are ignored by poll, which avoids waking up for a closed socket when not reading */
+	pfds[0].fd     = (reading || writing) ? s : -1;
+	pfds[0].events = (reading ? POLLIN : 0) | (writing ? POLLOUT : 0);
+	pfds[1].fd     = fds[0];
+	pfds[1].events = POLLIN;
+
+	if (poll(pfds, 2, milliseconds) == -1) {
+		return errno == EINTR ? 0 : errno;
+	}
+	if (pfds[1].revents) SocketWaker_Drain(fds[0]);
+	return 0;
+}
 #endif
 
 
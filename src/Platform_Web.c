@@ -196,6 +196,9 @@ cc_result File_Close(cc_file file) {
 	return -interop_FileClose(file);
 }
 
+/* Files are stored in memory, and only persisted when the filesystem is synced */
+cc_result File_Flush(cc_file file) { return 0; }
+
 extern int interop_FileSeek(int fd, int offset, int whence);
 cc_result File_Seek(cc_file file, int offset, int seekType) {
 	static cc_uint8 modes[3] = { SEEK_SET, SEEK_CUR, SEEK_END };
@@ -235,6 +238,8 @@ void Thread_Sleep(cc_uint32 milliseconds) { }
 void* Thread_Start(Thread_StartFunc func) { func(); return NULL; }
 void Thread_Detach(void* handle) { }
 void Thread_Join(void* handle) { }
+/* Threads are just run immediately on the calling thread */
+int Thread_ProcessorCount(void) { return 1; }
 
 void* Mutex_Create(void) { return NULL; }
 void Mutex_Free(void* handle) { }
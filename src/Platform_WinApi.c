@@ -261,6 +261,10 @@ cc_result File_Close(cc_file file) {
 	return CloseHandle(file) ? 0 : GetLastError();
 }
 
+cc_result File_Flush(cc_file file) {
+	return FlushFileBuffers(file) ? 0 : GetLastError();
+}
+
 cc_result File_Seek(cc_file file, int offset, int seekType) {
 	static cc_uint8 modes[3] = { FILE_BEGIN, FILE_CURRENT, FILE_END };
 	DWORD pos = SetFilePointer(file, offset, NULL, modes[seekType]);
@@ -308,6 +312,12 @@ void Thread_Join(void* handle) {
 	Thread_Detach(handle);
 }
 
+int Thread_ProcessorCount(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors ? (int)info.dwNumberOfProcessors : 1;
+}
+
 void* Mutex_Create(void) {
 	CRITICAL_SECTION* ptr = (CRITICAL_SECTION*)Mem_Alloc(1, sizeof(CRITICAL_SECTION), "mutex");
 	InitializeCriticalSection(ptr);
@@ -398,6 +408,7 @@ static int (WSAAPI *_getsockopt)(SOCKET s, int level, int optname, char* optval,
 static int (WSAAPI *_recv)(SOCKET s, char* buf, int len, int flags);
 static int (WSAAPI *_send)(SOCKET s, const char FAR * buf, int len, int flags);
 static int (WSAAPI *_select)(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, const struct timeval* timeout);
+static int (WSAAPI *_WSAEventSelect)(SOCKET s, HANDLE event, long networkEvents);
 
 static struct hostent* (WSAAPI *_gethostbyname)(const char* name);
 static unsigned short  (WSAAPI *_htons)(u_short hostshort);
@@ -433,7 +444,8 @@ static void LoadWinsockFuncs(void) {
 		DynamicLib_Sym(connect),         DynamicLib_Sym(shutdown),
 		DynamicLib_Sym(ioctlsocket),     DynamicLib_Sym(getsockopt),
 		DynamicLib_Sym(gethostbyname),   DynamicLib_Sym(htons),
-		DynamicLib_Sym(recv), DynamicLib_Sym(send), DynamicLib_Sym(select)
+		DynamicLib_Sym(recv), DynamicLib_Sym(send), DynamicLib_Sym(select),
+		DynamicLib_Sym(WSAEventSelect)
 	};
 	static const cc_string winsock1 = String_FromConst("wsock32.DLL");
 	static const cc_string winsock2 = String_FromConst("WS2_32.DLL");
@@ -555,6 +567,52 @@ cc_result Socket_Poll(cc_socket s, int mode, cc_bool* success) {
 	*success = set.fd_count != 0; return 0;
 }
 
+/* Socket can't be waited on alongside a waitable, so instead has an event that gets signalled for the socket */
+struct SocketWaker { HANDLE wake, socket; };
+
+void* SocketWaker_Create(void) {
+	struct SocketWaker* ptr = (struct SocketWaker*)Mem_Alloc(1, sizeof(struct SocketWaker), "socket waker");
+	ptr->wake   = Waitable_Create();
+	ptr->socket = Waitable_Create();
+	return ptr;
+}
+
+void SocketWaker_Free(void* handle) {
+	struct SocketWaker* ptr = (struct SocketWaker*)handle;
+	Waitable_Free(ptr->wake);
+	Waitable_Free(ptr->socket);
+	Mem_Free(ptr);
+}
+
+void SocketWaker_Wake(void* handle) {
+	struct SocketWaker* ptr = (struct SocketWaker*)handle;
+	SetEvent(ptr->wake);
+}
+
+cc_result Socket_WaitFor(cc_socket s, cc_bool reading, cc_bool writing, void* waker, cc_uint32 milliseconds) {
+	struct SocketWaker* ptr = (struct SocketWaker*)waker;
+	HANDLE handles[2];
+	cc_bool readable = false, writable = false;
+	long events = (reading ? (FD_READ | FD_CLOSE) : 0) | (writing ? FD_WRITE : 0);
+	cc_result res;
+
+	/* FD_WRITE is only signalled after a send fails, so check the socket's current state first */
+	if (reading && (res = Socket_Poll(s, SOCKET_POLL_READ,  &readable))) return res;
+	if (writing && (res = Socket_Poll(s, SOCKET_POLL_WRITE, &writable))) return res;
+	if (readable || writable) return 0;
+
+	/* Windows 95 lacks WSAEventSelect, so just check the socket again a short while later */
+	if (!_WSAEventSelect) {
+		WaitForSingleObject(ptr->wake, min(milliseconds, 10)); return 0;
+	}
+	if (_WSAEventSelect(s, ptr->socket, events)) return _WSAGetLastError();
+
+	handles[0] = ptr->wake;
+	handles[1] = ptr->socket;
+	if (WaitForMultipleObjects(2, handles, false, milliseconds) == WAIT_FAILED) return GetLastError();
+	return 0;
+}
+
 
 /*########################################################################################################################*
 *-----------------------------------------------------Process/Module------------------------------------------------------*
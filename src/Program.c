@@ -54,6 +54,8 @@ CC_NOINLINE static void WarnMissingArgs(int argsCount, const cc_string* args) {
 
 static void SetupProgram(int argc, char** argv) {
 	static char ipBuffer[STRING_SIZE];
+	static char replayBuffer[FILENAME_SIZE];
+	static char captureBuffer[FILENAME_SIZE];
 	cc_result res;
 	Logger_Hook();
 	Platform_Init();
@@ -65,6 +67,8 @@ static void SetupProgram(int argc, char** argv) {
 	if (res) Logger_SysWarn(res, "setting current directory");
 	Platform_LogConst("Starting " GAME_APP_NAME " ..");
 	String_InitArray(Server.Address, ipBuffer);
+	String_InitArray(Net_ReplayPath, replayBuffer);
+	String_InitArray(Net_CapturePath, captureBuffer);
 }
 
 static int RunProgram(int argc, char** argv) {
@@ -94,6 +98,11 @@ static int RunProgram(int argc, char** argv) {
 	} else if (argsCount == 1) {
 		String_Copy(&Game_Username, &args[0]);
 		RunGame();		
+	/* --replay to replay a network capture, instead of connecting to a server */
+	} else if (argsCount == 3 && String_CaselessEqualsConst(&args[1], "--replay")) {
+		String_Copy(&Game_Username,  &args[0]);
+		String_Copy(&Net_ReplayPath, &args[2]);
+		RunGame();
 	} else if (argsCount < 4) {
 		WarnMissingArgs(argsCount, args);
 		return 1;
@@ -102,6 +111,11 @@ static int RunProgram(int argc, char** argv) {
 		String_Copy(&Game_Mppass,   &args[1]);
 		String_Copy(&Server.Address,&args[2]);
 
+		/* --capture to capture all data received from the server, so it can be replayed later */
+		if (argsCount == 6 && String_CaselessEqualsConst(&args[4], "--capture")) {
+			String_Copy(&Net_CapturePath, &args[5]);
+		}
+
 		if (!Convert_ParseUInt16(&args[3], &port)) {
 			WarnInvalidArg("Invalid port", &args[3]);
 			return 1;
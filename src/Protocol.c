@@ -37,6 +37,10 @@ struct _ProtocolData Protocol;
 /* Classic state */
 static cc_uint8 classic_tabList[ENTITIES_MAX_COUNT >> 3];
 static cc_bool classic_receivedFirstPos;
+/* Interpolated location updates received this network tick, that haven't been applied to entities yet */
+static struct LocationUpdate classic_pendingLocs[ENTITIES_MAX_COUNT];
+static cc_bool classic_hasPendingLoc[ENTITIES_MAX_COUNT];
+static int classic_pendingLocsCount;
 
 /* Map state */
 static cc_bool map_begunLoading;
@@ -147,11 +151,76 @@ static void CheckName(EntityID id, cc_string* name, cc_string* skin) {
 }
 
 static void Classic_ReadAbsoluteLocation(cc_uint8* data, EntityID id, cc_bool interpolate);
+
+/* Combines two location updates into one, as if they had been applied one after the other */
+static void MergeLocation(struct LocationUpdate* dst, const struct LocationUpdate* src) {
+	cc_uint8 flags = src->Flags;
+
+	if (flags & LOCATIONUPDATE_POS) {
+		if (src->RelativePos && (dst->Flags & LOCATIONUPDATE_POS)) {
+			Vec3_AddBy(&dst->Pos, &src->Pos);
+		} else {
+			dst->Pos = src->Pos; dst->RelativePos = src->RelativePos;
+		}
+	}
+	if (flags & LOCATIONUPDATE_ROTX)  dst->RotX  = src->RotX;
+	if (flags & LOCATIONUPDATE_ROTZ)  dst->RotZ  = src->RotZ;
+	if (flags & LOCATIONUPDATE_PITCH) dst->Pitch = src->Pitch;
+	if (flags & LOCATIONUPDATE_YAW)   dst->Yaw   = src->Yaw;
+	dst->Flags |= flags;
+}
+
+/* Discards any location update for the given entity that hasn't been applied yet */
+static void DropPendingLocation(EntityID id) {
+	if (!classic_hasPendingLoc[id]) return;
+	classic_hasPendingLoc[id] = false;
+	classic_pendingLocsCount--;
+}
+
+/* Servers often send multiple updates for the same entity within one network tick, */
+/*  so interpolated updates are combined and only applied once at the end of the tick */
+/*  (otherwise each update would add its own interpolation states to the entity) */
+static void UpdateLocation(EntityID id, struct LocationUpdate* update, cc_bool interpolate) {
+	struct LocationUpdate* pending = &classic_pendingLocs[id];
+	struct Entity* e = Entities.List[id];
+	if (!e) return;
+
+	/* Local player doesn't queue up interpolation states, so there's no benefit to combining */
+	if (id == ENTITIES_SELF_ID) { e->VTABLE->SetLocation(e, update, interpolate); return; }
+
+	if (!classic_hasPendingLoc[id]) {
+		classic_hasPendingLoc[id] = true;
+		classic_pendingLocsCount++;
+		pending->Flags = 0;
+	}
+	MergeLocation(pending, update);
+	if (interpolate) return;
+
+	/* Applying a non-interpolated update resets interpolation anyways, so can be applied immediately */
+	DropPendingLocation(id);
+	e->VTABLE->SetLocation(e, pending, false);
+}
+
+void Protocol_FlushLocations(void) {
+	struct Entity* e;
+	int id;
+	if (!classic_pendingLocsCount) return;
+
+	for (id = 0; id < ENTITIES_MAX_COUNT; id++) {
+		if (!classic_hasPendingLoc[id]) continue;
+		DropPendingLocation((EntityID)id);
+
+		e = Entities.List[id];
+		if (e) e->VTABLE->SetLocation(e, &classic_pendingLocs[id], true);
+	}
+}
+
 static void AddEntity(cc_uint8* data, EntityID id, const cc_string* name, const cc_string* skin, cc_bool readPosition) {
 	struct LocalPlayer* p = &LocalPlayer_Instance;
 	struct Entity* e;
 
 	if (id != ENTITIES_SELF_ID) {
+		DropPendingLocation(id);
 		if (Entities.List[id]) Entities_Remove(id);
 		e = &NetPlayers_List[id].Base;
 
@@ -175,6 +244,7 @@ static void AddEntity(cc_uint8* data, EntityID id, const cc_string* name, const
 
 void Protocol_RemoveEntity(EntityID id) {
 	struct Entity* e = Entities.List[id];
+	DropPendingLocation(id);
 	if (!e) return;
 	if (id != ENTITIES_SELF_ID) Entities_Remove(id);
 
@@ -184,11 +254,6 @@ void Protocol_RemoveEntity(EntityID id) {
 	Classic_TabList_Reset(id);
 }
 
-static void UpdateLocation(EntityID id, struct LocationUpdate* update, cc_bool interpolate) {
-	struct Entity* e = Entities.List[id];
-	if (e) { e->VTABLE->SetLocation(e, update, interpolate); }
-}
-
 static void UpdateUserType(struct HacksComp* hacks, cc_uint8 value) {
 	cc_bool isOp = value >= 100 && value <= 127;
 	hacks->IsOp  = isOp;
@@ -579,6 +644,9 @@ static void Classic_LevelFinalise(cc_uint8* data) {
 	if (cpe_extBlocks && map2.blocks) World_SetMapUpper(map2.blocks);
 	map2.blocks = NULL;
 #endif
+	/* NOTE: Although the blocks are received in Y-major order, chunks can't be meshed any earlier, */
+	/*  as the map dimensions (and hence the size of each Y layer) are only known after LevelFinalise. */
+	/*  (with FastMap, only the volume is known in advance) */
 	World_SetNewMap(map1.blocks, width, height, length);
 	map1.blocks  = NULL;
 }
@@ -737,6 +805,8 @@ static void Classic_Reset(void) {
 	Stream_ReadonlyMemory(&map_part, NULL, 0);
 	map_begunLoading = false;
 	classic_receivedFirstPos = false;
+	Mem_Set(classic_hasPendingLoc, 0, sizeof(classic_hasPendingLoc));
+	classic_pendingLocsCount = 0;
 
 	Net_Set(OPCODE_HANDSHAKE, Classic_Handshake, 131);
 	Net_Set(OPCODE_PING, Classic_Ping, 1);
@@ -763,7 +833,7 @@ static void Classic_Tick(void) {
 	if (!classic_receivedFirstPos) return;
 	/* Report end position of each physics tick, rather than current position */
 	/*  (otherwise can miss landing on a block then jumping off of it again) */
-	Classic_WritePosition(p->Interp.Next.Pos, e->Yaw, e->Pitch);
+	Server.SendPosition(p->Interp.Next.Pos, e->Yaw, e->Pitch);
 }
 
 
@@ -1329,7 +1399,7 @@ static void CPE_SetEntityProperty(cc_uint8* data) {
 	default:
 		return;
 	}
-	e->VTABLE->SetLocation(e, &update, true);
+	UpdateLocation(id, &update, true);
 }
 
 static void CPE_TwoWayPing(cc_uint8* data) {
@@ -58,6 +58,8 @@ extern struct IGameComponent Protocol_Component;
 
 void Protocol_RemoveEntity(EntityID id);
 void Protocol_Tick(void);
+/* Applies location updates for entities that were combined during the current network tick */
+void Protocol_FlushLocations(void);
 
 extern cc_bool cpe_needD3Fix;
 void Classic_SendChat(const cc_string* text, cc_bool partial);
@@ -294,7 +294,7 @@ static cc_result ZipPatcher_FixupLocalFile(struct Stream* s, struct ResourceText
 	int filenameLen = String_Length(e->filename);
 	cc_uint8 tmp[2048];
 	cc_uint32 dataBeg, dataEnd;
-	cc_uint32 i, crc, toRead, read;
+	cc_uint32 crc, toRead, read;
 	cc_result res;
 
 	dataBeg = e->offset + 30 + filenameLen;
@@ -312,9 +312,7 @@ static cc_result ZipPatcher_FixupLocalFile(struct Stream* s, struct ResourceText
 		if ((res = s->Read(s, tmp, toRead, &read))) return res;
 		if (!read) return ERR_END_OF_STREAM;
 
-		for (i = 0; i < read; i++) {
-			crc = Utils_Crc32Table[(crc ^ tmp[i]) & 0xFF] ^ (crc >> 8);
-		}
+		crc = Utils_Crc32Update(crc, tmp, read);
 	}
 	e->crc32 = crc ^ 0xffffffffUL;
 
@@ -465,14 +463,6 @@ static cc_result ModernPatcher_PatchTile(struct Stream* data, const struct TileP
 }
 
 
-static cc_bool ModernPatcher_SelectEntry(const cc_string* path) {
-	return
-		String_CaselessEqualsConst(path, "assets/minecraft/textures/environment/snow.png") ||
-		String_CaselessEqualsConst(path, "assets/minecraft/textures/entity/chicken.png")   ||
-		String_CaselessEqualsConst(path, "assets/minecraft/textures/blocks/fire_layer_1.png") ||
-		ModernPatcher_GetTile(path) != NULL;
-}
-
 static cc_result ModernPatcher_MakeAnimations(struct Stream* s, struct Stream* data) {
 	static const cc_string animsPng = String_FromConst("animations.png");
 	struct ResourceTexture* entry;
@@ -516,17 +506,36 @@ static cc_result ModernPatcher_ProcessEntry(const cc_string* path, struct Stream
 	return ModernPatcher_PatchTile(data, tile);
 }
 
+static cc_result ModernPatcher_ExtractEntry(struct ZipState* zip, const char* path) {
+	cc_string str = String_FromReadonly(path);
+	struct ZipEntry* entry = Zip_FindEntry(zip, &str);
+	/* Missing entries are ignored, same as when just extracting every entry */
+	return entry ? Zip_ExtractEntry(zip, entry) : 0;
+}
+
 static cc_result ModernPatcher_ExtractFiles(struct Stream* s) {
 	struct ZipState zip;
 	struct Stream src;
+	cc_result res;
+	int i;
 
 	Stream_ReadonlyMemory(&src, fileResources[1].data, fileResources[1].len);
 	Zip_Init(&zip, &src);
 
 	zip.obj = s;
-	zip.SelectEntry  = ModernPatcher_SelectEntry;
 	zip.ProcessEntry = ModernPatcher_ProcessEntry;
-	return Zip_Extract(&zip);
+	if ((res = Zip_ReadDirectory(&zip))) return res;
+
+	/* Only a few of the thousands of entries are needed, so look them up directly */
+	res = ModernPatcher_ExtractEntry(&zip, "assets/minecraft/textures/environment/snow.png");
+	if (!res) res = ModernPatcher_ExtractEntry(&zip, "assets/minecraft/textures/entity/chicken.png");
+	if (!res) res = ModernPatcher_ExtractEntry(&zip, "assets/minecraft/textures/blocks/fire_layer_1.png");
+
+	for (i = 0; !res && i < Array_Elems(modern_tiles); i++) {
+		res = ModernPatcher_ExtractEntry(&zip, modern_tiles[i].name);
+	}
+	Zip_Free(&zip);
+	return res;
 }
 
 #ifdef CC_BUILD_MOBILE
@@ -21,6 +21,7 @@
 #include "World.h"
 #include "Input.h"
 #include "Utils.h"
+#include "Formats.h"
 
 #define CHAT_MAX_STATUS Array_Elems(Chat_Status)
 #define CHAT_MAX_BOTTOMRIGHT Array_Elems(Chat_BottomRight)
@@ -63,6 +64,9 @@ CC_NOINLINE static cc_bool IsOnlyChatActive(void) {
 /*########################################################################################################################*
 *--------------------------------------------------------HUDScreen--------------------------------------------------------*
 *#########################################################################################################################*/
+/* Number of the most expensive packet types shown in the network statistics overlay */
+#define HUD_NET_TOP 4
+
 static struct HUDScreen {
 	Screen_Body
 	struct FontDesc font;
@@ -74,6 +78,7 @@ static struct HUDScreen {
 	float lastSpeed;
 	int lastFov;
 	struct HotbarWidget hotbar;
+	struct TextWidget netLines[1 + HUD_NET_TOP];
 } HUDScreen_Instance;
 
 static void HUDScreen_UpdateLine1(struct HUDScreen* s) {
@@ -102,6 +107,48 @@ static void HUDScreen_UpdateLine1(struct HUDScreen* s) {
 	TextWidget_Set(&s->line1, &status, &s->font);
 }
 
+/* Shows overall network usage, then the packet types that took the most time to handle in the last second */
+static void HUDScreen_UpdateNetStats(struct HUDScreen* s) {
+	cc_string status; char statusBuffer[STRING_SIZE * 2];
+	struct NetOpcodeStats* stats;
+	cc_uint8 top[HUD_NET_TOP];
+	int packets = 0, kb = 0, ms, bytes = 0, elapsed = 0;
+	int i, j, count = 0;
+
+	for (i = 0; i < 256; i++) {
+		stats    = &Net_OpcodeStats[i];
+		packets += (int)stats->countPerSec;
+		bytes   += (int)stats->bytesPerSec;
+		elapsed += (int)stats->elapsedPerSec;
+		if (!stats->countPerSec) continue;
+
+		/* Insert into list of most expensive packet types, dropping the cheapest one if full */
+		for (j = count; j > 0 && Net_OpcodeStats[top[j - 1]].elapsedPerSec < stats->elapsedPerSec; j--) {
+			if (j < HUD_NET_TOP) top[j] = top[j - 1];
+		}
+		if (j >= HUD_NET_TOP) continue;
+		top[j] = (cc_uint8)i;
+		if (count < HUD_NET_TOP) count++;
+	}
+
+	String_InitArray(status, statusBuffer);
+	kb = bytes / 1024; ms = elapsed / 1000;
+	String_Format3(&status, "Network: %i packets/s, %i KB/s, %i ms/s handling", &packets, &kb, &ms);
+	TextWidget_Set(&s->netLines[0], &status, &s->font);
+
+	for (i = 0; i < HUD_NET_TOP; i++) {
+		status.length = 0;
+		if (i < count) {
+			stats   = &Net_OpcodeStats[top[i]];
+			packets = (int)stats->countPerSec;
+			bytes   = (int)stats->bytesPerSec;
+			elapsed = (int)stats->elapsedPerSec;
+			String_Format4(&status, "  Opcode %b: %i/s, %i bytes/s, %i us/s", &top[i], &packets, &bytes, &elapsed);
+		}
+		TextWidget_Set(&s->netLines[i + 1], &status, &s->font);
+	}
+}
+
 static void HUDScreen_DrawPosition(struct HUDScreen* s) {
 	struct VertexTextured vertices[4 * 64];
 	struct VertexTextured* ptr = vertices;
@@ -167,6 +214,7 @@ static void HUDScreen_Update(void* screen, double delta) {
 	if (s->accumulator < 1.0) return;
 
 	HUDScreen_UpdateLine1(s);
+	if (Net_ShowStats) HUDScreen_UpdateNetStats(s);
 	s->accumulator = 0.0;
 	s->frames      = 0;
 	Game.ChunkUpdates = 0;
@@ -174,11 +222,16 @@ static void HUDScreen_Update(void* screen, double delta) {
 
 static void HUDScreen_ContextLost(void* screen) {
 	struct HUDScreen* s = (struct HUDScreen*)screen;
+	int i;
 	Font_Free(&s->font);
 	TextAtlas_Free(&s->posAtlas);
 	Elem_Free(&s->hotbar);
 	Elem_Free(&s->line1);
 	Elem_Free(&s->line2);
+
+	for (i = 0; i < Array_Elems(s->netLines); i++) {
+		Elem_Free(&s->netLines[i]);
+	}
 }
 
 static void HUDScreen_ContextRecreated(void* screen) {	
@@ -216,7 +269,7 @@ static void HUDScreen_Layout(void* screen) {
 	struct HUDScreen* s = (struct HUDScreen*)screen;
 	struct TextWidget* line1 = &s->line1;
 	struct TextWidget* line2 = &s->line2;
-	int posY;
+	int i, posY;
 
 	Widget_SetLocation(line1, ANCHOR_MIN, ANCHOR_MIN, 2, 2);
 	posY = line1->y + line1->height;
@@ -235,6 +288,13 @@ static void HUDScreen_Layout(void* screen) {
 
 	HUDScreen_LayoutHotbar();
 	Widget_Layout(line2);
+
+	posY = line2->yOffset + s->posAtlas.tex.Height;
+	for (i = 0; i < Array_Elems(s->netLines); i++) {
+		Widget_SetLocation(&s->netLines[i], ANCHOR_MIN, ANCHOR_MIN, 2, 0);
+		s->netLines[i].yOffset = posY + i * s->posAtlas.tex.Height;
+		Widget_Layout(&s->netLines[i]);
+	}
 }
 
 static int HUDScreen_KeyDown(void* screen, int key) {
@@ -285,14 +345,20 @@ static void HUDScreen_HacksChanged(void* obj) {
 
 static void HUDScreen_Init(void* screen) {
 	struct HUDScreen* s = (struct HUDScreen*)screen;
+	int i;
 	HotbarWidget_Create(&s->hotbar);
 	TextWidget_Init(&s->line1);
 	TextWidget_Init(&s->line2);
+
+	for (i = 0; i < Array_Elems(s->netLines); i++) {
+		TextWidget_Init(&s->netLines[i]);
+	}
 	Event_Register_(&UserEvents.HacksStateChanged, screen, HUDScreen_HacksChanged);
 }
 
 static void HUDScreen_Render(void* screen, double delta) {
 	struct HUDScreen* s = (struct HUDScreen*)screen;
+	int i;
 	if (Game_HideGui) return;
 
 	/* TODO: If Game_ShowFps is off and not classic mode, we should just return here */
@@ -307,6 +373,12 @@ static void HUDScreen_Render(void* screen, double delta) {
 		Elem_Render(&s->line2, delta);
 	}
 
+	if (Net_ShowStats) {
+		for (i = 0; i < Array_Elems(s->netLines); i++) {
+			Elem_Render(&s->netLines[i], delta);
+		}
+	}
+
 	if (!Gui_GetBlocksWorld()) Elem_Render(&s->hotbar, delta);
 	Gfx_SetTexturing(false);
 }
@@ -1816,6 +1888,38 @@ void GeneratingScreen_Show(void) {
 }
 
 
+/*########################################################################################################################*
+*-------------------------------------------------MapImportingScreen------------------------------------------------------*
+*#########################################################################################################################*/
+static void MapImportingScreen_Init(void* screen) {
+	LoadingScreen_Init(screen);
+	Event_Register_(&TextureEvents.AtlasChanged,   NULL, GeneratingScreen_AtlasChanged);
+}
+
+static void MapImportingScreen_Render(void* screen, double delta) {
+	struct LoadingScreen* s = (struct LoadingScreen*)screen;
+	s->progress = Map_ImportProgress;
+	LoadingScreen_Render(s, delta);
+	if (Map_ImportDone) Map_EndImport();
+}
+
+static const struct ScreenVTABLE MapImportingScreen_VTABLE = {
+	MapImportingScreen_Init,   Screen_NullUpdate, GeneratingScreen_Free,
+	MapImportingScreen_Render, LoadingScreen_BuildMesh,
+	Screen_TInput,             Screen_InputUp,    Screen_TKeyPress,   Screen_TText,
+	Screen_TPointer,           Screen_PointerUp,  Screen_FPointer,    Screen_TMouseScroll,
+	LoadingScreen_Layout, LoadingScreen_ContextLost, LoadingScreen_ContextRecreated
+};
+void MapImportingScreen_Show(const cc_string* path) {
+	static const cc_string title = String_FromConst("Loading level");
+	cc_string file = *path;
+	Utils_UNSAFE_GetFilename(&file);
+
+	LoadingScreen.VTABLE = &MapImportingScreen_VTABLE;
+	LoadingScreen_ShowCommon(&title, &file);
+}
+
+
 /*########################################################################################################################*
 *----------------------------------------------------DisconnectScreen-----------------------------------------------------*
 *#########################################################################################################################*/
@@ -27,6 +27,7 @@ void InventoryScreen_Show(void);
 void HUDScreen_Show(void);
 void LoadingScreen_Show(const cc_string* title, const cc_string* message);
 void GeneratingScreen_Show(void);
+void MapImportingScreen_Show(const cc_string* path);
 void ChatScreen_Show(void);
 void DisconnectScreen_Show(const cc_string* title, const cc_string* message);
 #ifdef CC_BUILD_TOUCH
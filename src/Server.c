@@ -24,6 +24,7 @@
 #include "Platform.h"
 #include "Input.h"
 #include "Errors.h"
+#include "Stream.h"
 
 static char nameBuffer[STRING_SIZE];
 static char motdBuffer[STRING_SIZE];
@@ -208,20 +209,539 @@ static void SPConnection_Init(void) {
 
 
 /*########################################################################################################################*
-*--------------------------------------------------Multiplayer connection-------------------------------------------------*
+*------------------------------------------------------Network thread-----------------------------------------------------*
 *#########################################################################################################################*/
 static cc_socket net_socket;
-static cc_uint8  net_readBuffer[4096 * 5];
-static cc_uint8  net_writeBuffer[131];
-static cc_uint8* net_readCurrent;
+static volatile cc_result net_readFailure, net_writeFailure;
+static cc_bool net_connecting;
+/* Whether received data is being read from a capture file, instead of from the socket */
+static cc_bool net_replaying;
+
+/* Web backend has no real threading support, so the socket is instead polled every network tick */
+#ifndef CC_BUILD_WEB
+#define NET_USE_THREAD
+#endif
+
+/* Queue of raw bytes, with one thread adding bytes and another thread removing them */
+/* NOTE: Packets are still framed on the main thread, as Protocol.Sizes changes when CPE extensions are negotiated */
+struct NetRing {
+	cc_uint8* data;
+	cc_uint32 capacity; /* Must be a power of two */
+	cc_uint32 head;     /* Only advanced by the thread that adds data */
+	cc_uint32 tail;     /* Only advanced by the thread that removes data */
+};
+#define NET_RING_SIZE (1024 * 64)
+/* Max size the receive queue grows to, when packets arrive faster than they can be handled each tick */
+#define NET_MAX_RECV_SIZE (1024 * 1024 * 4)
+static cc_uint8 net_recvData[NET_RING_SIZE], net_sendData[NET_RING_SIZE];
+static struct NetRing net_recv = { net_recvData, NET_RING_SIZE };
+static struct NetRing net_send = { net_sendData, NET_RING_SIZE };
+
+/* Statistics about how congested the connection to the server is */
+static struct NetSendStats {
+	cc_uint32 peakQueued;       /* Largest number of bytes that were waiting to be sent */
+	int blockedWrites;          /* Number of times the socket's send buffer was full */
+	int coalescedUpdates;       /* Number of position updates replaced by a newer one before being sent */
+} net_sendStats;
+/* Max number of bytes that can be waiting to be sent, before the connection is considered dead */
+/* NOTE: Must not be larger than NET_RING_SIZE */
+#define NET_MAX_SEND_QUEUED (1024 * 48)
+
+static void* net_thread;
+static void* net_mutex;
+static void* net_waker;
+static volatile cc_bool net_stopping;
+/* Whether the network thread stopped reading from the socket, because the receive queue was full */
+static volatile cc_bool net_recvFull;
+/* When data was last read from the socket (protected by net_mutex) */
+static cc_uint64 net_lastRecv;
+/* Max time the network thread blocks for, when there is nothing to send or receive */
+/* NOTE: The thread is always woken up when there is new data to send, so this is only a fallback */
+#define NET_THREAD_WAIT_MS 1000
+
+static void NetRing_Reset(struct NetRing* r) { r->head = 0; r->tail = 0; }
+
+/* Returns number of bytes that are in the queue */
+/* NOTE: Only the data itself is copied outside the lock, as head/tail regions never overlap */
+static cc_uint32 NetRing_Used(struct NetRing* r) {
+	cc_uint32 used;
+	Mutex_Lock(net_mutex);
+	{
+		used = r->head - r->tail;
+	}
+	Mutex_Unlock(net_mutex);
+	return used;
+}
+
+static void NetRing_Advance(cc_uint32* value, cc_uint32 amount) {
+	Mutex_Lock(net_mutex);
+	{
+		*value += amount;
+	}
+	Mutex_Unlock(net_mutex);
+}
+
+/* Adds the given data to the queue, returning false if there is not enough free space */
+static cc_bool NetRing_Write(struct NetRing* r, const cc_uint8* src, cc_uint32 count) {
+	cc_uint32 offset, part;
+	if (NetRing_Used(r) + count > r->capacity) return false;
+
+	while (count) {
+		offset = r->head & (r->capacity - 1);
+		part   = min(count, r->capacity - offset);
+		Mem_Copy(r->data + offset, src, part);
+
+		NetRing_Advance(&r->head, part);
+		src += part; count -= part;
+	}
+	return true;
+}
+
+/* Doubles capacity of the receive queue, moving all queued data to the start of the new buffer */
+/* NOTE: Must only be called from the main thread, when no packets are being handled */
+static void NetRecv_Grow(void) {
+	struct NetRing* r  = &net_recv;
+	cc_uint32 capacity = r->capacity * 2;
+	cc_uint32 used, offset, part;
+	cc_uint8* data;
+
+	data = (cc_uint8*)Mem_TryAlloc(capacity, 1);
+	if (!data) return;
+
+	Mutex_Lock(net_mutex);
+	{
+		used   = r->head - r->tail;
+		offset = r->tail & (r->capacity - 1);
+		part   = min(used, r->capacity - offset);
+		Mem_Copy(data,        r->data + offset, part);
+		Mem_Copy(data + part, r->data,          used - part);
+
+		if (r->data != net_recvData) Mem_Free(r->data);
+		r->data = data; r->capacity = capacity;
+		r->tail = 0;    r->head     = used;
+	}
+	Mutex_Unlock(net_mutex);
+}
+
+/* Shrinks the receive queue back to its default size, discarding any queued data */
+static void NetRecv_Reset(void) {
+	struct NetRing* r = &net_recv;
+	if (r->data != net_recvData) Mem_Free(r->data);
+
+	r->data = net_recvData; r->capacity = NET_RING_SIZE;
+	NetRing_Reset(r);
+}
+
+/* Reads data from the socket into the receive queue, returning number of bytes read */
+/* NOTE: The lock is held for the whole read, as NetRecv_Grow may replace the queue's buffer */
+static cc_uint32 NetThread_Receive(void) {
+	struct NetRing* r = &net_recv;
+	cc_uint32 offset, count, read = 0;
+	int pending = 0;
+	cc_bool poll_read;
+	cc_result res;
+
+	if (net_readFailure) return 0;
+	res = Socket_Poll(net_socket, SOCKET_POLL_READ, &poll_read);
+	if (!res && !poll_read) return 0;
+
+	/* poll read returns true when socket is closed */
+	if (!res) res = Socket_Available(net_socket, &pending);
+	if (!res && !pending) res = ERR_END_OF_STREAM;
+
+	Mutex_Lock(net_mutex);
+	{
+		/* Read everything available in one call, limited by free space before the end of the buffer */
+		offset = r->head & (r->capacity - 1);
+		count  = min(r->capacity - (r->head - r->tail), r->capacity - offset);
+		count  = min(count, (cc_uint32)pending);
+
+		if (!res && count) res = Socket_Read(net_socket, r->data + offset, count, &read);
+		if (!res) r->head += read;
+		if (read) net_lastRecv = Stopwatch_Measure();
+	}
+	Mutex_Unlock(net_mutex);
+
+	if (res) {
+		/* Ignore errors for 'no data available for non-blocking read' */
+		if (res == ReturnCode_SocketInProgess)  return 0;
+		if (res == ReturnCode_SocketWouldBlock) return 0;
+
+		net_readFailure = res; return 0;
+	}
+	return read;
+}
+
+/* Writes as much of the send queue as the socket accepts without blocking, returning number of bytes sent */
+static cc_uint32 NetThread_Send(void) {
+	struct NetRing* r = &net_send;
+	cc_uint32 offset, count, wrote = 0;
+	cc_result res;
+
+	if (net_writeFailure) return 0;
+	offset = r->tail & (r->capacity - 1);
+	count  = min(NetRing_Used(r), r->capacity - offset);
+	if (!count) return 0;
+
+	res = Socket_Write(net_socket, r->data + offset, count, &wrote);
+	/* Socket send buffer is full, so try again later */
+	if (res == ReturnCode_SocketInProgess || res == ReturnCode_SocketWouldBlock) {
+		net_sendStats.blockedWrites++; return 0;
+	}
+
+	/* NOTE: Not immediately disconnecting here, as otherwise we sometimes miss out on kick messages */
+	if (res)    { net_writeFailure = res;                  return 0; }
+	if (!wrote) { net_writeFailure = ERR_INVALID_ARGUMENT; return 0; }
+
+	NetRing_Advance(&r->tail, wrote);
+	return wrote;
+}
+
+#ifdef NET_USE_THREAD
+/* Whether there is space in the receive queue to read more data into */
+static cc_bool NetThread_CanReceive(void) {
+	struct NetRing* r = &net_recv;
+	cc_bool canReceive;
+
+	Mutex_Lock(net_mutex);
+	{
+		canReceive   = r->head - r->tail < r->capacity;
+		net_recvFull = !canReceive;
+	}
+	Mutex_Unlock(net_mutex);
+	return canReceive;
+}
+
+static void NetThread_Run(void) {
+	cc_uint32 sent, read;
+	cc_bool reading, writing;
+	cc_result res;
+
+	while (!net_stopping) {
+		sent = NetThread_Send();
+		read = NetThread_Receive();
+		if (sent || read) continue;
+
+		/* Block until the server sends more data, more data is queued for sending, */
+		/*  or the socket can accept data which previously couldn't be sent */
+		reading = !net_readFailure  && NetThread_CanReceive();
+		writing = !net_writeFailure && NetRing_Used(&net_send) != 0;
+
+		res = Socket_WaitFor(net_socket, reading, writing, net_waker, NET_THREAD_WAIT_MS);
+		if (res && !net_readFailure) net_readFailure = res;
+	}
+}
+#endif
+
+static void NetThread_Start(void) {
+#ifdef NET_USE_THREAD
+	if (!net_mutex) {
+		net_mutex = Mutex_Create();
+		net_waker = SocketWaker_Create();
+	}
+	/* Replayed data is instead added to the receive queue on the main thread */
+	if (net_replaying) return;
+
+	net_stopping = false;
+	net_thread   = Thread_Start(NetThread_Run);
+#endif
+}
+
+static void NetThread_Stop(void) {
+#ifdef NET_USE_THREAD
+	if (!net_thread) return;
+	net_stopping = true;
+	SocketWaker_Wake(net_waker);
+
+	Thread_Join(net_thread);
+	net_thread = NULL;
+#endif
+}
+
+/* Notifies network thread that there is new data in the send queue, or space in the receive queue */
+static void NetThread_Wake(void) {
+#ifdef NET_USE_THREAD
+	SocketWaker_Wake(net_waker);
+#else
+	if (!net_connecting) NetThread_Send();
+#endif
+}
+
+static void NetThread_Free(void) {
+#ifdef NET_USE_THREAD
+	if (!net_mutex) return;
+	Mutex_Free(net_mutex);
+	SocketWaker_Free(net_waker);
+
+	net_mutex = NULL;
+	net_waker = NULL;
+#endif
+}
+
+
+/*########################################################################################################################*
+*---------------------------------------------------Network statistics----------------------------------------------------*
+*#########################################################################################################################*/
+struct NetOpcodeStats Net_OpcodeStats[256];
+cc_bool Net_ShowStats;
+/* Totals at the start of the current one second window, used to calculate the per second rates */
+static struct NetStatsWindow { cc_uint32 bytes, count; cc_uint64 elapsed; } net_statsWindow[256];
+static cc_uint64 net_statsWindowBeg;
+
+static void NetStats_Reset(void) {
+	Mem_Set(Net_OpcodeStats, 0, sizeof(Net_OpcodeStats));
+	Mem_Set(net_statsWindow, 0, sizeof(net_statsWindow));
+	net_statsWindowBeg = Stopwatch_Measure();
+}
+
+static void NetStats_Add(cc_uint8 opcode, cc_uint32 size, cc_uint64 elapsed) {
+	struct NetOpcodeStats* stats = &Net_OpcodeStats[opcode];
+	stats->bytes   += size;
+	stats->count++;
+	stats->elapsed += elapsed;
+}
+
+/* Recalculates the per second rates, if at least a second has passed since they were last calculated */
+static void NetStats_UpdateRates(cc_uint64 now) {
+	cc_uint64 elapsed = Stopwatch_ElapsedMicroseconds(net_statsWindowBeg, now);
+	struct NetOpcodeStats* stats;
+	struct NetStatsWindow* win;
+	int i;
+	if (elapsed < 1000 * 1000) return;
+
+	for (i = 0; i < 256; i++) {
+		stats = &Net_OpcodeStats[i];
+		win   = &net_statsWindow[i];
+
+		stats->bytesPerSec   = (cc_uint32)((cc_uint64)(stats->bytes - win->bytes) * 1000000 / elapsed);
+		stats->countPerSec   = (cc_uint32)((cc_uint64)(stats->count - win->count) * 1000000 / elapsed);
+		stats->elapsedPerSec = (cc_uint32)((stats->elapsed - win->elapsed)         * 1000000 / elapsed);
+
+		win->bytes   = stats->bytes;
+		win->count   = stats->count;
+		win->elapsed = stats->elapsed;
+	}
+	net_statsWindowBeg = now;
+}
+
+cc_result Net_DumpStats(const cc_string* path) {
+	cc_string line; char lineBuffer[STRING_SIZE];
+	struct NetOpcodeStats* stats;
+	struct Stream stream;
+	cc_result res, closeRes;
+	int i;
+
+	res = Stream_CreateFile(&stream, path);
+	if (res) return res;
+	String_InitArray(line, lineBuffer);
+
+	String_AppendConst(&line, "opcode,packets,bytes,handler_us,packets_per_sec,bytes_per_sec,handler_us_per_sec");
+	res = Stream_WriteLine(&stream, &line);
+
+	for (i = 0; i < 256 && !res; i++) {
+		stats = &Net_OpcodeStats[i];
+		if (!stats->count) continue;
+		line.length = 0;
+
+		String_AppendInt(&line, i);                                  String_Append(&line, ',');
+		String_AppendUInt32(&line, stats->count);                    String_Append(&line, ',');
+		String_AppendUInt32(&line, stats->bytes);                    String_Append(&line, ',');
+		String_AppendUInt32(&line, (cc_uint32)stats->elapsed);       String_Append(&line, ',');
+		String_AppendUInt32(&line, stats->countPerSec);              String_Append(&line, ',');
+		String_AppendUInt32(&line, stats->bytesPerSec);              String_Append(&line, ',');
+		String_AppendUInt32(&line, stats->elapsedPerSec);
+		res = Stream_WriteLine(&stream, &line);
+	}
+
+	closeRes = stream.Close(&stream);
+	return res ? res : closeRes;
+}
+
+
+/*########################################################################################################################*
+*------------------------------------------------Packet capture and replay------------------------------------------------*
+*#########################################################################################################################*/
+/* Capture files start with NET_CAPTURE_MAGIC, followed by a record for each network tick that received data */
+/*  Each record is the network tick (u32), time since connecting in milliseconds (u32), length (u32), then the raw bytes */
+/* Replaying feeds the recorded bytes into the receive queue on the same network ticks they were originally received, */
+/*  so that the protocol handlers can be benchmarked and compared offline without the original server */
+#define NET_CAPTURE_MAGIC "CCNETCAP"
+#define NET_CAPTURE_MAGIC_LEN 8
+#define NET_RECORD_HEADER_SIZE 12
+
+/* Max size of a capture file, after which no further data is captured */
+#define NET_MAX_CAPTURE_SIZE (1024 * 1024 * 512)
+
+cc_string Net_CapturePath;
+static struct Stream net_capture;
+static cc_bool   net_capturing;
+static cc_uint32 net_captured; /* Number of bytes after tail of receive queue already written to the capture */
+static cc_uint32 net_captureSize;
+
+cc_string Net_ReplayPath;
+static struct Stream net_replayFile, net_replay;
+static cc_uint8  net_replayBuffer[16384];
+static cc_uint32 net_replayTick, net_replayLeft; /* Tick and remaining length of the current record */
+
+static int net_startTicks;
+static cc_uint64 net_startTime;
+
+static void NetCapture_Close(void) {
+	if (!net_capturing) return;
+	net_capture.Close(&net_capture);
+	net_capturing = false;
+}
+
+static void NetCapture_Open(void) {
+	cc_string* path = &Net_CapturePath;
+	cc_result res;
+	if (!path->length) return;
+
+	res = Stream_CreateFile(&net_capture, path);
+	if (res) { Logger_SysWarn2(res, "creating", path); return; }
 
-static cc_result net_writeFailure;
-static double lastPacket;
+	net_capturing   = true;
+	net_captured    = 0;
+	net_captureSize = NET_CAPTURE_MAGIC_LEN;
+	res = Stream_Write(&net_capture, (const cc_uint8*)NET_CAPTURE_MAGIC, NET_CAPTURE_MAGIC_LEN);
+	if (res) { Logger_SysWarn2(res, "writing", path); NetCapture_Close(); }
+}
+
+/* Writes all data added to the receive queue since the last network tick to the capture file */
+static void NetCapture_Write(cc_uint32 used) {
+	struct NetRing* r = &net_recv;
+	cc_uint8 header[NET_RECORD_HEADER_SIZE];
+	cc_uint32 offset, part, count;
+	cc_uint64 elapsed;
+	cc_result res;
+
+	count = used - net_captured;
+	if (!count) return;
+
+	net_captureSize += NET_RECORD_HEADER_SIZE + count;
+	if (net_captureSize > NET_MAX_CAPTURE_SIZE) {
+		Platform_LogConst("Network capture is too large, no longer capturing");
+		NetCapture_Close(); return;
+	}
+	elapsed = Stopwatch_ElapsedMicroseconds(net_startTime, Stopwatch_Measure());
+
+	Stream_SetU32_LE(header + 0, (cc_uint32)(ticks - net_startTicks));
+	Stream_SetU32_LE(header + 4, (cc_uint32)(elapsed / 1000));
+	Stream_SetU32_LE(header + 8, count);
+	res = Stream_Write(&net_capture, header, NET_RECORD_HEADER_SIZE);
+
+	offset = (r->tail + net_captured) & (r->capacity - 1);
+	part   = min(count, r->capacity - offset);
+	if (!res) res = Stream_Write(&net_capture, r->data + offset, part);
+	if (!res) res = Stream_Write(&net_capture, r->data, count - part);
+
+	net_captured = used;
+	if (res) { Logger_SysWarn(res, "writing network capture"); NetCapture_Close(); }
+}
+
+static void NetReplay_Close(void) {
+	if (!net_replaying) return;
+	net_replayFile.Close(&net_replayFile);
+	net_replaying = false;
+}
+
+/* Returns whether a capture file to replay instead of connecting to the server was opened */
+static cc_bool NetReplay_Open(void) {
+	cc_uint8 magic[NET_CAPTURE_MAGIC_LEN];
+	cc_string* path = &Net_ReplayPath;
+	cc_result res;
+	if (!path->length) return false;
+
+	res = Stream_OpenFile(&net_replayFile, path);
+	if (res) { Logger_SysWarn2(res, "opening", path); return false; }
+
+	Stream_ReadonlyBuffered(&net_replay, &net_replayFile, net_replayBuffer, sizeof(net_replayBuffer));
+	net_replaying  = true;
+	net_replayLeft = 0;
+
+	res = Stream_Read(&net_replay, magic, NET_CAPTURE_MAGIC_LEN);
+	if (!res && !Mem_Equal(magic, NET_CAPTURE_MAGIC, NET_CAPTURE_MAGIC_LEN)) res = ERR_INVALID_ARGUMENT;
+	if (res) { Logger_SysWarn2(res, "reading", path); NetReplay_Close(); }
+
+	return net_replaying;
+}
+
+/* Adds all recorded data which was originally received by this network tick to the receive queue */
+static void NetReplay_Feed(void) {
+	struct NetRing* r = &net_recv;
+	cc_uint8 data[4096];
+	cc_uint32 tick = (cc_uint32)(ticks - net_startTicks);
+	cc_uint32 count;
+	cc_result res;
+
+	if (net_readFailure) return;
+	for (;;) {
+		if (!net_replayLeft) {
+			/* End of stream is treated like the server closing the socket */
+			res = Stream_Read(&net_replay, data, NET_RECORD_HEADER_SIZE);
+			if (res) { net_readFailure = res; return; }
+
+			net_replayTick = Stream_GetU32_LE(data + 0);
+			net_replayLeft = Stream_GetU32_LE(data + 8);
+		}
+		if (net_replayTick > tick) return;
+
+		/* Receive queue is full, so add the rest of the record next tick */
+		count = min(net_replayLeft, r->capacity - NetRing_Used(r));
+		count = min(count, sizeof(data));
+		if (!count) return;
+
+		res = Stream_Read(&net_replay, data, count);
+		if (res) { net_readFailure = res; return; }
+
+		NetRing_Write(r, data, count);
+		net_replayLeft -= count;
+	}
+}
+
+static void NetReplay_Finish(void) {
+	static const cc_string title  = String_FromConst("Replay finished");
+	static const cc_string reason = String_FromConst("Handler timings have been written to client.log");
+	struct NetOpcodeStats* stats;
+	cc_uint64 elapsed = Stopwatch_ElapsedMicroseconds(net_startTime, Stopwatch_Measure());
+	int i, count, total, average, millis = (int)(elapsed / 1000), replayTicks = ticks - net_startTicks;
+	cc_uint8 opcode;
+
+	Platform_Log2("Replayed %i network ticks in %i ms", &replayTicks, &millis);
+	for (i = 0; i < 256; i++) {
+		stats = &Net_OpcodeStats[i];
+		if (!stats->count) continue;
+
+		opcode  = (cc_uint8)i;
+		count   = (int)stats->count;
+		total   = (int)stats->elapsed;
+		average = total / count;
+		Platform_Log4("  Opcode %b: %i packets, %i us total, %i us average", &opcode, &count, &total, &average);
+	}
+	Game_Disconnect(&title, &reason);
+}
+
+
+/*########################################################################################################################*
+*--------------------------------------------------Multiplayer connection-------------------------------------------------*
+*#########################################################################################################################*/
+static cc_uint8  net_writeBuffer[131];
+/* Packets are normally handled in place in the receive queue, */
+/*  but a packet that wraps around the end of the queue is first copied here */
+static cc_uint8  net_packetBuffer[1 << 16];
+/* Most recent position update that hasn't been added to the send queue yet */
+static cc_uint8  net_posBuffer[131];
+static cc_uint32 net_posLength;
 static cc_uint8 lastOpcode;
 
-static cc_bool net_connecting;
 static double net_connectTimeout;
 #define NET_TIMEOUT_SECS 15
+/* Max time spent running packet handlers in one network tick */
+/*  (any further received packets are instead handled in the next tick) */
+#define NET_HANDLERS_BUDGET_US 8000
+/* Max time without receiving any data, before the connection is considered to have been dropped */
+/*  (servers regularly send ping packets, so this only happens when e.g. the network is disconnected) */
+#define NET_IDLE_TIMEOUT_SECS 30
 
 static void OnClose(void);
 static void MPConnection_FinishConnect(void) {
@@ -229,11 +749,14 @@ static void MPConnection_FinishConnect(void) {
 	Event_RaiseVoid(&NetEvents.Connected);
 	Event_RaiseFloat(&WorldEvents.Loading, 0.0f);
 
-	net_readCurrent    = net_readBuffer;
 	Server.WriteBuffer = net_writeBuffer;
+	net_startTicks     = ticks;
+	net_startTime      = Stopwatch_Measure();
+	net_lastRecv       = net_startTime;
 
+	if (!net_replaying) NetCapture_Open();
+	NetThread_Start();
 	Classic_SendLogin();
-	lastPacket = Game.Time;
 }
 
 static void MPConnection_Fail(const cc_string* reason) {
@@ -279,6 +802,17 @@ static void MPConnection_TickConnect(void) {
 	}
 }
 
+static void MPConnection_ResetState(void) {
+	NetRecv_Reset();
+	NetRing_Reset(&net_send);
+	net_readFailure  = 0;
+	net_writeFailure = 0;
+	net_recvFull     = false;
+	net_posLength    = 0;
+	Mem_Set(&net_sendStats, 0, sizeof(net_sendStats));
+	NetStats_Reset();
+}
+
 static void MPConnection_BeginConnect(void) {
 	cc_string title; char titleBuffer[STRING_SIZE];
 	cc_result res;
@@ -291,6 +825,12 @@ static void MPConnection_BeginConnect(void) {
 	Blocks.CanPlace[BLOCK_STILL_LAVA] = false;  Blocks.CanDelete[BLOCK_STILL_LAVA] = false;
 	Blocks.CanPlace[BLOCK_STILL_WATER] = false; Blocks.CanDelete[BLOCK_STILL_WATER] = false;
 	Blocks.CanPlace[BLOCK_BEDROCK] = false;     Blocks.CanDelete[BLOCK_BEDROCK] = false;
+	MPConnection_ResetState();
+
+	if (NetReplay_Open()) {
+		Server.Disconnected = false;
+		MPConnection_FinishConnect(); return;
+	}
 	
 	res = Socket_Connect(&net_socket, &Server.Address, Server.Port);
 	if (res == ERR_INVALID_ARGUMENT) {
@@ -308,6 +848,27 @@ static void MPConnection_BeginConnect(void) {
 	}
 }
 
+static void MPConnection_QueueData(const cc_uint8* data, cc_uint32 len) {
+	cc_uint32 queued;
+	/* There is no server to send data to when replaying */
+	if (Server.Disconnected || net_replaying) return;
+
+	/* Send queue only fills up when the socket has been unable to send data for a long time */
+	queued = NetRing_Used(&net_send) + len;
+	if (queued > NET_MAX_SEND_QUEUED || !NetRing_Write(&net_send, data, len)) {
+		net_writeFailure = ReturnCode_SocketWouldBlock; return;
+	}
+
+	net_sendStats.peakQueued = max(net_sendStats.peakQueued, queued);
+	NetThread_Wake();
+}
+
+static void MPConnection_FlushPosition(void) {
+	cc_uint32 len = net_posLength;
+	net_posLength = 0;
+	MPConnection_QueueData(net_posBuffer, len);
+}
+
 static void MPConnection_SendBlock(int x, int y, int z, BlockID old, BlockID now) {
 	if (now == BLOCK_AIR) {
 		now = Inventory_SelectedBlock;
@@ -331,8 +892,18 @@ static void MPConnection_SendChat(const cc_string* text) {
 }
 
 static void MPConnection_SendPosition(Vec3 pos, float yaw, float pitch) {
+	cc_uint8* data = Server.WriteBuffer;
 	Classic_WritePosition(pos, yaw, pitch);
-	Net_SendPacket();
+
+	/* Only the most recent position matters, so replace any update that is still waiting to be sent */
+	if (net_posLength) net_sendStats.coalescedUpdates++;
+	net_posLength = (cc_uint32)(Server.WriteBuffer - data);
+	Mem_Copy(net_posBuffer, data, net_posLength);
+	Server.WriteBuffer = data;
+
+	/* Earlier data still hasn't been sent yet, so hold back the position update for now */
+	if (NetRing_Used(&net_send)) return;
+	MPConnection_FlushPosition();
 }
 
 static void MPConnection_Disconnect(void) {
@@ -341,20 +912,35 @@ static void MPConnection_Disconnect(void) {
 	Game_Disconnect(&title, &reason);
 }
 
-static void MPConnection_CheckDisconnection(void) {
-	static const cc_string title  = String_FromConst("Disconnected!");
-	static const cc_string reason = String_FromConst("You've lost connection to the server");
-	cc_result availRes, selectRes;
-	int pending = 0;
-	cc_bool poll_read;
+static void MPConnection_ReadFailed(void) {
+	static const cc_string title_lost  = String_FromConst("&eLost connection to the server");
+	static const cc_string reason_err  = String_FromConst("I/O error when reading packets");
+	cc_string msg; char msgBuffer[STRING_SIZE * 2];
+	cc_result res = net_readFailure;
 
-	availRes  = Socket_Available(net_socket, &pending);
-	/* poll read returns true when socket is closed */
-	selectRes = Socket_Poll(net_socket, SOCKET_POLL_READ, &poll_read);
+	/* Socket was closed by the server */
+	if (res == ERR_END_OF_STREAM && net_replaying) { NetReplay_Finish(); return; }
+	if (res == ERR_END_OF_STREAM) { MPConnection_Disconnect(); return; }
 
-	if (net_writeFailure || availRes || selectRes || (pending == 0 && poll_read)) {
-		MPConnection_Disconnect();
+	String_InitArray(msg, msgBuffer);
+	String_Format3(&msg, "Error reading from %s:%i: %i" _NL, &Server.Address, &Server.Port, &res);
+
+	Logger_Log(&msg);
+	Game_Disconnect(&title_lost, &reason_err);
+}
+
+/* Whether no data has been received from the server for a long time */
+static cc_bool MPConnection_TimedOut(void) {
+	cc_uint64 lastRecv;
+	/* Network thread isn't reading from the socket when the receive queue is full */
+	if (net_replaying || net_recvFull) return false;
+
+	Mutex_Lock(net_mutex);
+	{
+		lastRecv = net_lastRecv;
 	}
+	Mutex_Unlock(net_mutex);
+	return Stopwatch_ElapsedMicroseconds(lastRecv, Stopwatch_Measure()) >= NET_IDLE_TIMEOUT_SECS * 1000 * 1000;
 }
 
 static void DisconnectInvalidOpcode(cc_uint8 opcode) {
@@ -367,82 +953,106 @@ static void DisconnectInvalidOpcode(cc_uint8 opcode) {
 }
 
 static void MPConnection_Tick(struct ScheduledTask* task) {
-	static const cc_string title_lost  = String_FromConst("&eLost connection to the server");
-	static const cc_string reason_err  = String_FromConst("I/O error when reading packets");
-	cc_string msg; char msgBuffer[STRING_SIZE * 2];
-	cc_uint32 pending;
-	cc_uint8* readEnd;
+	struct NetRing* r = &net_recv;
+	cc_uint32 used, offset, size, part, consumed = 0;
+	cc_uint8* packet;
+	cc_uint8 opcode;
 	Net_Handler handler;
-	int i, remaining;
-	cc_result res;
+	cc_uint64 beg, handlerBeg, handlerEnd;
+	cc_bool failed, exhausted = true;
 
 	if (Server.Disconnected) return;
 	if (net_connecting) { MPConnection_TickConnect(); return; }
 
-	/* Over 30 seconds since last packet, connection likely dropped */
-	if (lastPacket + 30 < Game.Time) MPConnection_CheckDisconnection();
-	if (Server.Disconnected) return;
-
-	pending = 0;
-	res     = Socket_Available(net_socket, &pending);
-	readEnd = net_readCurrent; /* todo change to int remaining instead */
-
-	if (!res && pending) {
-		/* NOTE: Always using a read call that is a multiple of 4096 (appears to?) improve read performance */	
-		res = Socket_Read(net_socket, net_readCurrent, 4096 * 4, &pending);
-		/* Ignore errors for 'no data available for non-blocking read' */
-		if (res) {
-			if (res == ReturnCode_SocketInProgess)  return;
-			if (res == ReturnCode_SocketWouldBlock) return;
-		}
-		readEnd += pending;
+	if (net_replaying) {
+		NetReplay_Feed();
+	} else {
+#ifndef NET_USE_THREAD
+		NetThread_Receive();
+		NetThread_Send();
+#endif
 	}
 
-	if (res) {
-		String_InitArray(msg, msgBuffer);
-		String_Format3(&msg, "Error reading from %s:%i: %i" _NL, &Server.Address, &Server.Port, &res);
+	/* Check for failure first, so any data received before the failure is always handled */
+	failed = net_readFailure != 0;
+	used   = NetRing_Used(r);
 
-		Logger_Log(&msg);
-		Game_Disconnect(&title_lost, &reason_err);
-		return;
-	}
+	/* Receive queue was at least half full, so let the network thread buffer more of a large burst of packets */
+	if (used >= r->capacity / 2 && r->capacity < NET_MAX_RECV_SIZE) NetRecv_Grow();
+	if (net_capturing) NetCapture_Write(used);
+	beg = Stopwatch_Measure();
 
-	net_readCurrent = net_readBuffer;
-	while (net_readCurrent < readEnd) {
-		cc_uint8 opcode = net_readCurrent[0];
+	/* NOTE: Only this thread advances tail, so the data being handled can't be overwritten */
+	while (consumed < used) {
+		offset = (r->tail + consumed) & (r->capacity - 1);
+		opcode = r->data[offset];
 
 		/* Workaround for older D3 servers which wrote one byte too many for HackControl packets */
 		if (cpe_needD3Fix && lastOpcode == OPCODE_HACK_CONTROL && (opcode == 0x00 || opcode == 0xFF)) {
 			Platform_LogConst("Skipping invalid HackControl byte from D3 server");
-			net_readCurrent++;
+			consumed++;
 			LocalPlayer_ResetJumpVelocity();
 			continue;
 		}
 
-		if (net_readCurrent + Protocol.Sizes[opcode] > readEnd) break;
+		/* Protocol packets might be split up across TCP packets */
+		/* If so, the rest of the packet is handled once it has been received */
+		size = Protocol.Sizes[opcode];
+		if (consumed + size > used) break;
 		handler = Protocol.Handlers[opcode];
 		if (!handler) { DisconnectInvalidOpcode(opcode); return; }
 
+		packet = r->data + offset;
+		if (offset + size > r->capacity) {
+			part = r->capacity - offset;
+			Mem_Copy(net_packetBuffer,        packet,  part);
+			Mem_Copy(net_packetBuffer + part, r->data, size - part);
+			packet = net_packetBuffer;
+		}
+
 		lastOpcode = opcode;
-		lastPacket = Game.Time;
-		handler(net_readCurrent + 1); /* skip opcode */
-		net_readCurrent += Protocol.Sizes[opcode];
+		handlerBeg = Stopwatch_Measure();
+		handler(packet + 1); /* skip opcode */
+		handlerEnd = Stopwatch_Measure();
+		consumed  += size;
+
+		NetStats_Add(opcode, size, Stopwatch_ElapsedMicroseconds(handlerBeg, handlerEnd));
+		/* Handler disconnected (e.g. kicked), so receive queue is no longer valid */
+		if (Server.Disconnected) return;
+
+		/* Leave remaining packets for next tick, to avoid a burst of packets causing a long frame */
+		if (Stopwatch_ElapsedMicroseconds(beg, handlerEnd) >= NET_HANDLERS_BUDGET_US) {
+			exhausted = false; break;
+		}
+	}
+	NetRing_Advance(&r->tail, consumed);
+	/* Network thread stops reading from the socket while the receive queue is full */
+	if (net_recvFull) NetThread_Wake();
+	net_captured -= min(consumed, net_captured);
+	Protocol_FlushLocations();
+	NetStats_UpdateRates(Stopwatch_Measure());
+
+	/* Only disconnect once all packets received before the error have been handled */
+	/*  (otherwise would miss out on e.g. kick messages sent just before the socket was closed) */
+	if (failed && exhausted) {
+		MPConnection_ReadFailed(); return;
 	}
 
-	/* Protocol packets might be split up across TCP packets */
-	/* If so, copy last few unprocessed bytes back to beginning of buffer */
-	/* These bytes are then later combined with subsequently read TCP packet data */
-	remaining = (int)(readEnd - net_readCurrent);
-	for (i = 0; i < remaining; i++) {
-		net_readBuffer[i] = net_readCurrent[i];
+	/* Server likely went away without closing the connection, e.g. the network connection was lost */
+	if (MPConnection_TimedOut()) {
+		Platform_LogConst("No data received from server, disconnecting");
+		MPConnection_Disconnect(); return;
 	}
-	net_readCurrent = net_readBuffer + remaining;
 
 	if (net_writeFailure) {
-		Platform_Log1("Error from send: %i", &net_writeFailure);
+		cc_result res = net_writeFailure;
+		Platform_Log1("Error from send: %i", &res);
 		MPConnection_Disconnect();
 	}
 
+	/* Send any held back position update once the send queue has been emptied */
+	if (net_posLength && !NetRing_Used(&net_send)) MPConnection_FlushPosition();
+
 	/* Network is ticked 60 times a second. We only send position updates 20 times a second */
 	if ((ticks % 3) == 0) {
 		TexturePack_CheckPending();
@@ -454,27 +1064,9 @@ static void MPConnection_Tick(struct ScheduledTask* task) {
 }
 
 static void MPConnection_SendData(const cc_uint8* data, cc_uint32 len) {
-	cc_uint32 wrote;
-	cc_result res;
-	int tries = 0;
-	if (Server.Disconnected) return;
-
-	while (len) {
-		res = Socket_Write(net_socket, data, len, &wrote);
-		/* If sending would block (send buffer full), retry for a bit up to 10 seconds */
-		/* TODO: Avoid doing this and manually buffer data when this happens */
-		if (res && tries < 1000 && (res == ReturnCode_SocketInProgess || res == ReturnCode_SocketWouldBlock)) {
-			Thread_Sleep(10);
-			tries++;
-			continue;
-		}
-
-		/* NOTE: Not immediately disconnecting here, as otherwise we sometimes miss out on kick messages */
-		if (res)    { net_writeFailure = res;                  return; }
-		if (!wrote) { net_writeFailure = ERR_INVALID_ARGUMENT; return; }
-
-		data += wrote; len -= wrote;
-	}
+	/* Position update must still be sent before any later data, to preserve ordering */
+	if (net_posLength) MPConnection_FlushPosition();
+	MPConnection_QueueData(data, len);
 }
 
 void Net_SendPacket(void) {
@@ -494,7 +1086,6 @@ static void MPConnection_Init(void) {
 	Server.SendPosition = MPConnection_SendPosition;
 	Server.SendData     = MPConnection_SendData;
 
-	net_readCurrent    = net_readBuffer;
 	Server.WriteBuffer = net_writeBuffer;
 }
 
@@ -514,7 +1105,8 @@ static void OnInit(void) {
 	String_InitArray(Server.MOTD,    motdBuffer);
 	String_InitArray(Server.AppName, appBuffer);
 
-	if (!Server.Address.length) {
+	/* Replaying a network capture doesn't require a server address */
+	if (!Server.Address.length && !Net_ReplayPath.length) {
 		SPConnection_Init();
 	} else {
 		MPConnection_Init();
@@ -539,6 +1131,8 @@ static void OnReset(void) {
 static void OnFree(void) {
 	Server.Address.length = 0;
 	OnClose();
+	NetThread_Free();
+	NetRecv_Reset();
 }
 
 static void OnClose(void) {
@@ -548,7 +1142,12 @@ static void OnClose(void) {
 		Ping_Reset();
 		if (Server.Disconnected) return;
 
-		Socket_Close(net_socket);
+		NetThread_Stop();
+		NetCapture_Close();
+		if (!net_replaying) Socket_Close(net_socket);
+		NetReplay_Close();
+		Platform_Log3("Send queue: peak %i bytes, %i blocked writes, %i coalesced position updates",
+			&net_sendStats.peakQueued, &net_sendStats.blockedWrites, &net_sendStats.coalescedUpdates);
 		Server.Disconnected = true;
 	}
 }
@@ -68,4 +68,23 @@ CC_VAR extern struct _ServerConnectionData {
 /* Otherwise just calls TexturePack_Extract. */
 void Server_RetrieveTexturePack(const cc_string* url);
 void Net_SendPacket(void);
+
+/* Statistics about the packets with a particular opcode received from the server. */
+struct NetOpcodeStats {
+	cc_uint32 bytes, count; /* Totals since connecting to the server */
+	cc_uint64 elapsed;      /* Total time spent in the opcode's handler, in microseconds */
+	/* Rates over the most recent full second */
+	cc_uint32 bytesPerSec, countPerSec, elapsedPerSec;
+};
+extern struct NetOpcodeStats Net_OpcodeStats[256];
+/* Whether an overlay with the most expensive packet types is shown. */
+extern cc_bool Net_ShowStats;
+/* Writes the statistics of every received opcode to a CSV file. */
+cc_result Net_DumpStats(const cc_string* path);
+/* Path of a network capture to replay instead of connecting to a server, empty string if none. */
+/* Set from the command line, e.g. 'ClassiCube [username] --replay [capture file]' */
+extern cc_string Net_ReplayPath;
+/* Path of the file to capture data received from the server to, empty string if none. */
+/* Set from the command line, e.g. 'ClassiCube [username] [mppass] [ip] [port] --capture [capture file]' */
+extern cc_string Net_CapturePath;
 #endif
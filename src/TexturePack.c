@@ -16,6 +16,7 @@
 #include "Utils.h"
 #include "Chat.h" /* TODO avoid this include */
 #include "Errors.h"
+#include "Model.h"
 
 /*########################################################################################################################*
 *------------------------------------------------------TerrainAtlas-------------------------------------------------------*
@@ -298,8 +299,278 @@ static cc_result ProcessZipEntry(const cc_string* path, struct Stream* stream, s
 	return 0;
 }
 
+
+/*########################################################################################################################*
+*-------------------------------------------------Parallel zip extraction-------------------------------------------------*
+*#########################################################################################################################*/
+/* Entries are inflated and decoded by worker threads, but always applied in archive order on the main thread */
+#define ZIP_PARALLEL_MAX_THREADS 16
+/* Images that are decoded by the game when changed (see the OnFileChanged handlers) */
+/* NOTE: Other entries are passed through undecoded, so unused images in HD packs aren't decoded for nothing */
+static const char* const zip_decodedFiles[] = {
+	"terrain.png", "animations.png", "default.png", "particles.png",
+	"clouds.png", "skybox.png", "snow.png", "rain.png",
+	"gui.png", "gui_classic.png", "icons.png", "touch.png"
+};
+
+struct ZipParallelEntry {
+	struct DecodedPng png; /* Raw data of the entry, and decoded bitmap if entry is decoded */
+	cc_bool decode, processed, done;
+	cc_result res;
+};
+
+static struct ZipParallelState {
+	struct ZipState zip;  /* Entries in the archive (each worker extracts using its own copy of this) */
+	cc_uint8* data;       /* Raw data of the entire .zip archive */
+	cc_uint32 size;
+	struct ZipParallelEntry* entries;
+	int count, next;      /* Total number of entries, and index of next entry to extract */
+	int applied, window;  /* Number of entries applied so far, and max number of entries ahead of that to extract */
+	int numThreads, nextId;
+	void* mutex;
+	void* entryDone; /* Signalled when a worker has finished extracting an entry */
+	void* threads[ZIP_PARALLEL_MAX_THREADS];
+	void* wake[ZIP_PARALLEL_MAX_THREADS]; /* Signalled when a worker may be able to extract another entry */
+} zip_par;
+
+static cc_result ZipParallel_ProcessEntry(const cc_string* path, struct Stream* stream, struct ZipState* s) {
+	struct ZipParallelEntry* e = (struct ZipParallelEntry*)s->obj;
+	struct Stream mem;
+	cc_uint32 size = s->_curEntry->UncompressedSize;
+	cc_result res;
+
+	if (size) {
+		e->png.data = (cc_uint8*)Mem_TryAlloc(size, 1);
+		if (!e->png.data) return ERR_OUT_OF_MEMORY;
+		if ((res = Stream_Read(stream, e->png.data, size))) return res;
+	}
+	e->png.size  = size;
+	e->processed = true;
+	if (!e->decode) return 0;
+
+	Stream_ReadonlyMemory(&mem, e->png.data, size);
+	e->png.res = Png_Decode(&e->png.bmp, &mem);
+	return 0;
+}
+
+/* Waits until this worker is allowed to extract another entry, returning -1 if there are no more entries */
+static int ZipParallel_NextEntry(int id) {
+	int i;
+	Mutex_Lock(zip_par.mutex);
+
+	while (zip_par.next < zip_par.count && zip_par.next >= zip_par.applied + zip_par.window) {
+		Mutex_Unlock(zip_par.mutex);
+		Waitable_Wait(zip_par.wake[id]);
+		Mutex_Lock(zip_par.mutex);
+	}
+	i = zip_par.next < zip_par.count ? zip_par.next++ : -1;
+
+	Mutex_Unlock(zip_par.mutex);
+	return i;
+}
+
+static void ZipParallel_Run(void) {
+	struct ZipParallelEntry* e;
+	struct ZipState state;
+	struct Stream mem;
+	cc_result res;
+	int id, i;
+
+	Mutex_Lock(zip_par.mutex);
+	{
+		id = zip_par.nextId++;
+	}
+	Mutex_Unlock(zip_par.mutex);
+
+	while ((i = ZipParallel_NextEntry(id)) >= 0) {
+		e = &zip_par.entries[i];
+		Stream_ReadonlyMemory(&mem, zip_par.data, zip_par.size);
+
+		state              = zip_par.zip;
+		state.input        = &mem;
+		state.obj          = e;
+		state.ProcessEntry = ZipParallel_ProcessEntry;
+		res = Zip_ExtractEntry(&state, &state.entries[i]);
+
+		Mutex_Lock(zip_par.mutex);
+		{
+			e->res  = res;
+			e->done = true;
+		}
+		Mutex_Unlock(zip_par.mutex);
+		Waitable_Signal(zip_par.entryDone);
+	}
+}
+
+static void ZipParallel_WakeAll(void) {
+	int i;
+	for (i = 0; i < zip_par.numThreads; i++) { Waitable_Signal(zip_par.wake[i]); }
+}
+
+/* Waits for the given entry to be extracted, then raises TextureEvents.FileChanged for it */
+static cc_result ZipParallel_Apply(int i) {
+	struct ZipParallelEntry* e = &zip_par.entries[i];
+	struct Stream stream;
+	cc_string name;
+	cc_bool done;
+
+	for (;;) {
+		Mutex_Lock(zip_par.mutex);
+		{
+			done = e->done;
+		}
+		Mutex_Unlock(zip_par.mutex);
+
+		if (done) break;
+		Waitable_Wait(zip_par.entryDone);
+	}
+	if (e->res) return e->res;
+
+	/* Entries using unsupported compression methods are skipped */
+	if (e->processed) {
+		if (e->decode) {
+			Png_MakeDecodedStream(&stream, &e->png);
+		} else {
+			Stream_ReadonlyMemory(&stream, e->png.data, e->png.size);
+		}
+
+		name = zip_par.zip.entries[i].Path;
+		Utils_UNSAFE_GetFilename(&name);
+		Event_RaiseEntry(&TextureEvents.FileChanged, &stream, &name);
+		(void)stream.Close(&stream);
+	}
+
+	Mem_Free(e->png.data);
+	e->png.data = NULL;
+
+	Mutex_Lock(zip_par.mutex);
+	{
+		zip_par.applied = i + 1;
+	}
+	Mutex_Unlock(zip_par.mutex);
+	ZipParallel_WakeAll();
+	return 0;
+}
+
+static void ZipParallel_Free(void) {
+	struct ZipParallelEntry* e;
+	int i;
+
+	/* Stop workers from extracting any further entries */
+	if (zip_par.mutex) Mutex_Lock(zip_par.mutex);
+	zip_par.next = zip_par.count;
+	if (zip_par.mutex) Mutex_Unlock(zip_par.mutex);
+	ZipParallel_WakeAll();
+
+	for (i = 0; i < zip_par.numThreads; i++) {
+		if (zip_par.threads[i]) Thread_Join(zip_par.threads[i]);
+		if (zip_par.wake[i])    Waitable_Free(zip_par.wake[i]);
+		zip_par.threads[i] = NULL;
+		zip_par.wake[i]    = NULL;
+	}
+
+	for (i = 0; zip_par.entries && i < zip_par.count; i++) {
+		e = &zip_par.entries[i];
+		Mem_Free(e->png.data);
+		Mem_Free(e->png.bmp.scan0);
+	}
+
+	if (zip_par.mutex)     Mutex_Free(zip_par.mutex);
+	if (zip_par.entryDone) Waitable_Free(zip_par.entryDone);
+	Zip_Free(&zip_par.zip);
+	Mem_Free(zip_par.entries);
+	Mem_Free(zip_par.data);
+
+	zip_par.mutex      = NULL;
+	zip_par.entryDone  = NULL;
+	zip_par.entries    = NULL;
+	zip_par.data       = NULL;
+	zip_par.numThreads = 0;
+}
+
+/* Whether the given entry is an image that the game would decode when raising TextureEvents.FileChanged */
+static cc_bool ZipParallel_ShouldDecode(const cc_string* path) {
+	cc_string name = *path;
+	int i;
+	Utils_UNSAFE_GetFilename(&name);
+
+	for (i = 0; i < Array_Elems(zip_decodedFiles); i++) {
+		if (String_CaselessEqualsConst(&name, zip_decodedFiles[i])) return true;
+	}
+	return Model_GetTexture(&name) != NULL;
+}
+
+/* Reads the entire .zip archive into memory, then reads its central directory */
+static cc_result ZipParallel_Init(struct Stream* stream) {
+	struct Stream mem;
+	cc_result res;
+	int i;
+
+	if ((res = stream->Length(stream, &zip_par.size))) return res;
+	if ((res = stream->Seek(stream, 0)))               return res;
+
+	zip_par.data = (cc_uint8*)Mem_TryAlloc(zip_par.size, 1);
+	if (!zip_par.data) return ERR_OUT_OF_MEMORY;
+	if ((res = Stream_Read(stream, zip_par.data, zip_par.size))) return res;
+
+	Stream_ReadonlyMemory(&mem, zip_par.data, zip_par.size);
+	Zip_Init(&zip_par.zip, &mem);
+	if ((res = Zip_ReadDirectory(&zip_par.zip))) return res;
+	/* Workers use their own memory stream */
+	zip_par.zip.input = NULL;
+
+	zip_par.count   = zip_par.zip._totalEntries;
+	zip_par.entries = (struct ZipParallelEntry*)Mem_TryAllocCleared(max(zip_par.count, 1), sizeof(struct ZipParallelEntry));
+	if (!zip_par.entries) return ERR_OUT_OF_MEMORY;
+
+	/* Decided here on the main thread, as plugins may register model textures at any time */
+	for (i = 0; i < zip_par.count; i++) {
+		zip_par.entries[i].decode = ZipParallel_ShouldDecode(&zip_par.zip.entries[i].Path);
+	}
+	return 0;
+}
+
+static cc_result ZipParallel_Extract(int numThreads) {
+	cc_result res = 0;
+	int i;
+
+	numThreads = min(numThreads, zip_par.count);
+	/* Limit how far ahead of the main thread workers can get, to bound memory usage */
+	zip_par.window     = numThreads * 2;
+	zip_par.numThreads = numThreads;
+	zip_par.mutex      = Mutex_Create();
+	zip_par.entryDone  = Waitable_Create();
+
+	for (i = 0; i < numThreads; i++) {
+		zip_par.wake[i] = Waitable_Create();
+	}
+	/* Started separately, because threads use the wake array */
+	for (i = 0; i < numThreads; i++) {
+		zip_par.threads[i] = Thread_Start(ZipParallel_Run);
+	}
+
+	for (i = 0; i < zip_par.count; i++) {
+		if ((res = ZipParallel_Apply(i))) break;
+	}
+
+	ZipParallel_Free();
+	return res;
+}
+
 static cc_result ExtractZip(struct Stream* stream) {
 	struct ZipState state;
+	int numThreads = min(Thread_ProcessorCount(), ZIP_PARALLEL_MAX_THREADS);
+
+	if (numThreads > 1) {
+		zip_par.next    = 0;
+		zip_par.applied = 0;
+		zip_par.nextId  = 0;
+		if (!ZipParallel_Init(stream)) return ZipParallel_Extract(numThreads);
+		ZipParallel_Free();
+	}
+
+	/* Fallback to extracting entries on only this thread when multiple threads wouldn't help */
+	/*  (or when the archive couldn't be read into memory, in which case this reports the error) */
 	Zip_Init(&state, stream);
 	state.ProcessEntry = ProcessZipEntry;
 	return Zip_Extract(&state);
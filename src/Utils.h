@@ -40,7 +40,13 @@ int Utils_AccumulateWheelDelta(float* accumulator, float delta);
 #define Utils_AdjViewDist(value) ((int)(1.4142135f * (value)))
 
 cc_uint8 Utils_CalcSkinType(const struct Bitmap* bmp);
+/* Calculates the CRC32 of the given data. */
 cc_uint32 Utils_CRC32(const cc_uint8* data, cc_uint32 length);
+/* Updates a running CRC32 (starts as 0xFFFFFFFF) with the given data. */
+/* NOTE: The actual CRC32 is the running CRC32 XOR 0xFFFFFFFF */
+cc_uint32 Utils_Crc32Update(cc_uint32 crc, const cc_uint8* data, cc_uint32 length);
+/* Updates a running Adler32 (starts as 1) with the given data. */
+cc_uint32 Utils_Adler32Update(cc_uint32 adler, const cc_uint8* data, cc_uint32 length);
 /* CRC32 lookup table, for faster CRC32 calculations. */
 /* NOTE: This cannot be just indexed by byte value - see Utils_CRC32 implementation. */
 extern const cc_uint32 Utils_Crc32Table[256];
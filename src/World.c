@@ -10,6 +10,9 @@
 #include "Game.h"
 #include "TexturePack.h"
 #include "Window.h"
+#include "Stream.h"
+#include "Errors.h"
+#include "Funcs.h"
 
 struct _WorldData World;
 static char nameBuffer[STRING_SIZE];
@@ -37,7 +40,9 @@ static void GenerateNewUuid(void) {
 	World.Uuid[8] |= 0x80; /* variant 2*/
 }
 
+static void WorldSnapshot_CopyAll(void);
 void World_Reset(void) {
+	WorldSnapshot_CopyAll();
 #ifdef EXTENDED_BLOCKS
 	if (World.Blocks != World.Blocks2) Mem_Free(World.Blocks2);
 	World.Blocks2 = NULL;
@@ -112,6 +117,174 @@ void World_OutOfMemory(void) {
 }
 
 
+/*########################################################################################################################*
+*-----------------------------------------------------World snapshot------------------------------------------------------*
+*#########################################################################################################################*/
+/* The snapshot is split into sections of the blocks array, which are only copied right before they are */
+/*  first modified. So until then, the background thread reads the blocks directly from the world */
+#define SNAPSHOT_SECTION_SHIFT 16
+#define SNAPSHOT_SECTION_SIZE (1 << SNAPSHOT_SECTION_SHIFT)
+
+static struct WorldSnapshot {
+	BlockRaw* blocks;
+#ifdef EXTENDED_BLOCKS
+	BlockRaw* blocks2;
+#endif
+	int volume, numSections;
+	/* Copy of each section (lower bits, then upper bits), made before it was modified. NULL if unmodified */
+	BlockRaw** sections;
+	void* mutex;
+	cc_bool active;
+	/* Whether changes to the world's blocks still need to be tracked, i.e. false once */
+	/*  every section has been copied, which happens before a different map is loaded */
+	cc_bool tracking;
+	/* Set when a section couldn't be copied, in which case the snapshot no longer matches the world */
+	cc_result res;
+} snapshot;
+
+#ifdef EXTENDED_BLOCKS
+#define Snapshot_HasUpper() (snapshot.blocks2 != snapshot.blocks)
+#else
+#define Snapshot_HasUpper() false
+#endif
+
+cc_result WorldSnapshot_Begin(void) {
+	if (snapshot.active || !World.Blocks) return ERR_NOT_SUPPORTED;
+	snapshot.numSections = (World.Volume + SNAPSHOT_SECTION_SIZE - 1) >> SNAPSHOT_SECTION_SHIFT;
+
+	snapshot.sections = (BlockRaw**)Mem_TryAllocCleared(snapshot.numSections, sizeof(BlockRaw*));
+	if (!snapshot.sections) return ERR_OUT_OF_MEMORY;
+
+	snapshot.blocks  = World.Blocks;
+#ifdef EXTENDED_BLOCKS
+	snapshot.blocks2 = World.Blocks2;
+#endif
+	snapshot.volume  = World.Volume;
+	if (!snapshot.mutex) snapshot.mutex = Mutex_Create();
+	snapshot.active   = true;
+	snapshot.tracking = true;
+	snapshot.res      = 0;
+	return 0;
+}
+
+static void WorldSnapshot_CopySection(int i) {
+	int offset = i << SNAPSHOT_SECTION_SHIFT;
+	int size   = min(snapshot.volume - offset, SNAPSHOT_SECTION_SIZE);
+	BlockRaw* copy;
+
+	/* Failing to save the map shouldn't also take down the game, so the save is just aborted instead */
+	copy = (BlockRaw*)Mem_TryAlloc(size, Snapshot_HasUpper() ? 2 : 1);
+	if (!copy) {
+		Mutex_Lock(snapshot.mutex);
+		{
+			snapshot.res = ERR_OUT_OF_MEMORY;
+		}
+		Mutex_Unlock(snapshot.mutex);
+		snapshot.tracking = false;
+		return;
+	}
+
+	Mem_Copy(copy, snapshot.blocks + offset, size);
+#ifdef EXTENDED_BLOCKS
+	if (Snapshot_HasUpper()) Mem_Copy(copy + size, snapshot.blocks2 + offset, size);
+#endif
+
+	Mutex_Lock(snapshot.mutex);
+	{
+		snapshot.sections[i] = copy;
+	}
+	Mutex_Unlock(snapshot.mutex);
+}
+
+/* Ensures the section containing the given block has been copied, before the block is modified */
+static CC_INLINE void WorldSnapshot_Touch(int index) {
+	int i = index >> SNAPSHOT_SECTION_SHIFT;
+	if (!snapshot.tracking || i >= snapshot.numSections) return;
+	if (!snapshot.sections[i]) WorldSnapshot_CopySection(i);
+}
+
+/* Copies all remaining sections, as the world's blocks are about to be freed */
+/* The snapshot is then detached from the world, as blocks set afterwards belong to a different map */
+static void WorldSnapshot_CopyAll(void) {
+	int i;
+	if (!snapshot.tracking) return;
+
+	for (i = 0; i < snapshot.numSections && snapshot.tracking; i++) {
+		if (!snapshot.sections[i]) WorldSnapshot_CopySection(i);
+	}
+	snapshot.tracking = false;
+}
+
+cc_result WorldSnapshot_Read(BlockRaw* dst, int index, int count, cc_bool upper) {
+	BlockRaw* src;
+	int i, offset, size, part;
+	cc_result res;
+
+	/* Sections must be copied while locked, as the main thread may be about to modify them */
+	Mutex_Lock(snapshot.mutex);
+	{
+		/* If a section couldn't be copied, the world's blocks may have already been modified or freed */
+		res = snapshot.res;
+
+		for (; count > 0 && !res; index += part, dst += part, count -= part) {
+			i      = index >> SNAPSHOT_SECTION_SHIFT;
+			offset = i << SNAPSHOT_SECTION_SHIFT;
+			size   = min(snapshot.volume - offset, SNAPSHOT_SECTION_SIZE);
+			part   = min(count, offset + size - index);
+
+			if (snapshot.sections[i]) {
+				src = snapshot.sections[i] + (upper ? size : 0) + (index - offset);
+			} else {
+				src = snapshot.blocks + index;
+#ifdef EXTENDED_BLOCKS
+				if (upper) src = snapshot.blocks2 + index;
+#endif
+			}
+			Mem_Copy(dst, src, part);
+		}
+	}
+	Mutex_Unlock(snapshot.mutex);
+	return res;
+}
+
+cc_result WorldSnapshot_Write(struct Stream* stream, cc_bool upper) {
+	BlockRaw* chunk;
+	int i, offset, size;
+	cc_result res = 0;
+
+	chunk = (BlockRaw*)Mem_TryAlloc(SNAPSHOT_SECTION_SIZE, 1);
+	if (!chunk) return ERR_OUT_OF_MEMORY;
+
+	for (i = 0; i < snapshot.numSections; i++) {
+		offset = i << SNAPSHOT_SECTION_SHIFT;
+		size   = min(snapshot.volume - offset, SNAPSHOT_SECTION_SIZE);
+
+		if ((res = WorldSnapshot_Read(chunk, offset, size, upper))) break;
+		if ((res = Stream_Write(stream, chunk, size)))              break;
+	}
+
+	Mem_Free(chunk);
+	return res;
+}
+
+void WorldSnapshot_End(void) {
+	int i;
+	if (!snapshot.active) return;
+
+	for (i = 0; i < snapshot.numSections; i++) {
+		Mem_Free(snapshot.sections[i]);
+	}
+	Mem_Free(snapshot.sections);
+
+	snapshot.sections = NULL;
+	snapshot.active   = false;
+	snapshot.tracking = false;
+}
+
+
+/*########################################################################################################################*
+*----------------------------------------------------------Blocks---------------------------------------------------------*
+*#########################################################################################################################*/
 #ifdef EXTENDED_BLOCKS
 static CC_NOINLINE void LazyInitUpper(int i, BlockID block) {
 	BlockRaw* data = (BlockRaw*)Mem_TryAllocCleared(World.Volume, 1);
@@ -123,6 +296,7 @@ static CC_NOINLINE void LazyInitUpper(int i, BlockID block) {
 
 void World_SetBlock(int x, int y, int z, BlockID block) {
 	int i = World_Pack(x, y, z);
+	WorldSnapshot_Touch(i);
 	World.Blocks[i] = (BlockRaw)block;
 
 	/* defer allocation of second map array if possible */
@@ -135,7 +309,9 @@ void World_SetBlock(int x, int y, int z, BlockID block) {
 }
 #else
 void World_SetBlock(int x, int y, int z, BlockID block) {
-	World.Blocks[World_Pack(x, y, z)] = block; 
+	int i = World_Pack(x, y, z);
+	WorldSnapshot_Touch(i);
+	World.Blocks[i] = block; 
 }
 #endif
 
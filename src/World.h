@@ -7,6 +7,7 @@ Represents a fixed size 3D array of blocks and associated metadata
 Copyright 2014-2022 ClassiCube | Licensed under BSD-3
 */
 struct AABB;
+struct Stream;
 extern struct IGameComponent World_Component;
 
 /* Unpacka an index into x,y,z (slow!) */
@@ -96,6 +97,21 @@ void World_SetBlock(int x, int y, int z, BlockID block);
 /* Otherwise returns the block at the given coordinates. */
 BlockID World_SafeGetBlock(int x, int y, int z);
 
+/* Takes a copy on write snapshot of the world's blocks, so they can be read by a background thread. */
+/* NOTE: Sections of the blocks are only actually copied right before they are first modified. */
+/* Returns ERR_NOT_SUPPORTED if a snapshot already exists or there are no blocks to snapshot, */
+/*  or ERR_OUT_OF_MEMORY if there is insufficient memory. */
+cc_result WorldSnapshot_Begin(void);
+/* Copies the lower 8 bits (or upper 8 bits if upper) of count blocks in the snapshot, starting at the given index. */
+/* NOTE: Can be called on a background thread, while the world continues to be modified on the main thread. */
+cc_result WorldSnapshot_Read(BlockRaw* dst, int index, int count, cc_bool upper);
+/* Writes the lower 8 bits (or upper 8 bits if upper) of the blocks in the snapshot to the given stream. */
+/* NOTE: Can be called on a background thread, while the world continues to be modified on the main thread. */
+/* NOTE: Fails with ERR_OUT_OF_MEMORY if a section couldn't be copied before it was modified. */
+cc_result WorldSnapshot_Write(struct Stream* stream, cc_bool upper);
+/* Frees the snapshot. Must only be called once the background thread has finished using it. */
+void WorldSnapshot_End(void);
+
 /* Whether the given coordinates lie inside the map. */
 static CC_INLINE cc_bool World_Contains(int x, int y, int z) {
 	return (unsigned)x < (unsigned)World.Width